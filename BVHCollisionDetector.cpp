@@ -0,0 +1,23 @@
+#include "BVHCollisionDetector.h"
+
+BVHCollisionDetector::BVHCollisionDetector(chai3d::cTriangleArrayPtr triangles, double radius) :
+    m_triangles(triangles), m_radius(radius) {
+}
+
+bool BVHCollisionDetector::computeCollision(chai3d::cGenericObject* a_object,
+    chai3d::cVector3d& a_segmentPointA,
+    chai3d::cVector3d& a_segmentPointB,
+    chai3d::cCollisionRecorder& a_recorder,
+    chai3d::cCollisionSettings& a_settings) {
+
+    // broadphase on the refit tree, exact test on the mesh triangles
+    m_candidates.clear();
+    m_bvh.querySegment(a_segmentPointA, a_segmentPointB, a_settings.m_collisionRadius + m_radius, m_candidates);
+
+    bool hit = false;
+    for (int t : m_candidates) {
+        if (m_triangles->computeCollision(t, a_object, a_segmentPointA, a_segmentPointB, a_recorder, a_settings))
+            hit = true;
+    }
+    return hit;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+
+#include "chai3d.h"
+
+#include "TriangleBVH.h"
+
+// collision detector for meshes that deform but keep their triangles, a drop-in for
+// createAABBCollisionDetector that is refit instead of rebuilt when vertices move
+
+class BVHCollisionDetector : public chai3d::cGenericCollision
+{
+public:
+	// triangle t of the mesh must be triangle t of the indices given to getBVH().build(), and the
+	// mesh vertices the positions of the last build/refit (the exact test reads the mesh)
+	BVHCollisionDetector(chai3d::cTriangleArrayPtr triangles, double radius);
+	~BVHCollisionDetector() = default;
+
+	TriangleBVH& getBVH() { return m_bvh; }
+
+	bool computeCollision(chai3d::cGenericObject* a_object,
+		chai3d::cVector3d& a_segmentPointA,
+		chai3d::cVector3d& a_segmentPointB,
+		chai3d::cCollisionRecorder& a_recorder,
+		chai3d::cCollisionSettings& a_settings) override;
+
+private:
+	chai3d::cTriangleArrayPtr m_triangles;
+
+	TriangleBVH m_bvh;
+
+	// extra distance covered by the broadphase, like the radius of createAABBCollisionDetector
+	double m_radius;
+
+	std::vector<int> m_candidates;
+};
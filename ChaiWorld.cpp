@@ -3,6 +3,15 @@
 #include "Macro.h"
 #include "Global.h"
 
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+    // longest cloth step [s], longer steps of the multi-rate mode are split
+    const double kMaxClothStep = 0.001;
+}
+
 ChaiWorld ChaiWorld::chaiWorld;
 
 ChaiWorld::ChaiWorld() {
@@ -82,6 +91,27 @@ ChaiWorld::ChaiWorld() {
     // define the radius of the tool (sphere)
     m_multiCursorRadius = 0.1;
 
+    // single threaded cloth step by default
+    m_threadPool = nullptr;
+
+    m_recorder = nullptr;
+    m_trace = nullptr;
+
+    m_clothCollision = true;
+    m_refinementFactor = 1;
+    m_surfaceContact = false;
+
+    m_candidateForceX = nullptr;
+    m_candidateForceY = nullptr;
+    m_candidateForceZ = nullptr;
+
+    m_sceneVersion = 0;
+
+    // single-rate by default, the cursor stays out of the cloth until the haptic thread publishes it
+    m_multiRate = false;
+    for (int k = 0; k < 3; k++)
+        m_cursorPositions.getBuffer(k).set(0.0, 0.0, 1000.0);
+
     //  ============================ Cursor setup ===========================
 
     // create a cursor and insert into the world
@@ -139,12 +169,34 @@ ChaiWorld::~ChaiWorld() {
     //delete m_handler;
 }
 
+void ChaiWorld::setClothThreads(int numThreads, int reservedCore) {
+    delete m_threadPool;
+    m_threadPool = (numThreads > 1) ? new ThreadPool(numThreads, reservedCore) : nullptr;
+}
+
+void ChaiWorld::setHapticDevice(chai3d::cGenericHapticDevicePtr hapticDevice) {
+    // release the device the cursor is currently connected to
+    m_multiCursor->stop();
+
+    m_hapticDevice = hapticDevice;
+    m_hapticDeviceInfo = m_hapticDevice->getSpecifications();
+
+    // reconnect the cursor, the workspace mapping depends on the device
+    m_multiCursor->setHapticDevice(m_hapticDevice);
+    m_multiCursor->setWorkspaceRadius(m_cursorWorkspaceRadius);
+    m_multiCursor->start();
+
+    m_workspaceScaleFactor = m_cursorWorkspaceRadius / m_hapticDeviceInfo.m_workspaceRadius;
+    m_maxStiffness = m_hapticDeviceInfo.m_maxLinearStiffness / m_workspaceScaleFactor;
+}
+
 void ChaiWorld::cameraMoveLeft() {
     m_cameraPos.y(m_cameraPos.y() - 0.1);
     m_cameraLookAt.y(m_cameraLookAt.y() - 0.1);
     m_camera->set(m_cameraPos,    // camera position (eye)
         m_cameraLookAt,    // look at position (target)
         chai3d::cVector3d(0.0, 0.0, 1.0)); // up vector
+    m_sceneVersion++;
 }
 
 void ChaiWorld::cameraMoveRight() {
@@ -153,12 +205,45 @@ void ChaiWorld::cameraMoveRight() {
     m_camera->set(m_cameraPos,    // camera position (eye)
         m_cameraLookAt,    // look at position (target)
         chai3d::cVector3d(0.0, 0.0, 1.0)); // up vector
+    m_sceneVersion++;
 }
 
-void ChaiWorld::updateCloth(Polygons* polygonCloth) {
-   
-    polygonCloth->updatePolygons();
-    
+void ChaiWorld::addRigid(Rigid* rigid) {
+    m_rigids.push_back(rigid);
+}
+
+void ChaiWorld::addDeformable(Deformable* deformable) {
+    m_deformables.push_back(deformable);
+    if (m_surfaceContact)
+        deformable->setSurfaceContact(true);
+    else if (m_refinementFactor > 1)
+        deformable->setRefinement(m_refinementFactor);
+}
+
+void ChaiWorld::removeDeformable(Deformable* deformable) {
+    m_deformables.erase(std::remove(m_deformables.begin(), m_deformables.end(), deformable), m_deformables.end());
+
+    // polygons following it keep their last positions
+    for (Polygons* polygons : m_polygons)
+        if (polygons->m_source == deformable)
+            polygons->m_source = nullptr;
+}
+
+void ChaiWorld::addPolygons(Polygons* polygons) {
+    m_polygons.push_back(polygons);
+}
+
+bool ChaiWorld::updateDisplay() {
+    bool changed = false;
+    for (Deformable* deformable : m_deformables) {
+        if (deformable->updateDisplay())
+            changed = true;
+    }
+    for (Polygons* polygons : m_polygons) {
+        if (polygons->updatePolygons())
+            changed = true;
+    }
+    return changed;
 }
 
 void ChaiWorld::cameraMoveForward() {
@@ -167,6 +252,7 @@ void ChaiWorld::cameraMoveForward() {
     m_camera->set(m_cameraPos,    // camera position (eye)
         m_cameraLookAt,    // look at position (target)
         chai3d::cVector3d(0.0, 0.0, 1.0)); // up vector
+    m_sceneVersion++;
 }
 
 void ChaiWorld::cameraMoveBack() {
@@ -175,86 +261,63 @@ void ChaiWorld::cameraMoveBack() {
     m_camera->set(m_cameraPos,    // camera position (eye)
         m_cameraLookAt,    // look at position (target)
         chai3d::cVector3d(0.0, 0.0, 1.0)); // up vector
+    m_sceneVersion++;
 }
 
-void ChaiWorld::updateHapticsMulti(double time, Rigid* table, Deformable* cloth, Polygons* polygonCloth) {
+void ChaiWorld::updateHapticsMulti(double time) {
+    if (m_trace)
+        m_trace->beginTick();
+
     chai3d::cVector3d pos;
     m_hapticDevice->getPosition(pos);
+    if (m_recorder)
+        m_recorder->record(m_hapticDevice.get(), pos);
     pos.mul(m_workspaceScaleFactor);
     //m_multiCursor->setLocalPos(pos); // tool side will handle position set (m_multiCursor->updateFromDevice();)
 
     // use proxy position to check collision with deformable object, otherwise god object will penetrate the rigidbody
     chai3d::cVector3d renderPos = m_multiCursor->getHapticPoint(0)->getGlobalPosProxy();
+    if (m_trace)
+        m_trace->mark(PHASE_DEVICE);
 
-    // clear all external forces
-    m_defWorld->clearExternalForces();
-
-    // compute reaction forces
-    chai3d::cVector3d force(0.0, 0.0, 0.0);
-
-    for (int i = 0; i < cloth->m_length; i++)
-    {
-        for (int j = 0; j < cloth->m_width; j++)
-        {
-            chai3d::cVector3d nodePos = cloth->m_nodes[i][j]->m_pos;
-            //chai3d::cVector3d f = computeForce(pos, m_multiCursorRadius, nodePos, cloth->m_modelRadius, cloth->m_stiffness);
-            chai3d::cVector3d f = computeForce(renderPos, m_multiCursorRadius, nodePos, cloth->m_modelRadius, cloth->m_stiffness);
-            chai3d::cVector3d tmpfrc = -1.0 * f;
-
-            if (polygonCloth) {
-                polygonCloth->m_positions[i * cloth->m_length + j].x(nodePos.x());
-                polygonCloth->m_positions[i * cloth->m_length + j].y(nodePos.y());
-                polygonCloth->m_positions[i * cloth->m_length + j].z(nodePos.z() + 0.04);
-            }
-
-            double modelHeight = cloth->m_modelRadius;
-            //if (nodePos.get(2) - table->getOffset().z() < modelHeight)
-            //    std::cout << cGELSkeletonLink::s_default_kSpringElongation * (table->getOffset().z() - nodePos.get(2)) << std::endl;
-            if (nodePos.get(2) - table->getOffset().z() < modelHeight) {
-                tmpfrc.z(tmpfrc.get(2) +
-                    cGELSkeletonLink::s_default_kSpringElongation * (modelHeight + table->getOffset().z() - nodePos.get(2)));
-            }
-            cloth->m_nodes[i][j]->setExternalForce(tmpfrc);
-
-            force.add(f);
-        }
+    chai3d::cVector3d force;
+    if (m_multiRate) {
+        // hand the cursor to the cloth thread and render the patch of its latest step
+        m_cursorPositions.getWriteBuffer() = renderPos;
+        m_cursorPositions.publish();
+
+        m_contactPatches.update();
+        force = m_contactPatches.getReadBuffer().computeForce(renderPos);
+        if (m_trace)
+            m_trace->mark(PHASE_CONTACT);
     }
-
-    // update cGELSkeletonLink elongation
-    static double coeff = 0.0;
-    coeff += 0.01;
-    // enable and assign table to this if you have a table
-    //std::vector<std::vector<double>> elongationTable((cloth->m_length - 1), std::vector<double>((cloth->m_width - 1) * 4, coeff));
-    
-    std::list<cGELSkeletonLink*>::iterator it = cloth->m_defObject->m_links.begin();
-    for (int i = 0; i < cloth->m_length - 1; i++)
-    {
-        for (int j = 0; j < cloth->m_width - 1; j++)
-        {
-            for (int k = 0; k < 4; k++) {
-                //(*it)->m_kSpringElongation = elongationTable[i][j*4+k]; ++it;
-                (*it)->m_kSpringElongation = (j * j + 5) * 1; ++it;
-            }
-        }
+    else {
+        force = stepScene(time, renderPos);
     }
 
-    ChaiWorld::chaiWorld.getDefWorld()->updateDynamics(time);
-
     // scale force
     force.mul(ChaiWorld::chaiWorld.getDeviceForceScale() / ChaiWorld::chaiWorld.getWorkspaceScaleFactor());
 
     // compute global reference frames for each object
     m_world->computeGlobalPositions(true);
+    if (m_trace)
+        m_trace->mark(PHASE_GLOBAL_POSITIONS);
 
     // update position and orientation of tool
     m_multiCursor->updateFromDevice();
+    if (m_trace)
+        m_trace->mark(PHASE_DEVICE);
 
     // compute interaction forces
     m_multiCursor->computeInteractionForces();
+    if (m_trace)
+        m_trace->mark(PHASE_INTERACTION);
 
     // send forces to haptic device
     //m_multiCursor->applyToDevice();
     m_multiCursor->applyToDevice(force);
+    if (m_trace)
+        m_trace->mark(PHASE_APPLY);
 
     // ====== force -> force from deformable object ===============================
     // ====== m_multiCursor->applyToDevice -> deformable force + rigid force ======
@@ -265,10 +328,421 @@ void ChaiWorld::updateHapticsMulti(double time, Rigid* table, Deformable* cloth,
     // compute a boundary box
     //polygonCloth->m_object->computeBoundaryBox(true);
 
-    if(polygonCloth)
-        polygonCloth->m_object->createAABBCollisionDetector(m_multiCursorRadius);
+    // refit instead of rebuilding the collision tree
+    for (Polygons* polygons : m_polygons)
+        polygons->refitCollision();
+
+    if (m_trace) {
+        m_trace->mark(PHASE_COLLISION);
+        m_trace->endTick();
+    }
 }
 
+void ChaiWorld::updateClothMulti(double time) {
+    m_cursorPositions.update();
+
+    // the explicit engines are only stable up to the step of the single-rate loop
+    int substeps = std::max(1, (int)ceil(time / kMaxClothStep - 1e-9));
+    for (int k = 0; k < substeps; k++)
+        stepScene(time / substeps, m_cursorPositions.getReadBuffer());
+}
+
+chai3d::cVector3d ChaiWorld::computeClothContact(Deformable* cloth, const chai3d::cVector3d& renderPos) {
+    if (cloth->m_surface)
+        return computeSurfaceContact(cloth, renderPos);
+
+    const double* nodeX;
+    const double* nodeY;
+    const double* nodeZ;
+    int numNodes = cloth->m_length * cloth->m_width;
+    cloth->getPackedNodePositions(nodeX, nodeY, nodeZ);
+
+    // only nodes in cells overlapping the cursor sphere can be in contact. a reduced cloth
+    // updates its broadphase by slices (see Deformable::updateDynamics), the margin covers the
+    // nodes that moved since
+    double contactDistance = m_multiCursorRadius + cloth->m_modelRadius;
+    double queryDistance = contactDistance;
+    if (cloth->m_reduced)
+        queryDistance += cloth->m_modelRadius;
+    else
+        cloth->m_spatialHash.update(nodeX, nodeY, nodeZ, numNodes);
+    m_contactCandidates.clear();
+    cloth->m_spatialHash.query(renderPos, queryDistance, m_contactCandidates);
+
+    // inside the refined window the patch nodes touch the cursor instead of the coarse ones
+    ClothRefinement* refinement = (cloth->m_refinement && cloth->m_refinement->isActive()) ? cloth->m_refinement : nullptr;
+    int numSlots = numNodes;
+    int numCoarse = (int)m_contactCandidates.size();
+    const double* fineX = nullptr;
+    const double* fineY = nullptr;
+    const double* fineZ = nullptr;
+    if (refinement) {
+        m_contactCandidates.erase(std::remove_if(m_contactCandidates.begin(), m_contactCandidates.end(),
+            [refinement](int index) { return refinement->isSlaved(index); }), m_contactCandidates.end());
+        numCoarse = (int)m_contactCandidates.size();
+        refinement->query(renderPos, contactDistance, m_contactCandidates);
+        refinement->getPackedNodePositions(fineX, fineY, fineZ);
+        numSlots += refinement->getNumNodes();
+    }
+
+    int numCandidates = (int)m_contactCandidates.size();
+    m_candidateX.resize(numCandidates);
+    m_candidateY.resize(numCandidates);
+    m_candidateZ.resize(numCandidates);
+    if ((int)m_contactSlot.size() < numSlots)
+        m_contactSlot.resize(numSlots, -1);
+    for (int c = 0; c < numCoarse; c++) {
+        int index = m_contactCandidates[c];
+        if (cloth->m_reduced) {
+            cloth->m_reduced->getNodePos(index, m_candidateX[c], m_candidateY[c], m_candidateZ[c]);
+        }
+        else {
+            m_candidateX[c] = nodeX[index];
+            m_candidateY[c] = nodeY[index];
+            m_candidateZ[c] = nodeZ[index];
+        }
+        m_contactSlot[index] = c;
+    }
+    for (int c = numCoarse; c < numCandidates; c++) {
+        int index = m_contactCandidates[c];
+        m_candidateX[c] = fineX[index];
+        m_candidateY[c] = fineY[index];
+        m_candidateZ[c] = fineZ[index];
+        m_contactSlot[numNodes + index] = c;
+    }
+
+    // compute reaction forces of the candidates in one pass (see computeForce for the model)
+    chai3d::cVector3d force = m_contactKernel.computeForces(m_candidateX.data(), m_candidateY.data(), m_candidateZ.data(),
+        numCandidates, renderPos, m_multiCursorRadius, cloth->m_modelRadius, cloth->m_stiffness);
+    m_candidateForceX = m_contactKernel.getForceX();
+    m_candidateForceY = m_contactKernel.getForceY();
+    m_candidateForceZ = m_contactKernel.getForceZ();
+    if (numCandidates == numCoarse)
+        return force;
+
+    // a patch node pushes with its share of the mass of a coarse node
+    double weight = refinement->getNodeWeight();
+    m_weightedForceX.assign(m_candidateForceX, m_candidateForceX + numCandidates);
+    m_weightedForceY.assign(m_candidateForceY, m_candidateForceY + numCandidates);
+    m_weightedForceZ.assign(m_candidateForceZ, m_candidateForceZ + numCandidates);
+    for (int c = numCoarse; c < numCandidates; c++) {
+        force.add((weight - 1.0) * m_weightedForceX[c], (weight - 1.0) * m_weightedForceY[c], (weight - 1.0) * m_weightedForceZ[c]);
+        m_weightedForceX[c] *= weight;
+        m_weightedForceY[c] *= weight;
+        m_weightedForceZ[c] *= weight;
+    }
+    m_candidateForceX = m_weightedForceX.data();
+    m_candidateForceY = m_weightedForceY.data();
+    m_candidateForceZ = m_weightedForceZ.data();
+    return force;
+}
+
+chai3d::cVector3d ChaiWorld::computeSurfaceContact(Deformable* cloth, const chai3d::cVector3d& renderPos) {
+    const double* nodeX;
+    const double* nodeY;
+    const double* nodeZ;
+    int numNodes = cloth->m_length * cloth->m_width;
+    cloth->getPackedNodePositions(nodeX, nodeY, nodeZ);
+
+    SurfaceContact* surface = cloth->m_surface;
+    surface->setNodePositions(nodeX, nodeY, nodeZ);
+
+    // the packed nodes of a reduced cloth are reconstructed by slices (see Deformable::updateDynamics),
+    // the ones around the cursor are brought up to date
+    double contactDistance = m_multiCursorRadius + cloth->m_modelRadius;
+    if (cloth->m_reduced) {
+        m_contactCandidates.clear();
+        cloth->m_spatialHash.query(renderPos, contactDistance + cloth->m_modelRadius, m_contactCandidates);
+        for (int index : m_contactCandidates) {
+            double x, y, z;
+            cloth->m_reduced->getNodePos(index, x, y, z);
+            surface->setNodePos(index, chai3d::cVector3d(x, y, z));
+        }
+    }
+
+    // the node radius thickens the surface like it does the skeleton
+    chai3d::cVector3d force = surface->computeForce(renderPos, contactDistance, cloth->m_stiffness);
+
+    int numCandidates = surface->getNumContactNodes();
+    m_contactCandidates.resize(numCandidates);
+    m_candidateX.resize(numCandidates);
+    m_candidateY.resize(numCandidates);
+    m_candidateZ.resize(numCandidates);
+    m_weightedForceX.resize(numCandidates);
+    m_weightedForceY.resize(numCandidates);
+    m_weightedForceZ.resize(numCandidates);
+    if ((int)m_contactSlot.size() < numNodes)
+        m_contactSlot.resize(numNodes, -1);
+    for (int c = 0; c < numCandidates; c++) {
+        int index = surface->getContactNode(c);
+        double weight = surface->getContactWeight(c);
+        const chai3d::cVector3d& nodePos = surface->getNodePos(index);
+        m_contactCandidates[c] = index;
+        m_candidateX[c] = nodePos.x();
+        m_candidateY[c] = nodePos.y();
+        m_candidateZ[c] = nodePos.z();
+        m_weightedForceX[c] = weight * force.x();
+        m_weightedForceY[c] = weight * force.y();
+        m_weightedForceZ[c] = weight * force.z();
+        m_contactSlot[index] = c;
+    }
+    m_candidateForceX = m_weightedForceX.data();
+    m_candidateForceY = m_weightedForceY.data();
+    m_candidateForceZ = m_weightedForceZ.data();
+    return force;
+}
+
+void ChaiWorld::collideCloths() {
+    // sleeping cloths stay in as obstacles, pairs of two sleeping ones are not tested
+    m_collision.clear();
+    m_collisionFirst.resize(m_deformables.size());
+    for (size_t k = 0; k < m_deformables.size(); k++) {
+        Deformable* cloth = m_deformables[k];
+        const double* nodeX;
+        const double* nodeY;
+        const double* nodeZ;
+        cloth->getPackedNodePositions(nodeX, nodeY, nodeZ);
+
+        // reduced cloths take no collision forces, they enter without nodes to keep the indices
+        int width = cloth->m_reduced ? 0 : cloth->m_width;
+        int length = cloth->m_reduced ? 0 : cloth->m_length;
+        m_collisionFirst[k] = m_collision.addCloth(nodeX, nodeY, nodeZ, width, length, cloth->m_modelRadius,
+            !cloth->m_sleeping);
+    }
+    m_collision.resolve(cGELSkeletonLink::s_default_kSpringElongation);
+
+    for (size_t k = 0; k < m_deformables.size(); k++) {
+        if (m_collision.isTouched((int)k))
+            m_deformables[k]->m_sleeping = false;
+    }
+}
+
+chai3d::cVector3d ChaiWorld::stepScene(double time, const chai3d::cVector3d& renderPos) {
+    // phases of the cloth step are part of the haptic tick unless the cloth has its own thread
+    TickTrace* trace = m_multiRate ? nullptr : m_trace;
+
+    // clear all external forces
+    m_defWorld->clearExternalForces();
+
+    // cursor sphere against the bounds of the last step. a cloth out of reach gets no contact
+    // work, and if it also rests it is not stepped at all. GEL meshes are all stepped by m_defWorld
+    for (Deformable* cloth : m_deformables) {
+        bool inReach = cloth->isNear(renderPos, m_multiCursorRadius + cloth->m_modelRadius);
+        cloth->m_sleeping = !inReach && cloth->m_engine != ClothEngine::GEL && cloth->isSettled();
+    }
+
+    if (m_clothCollision)
+        collideCloths();
+    if (trace)
+        trace->mark(PHASE_TABLE);
+
+    chai3d::cVector3d force(0.0, 0.0, 0.0);
+
+    // local contact model for the haptic loop, only read in multi-rate mode. it is fitted to the
+    // cloth pushing hardest on the cursor, or to the first one in reach if none touches it
+    ContactPatch& patch = m_contactPatches.getWriteBuffer();
+    double patchForce = -1.0;
+
+    for (size_t k = 0; k < m_deformables.size(); k++) {
+        Deformable* cloth = m_deformables[k];
+        if (cloth->m_sleeping)
+            continue;
+
+        double contactDistance = m_multiCursorRadius + cloth->m_modelRadius;
+        bool inReach = cloth->isNear(renderPos, contactDistance);
+
+        // the refined window is in place before the cursor touches the cloth
+        cloth->followCursor(renderPos, 2.0 * contactDistance);
+        ClothRefinement* refinement = (cloth->m_refinement && cloth->m_refinement->isActive()) ? cloth->m_refinement : nullptr;
+
+        int numCandidates = 0;
+        const double* forceX = nullptr;
+        const double* forceY = nullptr;
+        const double* forceZ = nullptr;
+        if (inReach) {
+            chai3d::cVector3d clothForce = computeClothContact(cloth, renderPos);
+            force.add(clothForce);
+
+            numCandidates = (int)m_contactCandidates.size();
+            forceX = m_candidateForceX;
+            forceY = m_candidateForceY;
+            forceZ = m_candidateForceZ;
+
+            if (clothForce.length() > patchForce) {
+                if (cloth->m_surface) {
+                    // the proxy force as if from a single node on the surface point, the plane
+                    // then goes through the proxy
+                    chai3d::cVector3d point;
+                    double x = 0.0, y = 0.0, z = 0.0;
+                    bool onSurface = cloth->m_surface->getSurfacePoint(point);
+                    if (onSurface) {
+                        x = point.x();
+                        y = point.y();
+                        z = point.z();
+                    }
+                    double fx = clothForce.x(), fy = clothForce.y(), fz = clothForce.z();
+                    patch.build(renderPos, &x, &y, &z, &fx, &fy, &fz, onSurface ? 1 : 0, contactDistance, cloth->m_stiffness);
+                }
+                else {
+                    patch.build(renderPos, m_candidateX.data(), m_candidateY.data(), m_candidateZ.data(),
+                        forceX, forceY, forceZ, numCandidates, contactDistance, cloth->m_stiffness);
+                }
+                patchForce = clothForce.length();
+            }
+        }
+        else if (cloth->m_surface) {
+            cloth->m_surface->release();
+        }
+        if (trace)
+            trace->mark(PHASE_CONTACT);
+
+        // a reduced cloth is only pushed where the cursor is: its contact candidates, which also
+        // meet the rigids the cursor presses them against. no cloth collision, no elastic model
+        if (cloth->m_reduced) {
+            for (int c = 0; c < numCandidates; c++) {
+                int index = m_contactCandidates[c];
+                m_contactSlot[index] = -1;
+                chai3d::cVector3d nodePos(m_candidateX[c], m_candidateY[c], m_candidateZ[c]);
+                chai3d::cVector3d tmpfrc(-forceX[c], -forceY[c], -forceZ[c]);
+                for (Rigid* rigid : m_rigids) {
+                    chai3d::cVector3d normal;
+                    double distance = rigid->m_distanceField.sample(nodePos, normal);
+                    if (distance < cloth->m_modelRadius)
+                        tmpfrc.add(cGELSkeletonLink::s_default_kSpringElongation * (cloth->m_modelRadius - distance) * normal);
+                }
+                cloth->m_reduced->addNodeForce(index, tmpfrc);
+            }
+            if (trace)
+                trace->mark(PHASE_TABLE);
+            continue;
+        }
+
+        const double* nodeX;
+        const double* nodeY;
+        const double* nodeZ;
+        cloth->getPackedNodePositions(nodeX, nodeY, nodeZ);
+
+        // forces of the other cloths and of folds of this one
+        const double* collisionX = nullptr;
+        const double* collisionY = nullptr;
+        const double* collisionZ = nullptr;
+        if (m_clothCollision) {
+            collisionX = m_collision.getForceX() + m_collisionFirst[k];
+            collisionY = m_collision.getForceY() + m_collisionFirst[k];
+            collisionZ = m_collision.getForceZ() + m_collisionFirst[k];
+        }
+
+        for (int i = 0; i < cloth->m_length; i++)
+        {
+            for (int j = 0; j < cloth->m_width; j++)
+            {
+                int index = i * cloth->m_width + j;
+                if (refinement && refinement->isSlaved(index))
+                    continue;
+                chai3d::cVector3d nodePos(nodeX[index], nodeY[index], nodeZ[index]);
+                chai3d::cVector3d tmpfrc(0.0, 0.0, 0.0);
+
+                if (inReach) {
+                    int slot = m_contactSlot[index];
+                    if (slot >= 0) {
+                        tmpfrc.set(-forceX[slot], -forceY[slot], -forceZ[slot]);
+                        m_contactSlot[index] = -1;
+                    }
+                }
+                if (collisionX)
+                    tmpfrc.add(collisionX[index], collisionY[index], collisionZ[index]);
+
+                // nodes closer to a rigid surface than their radius are pushed out along its
+                // distance gradient, one lookup per rigid whatever its shape
+                double modelHeight = cloth->m_modelRadius;
+                for (Rigid* rigid : m_rigids) {
+                    chai3d::cVector3d normal;
+                    double distance = rigid->m_distanceField.sample(nodePos, normal);
+                    if (distance < modelHeight)
+                        tmpfrc.add(cGELSkeletonLink::s_default_kSpringElongation * (modelHeight - distance) * normal);
+                }
+                cloth->setExternalForce(i, j, tmpfrc);
+            }
+        }
+
+        // the same forces on the patch, weighted by the mass of its nodes. nodes on coarse nodes
+        // take their cloth collision forces, the patch itself is not collided
+        if (refinement) {
+            SoACloth& patch = refinement->getPatch();
+            double weight = refinement->getNodeWeight();
+            int numNodes = cloth->m_length * cloth->m_width;
+            for (int fine = 0; fine < refinement->getNumNodes(); fine++) {
+                chai3d::cVector3d nodePos = patch.getNodePos(fine);
+                chai3d::cVector3d tmpfrc(0.0, 0.0, 0.0);
+
+                if (inReach) {
+                    int slot = m_contactSlot[numNodes + fine];
+                    if (slot >= 0) {
+                        tmpfrc.set(-forceX[slot], -forceY[slot], -forceZ[slot]);
+                        m_contactSlot[numNodes + fine] = -1;
+                    }
+                }
+                int coarse = refinement->getCoarseNode(fine);
+                if (collisionX && coarse >= 0)
+                    tmpfrc.add(weight * collisionX[coarse], weight * collisionY[coarse], weight * collisionZ[coarse]);
+
+                for (Rigid* rigid : m_rigids) {
+                    chai3d::cVector3d normal;
+                    double distance = rigid->m_distanceField.sample(nodePos, normal);
+                    if (distance < cloth->m_modelRadius)
+                        tmpfrc.add(weight * cGELSkeletonLink::s_default_kSpringElongation * (cloth->m_modelRadius - distance) * normal);
+                }
+                patch.setExternalForce(fine, tmpfrc);
+            }
+        }
+        if (trace)
+            trace->mark(PHASE_TABLE);
+
+        // update cGELSkeletonLink elongation from the strain of each cell (see ElasticModel)
+        cloth->updateElasticModel();
+        if (trace)
+            trace->mark(PHASE_STIFFNESS);
+    }
+
+    // nothing in reach, the patch holds no contact
+    if (patchForce < 0.0)
+        patch.build(renderPos, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, 0, 0.0, 0.0);
+    m_contactPatches.publish();
+    if (trace)
+        trace->mark(PHASE_CONTACT);
+
+    ChaiWorld::chaiWorld.getDefWorld()->updateDynamics(time);
+
+    // engines outside of the GEL world, then hand the new state to the graphics thread
+    for (Deformable* cloth : m_deformables) {
+        if (cloth->m_sleeping)
+            continue;
+        cloth->updateDynamics(time);
+        cloth->publishState();
+    }
+
+    for (Polygons* polygons : m_polygons) {
+        Deformable* source = polygons->m_source;
+        if (!source || source->m_sleeping || source->m_version == polygons->m_sourceVersion)
+            continue;
+        polygons->m_sourceVersion = source->m_version;
+
+        const double* nodeX;
+        const double* nodeY;
+        const double* nodeZ;
+        source->getPackedNodePositions(nodeX, nodeY, nodeZ);
+        int count = std::min((int)polygons->m_positions.size(), source->m_length * source->m_width);
+        for (int index = 0; index < count; index++)
+            polygons->m_positions[index].set(nodeX[index], nodeY[index], nodeZ[index] + 0.04);
+        polygons->publishPositions();
+    }
+    if (trace)
+        trace->mark(PHASE_DYNAMICS);
+
+    return force;
+}
+
+
 chai3d::cVector3d ChaiWorld::computeForce(const chai3d::cVector3d& a_cursor,
     double a_cursorRadius,
     const chai3d::cVector3d& a_spherePos,
@@ -7,6 +7,13 @@
 #include "Deformable.h"
 #include "Rigid.h"
 #include "Polygons.h"
+#include "ClothCollision.h"
+#include "ContactKernel.h"
+#include "ContactPatch.h"
+#include "DeviceRecorder.h"
+#include "ThreadPool.h"
+#include "TickTrace.h"
+#include "TripleBuffer.h"
 
 // a singleton class to handle all chai3d stuff
 
@@ -30,21 +37,79 @@ public:
 	double getWorkspaceScaleFactor() { return m_workspaceScaleFactor; }
 	double getMaxStiffness() { return m_maxStiffness; }
 	double getMultiCursorRadius() { return m_multiCursorRadius; }
+	ContactKernel& getContactKernel() { return m_contactKernel; }
+	ThreadPool* getThreadPool() { return m_threadPool; }
 	chai3d::cHapticDeviceInfo getHapticDeviceInfo() { return m_hapticDeviceInfo; }
 
+	// replace the device picked by the handler (e.g. with a VirtualHapticDevice)
+	void setHapticDevice(chai3d::cGenericHapticDevicePtr hapticDevice);
+
+	// record the device state of every haptic tick, nullptr to stop. set before the haptic thread starts
+	void setRecorder(DeviceRecorder* recorder) { m_recorder = recorder; }
+
+	// time the phases of every haptic tick, nullptr to stop. set before the haptic thread starts
+	void setTrace(TickTrace* trace) { m_trace = trace; }
+	TickTrace* getTrace() { return m_trace; }
+
+	// threads stepping SoA cloths attached afterwards, 1 for a single threaded step. workers
+	// stay off reservedCore, the core of the haptic thread
+	void setClothThreads(int numThreads, int reservedCore = 0);
+
+	// node-node collision within and between cloths (on by default). set before the threads start
+	void setClothCollision(bool clothCollision) { m_clothCollision = clothCollision; }
+	bool isClothCollision() { return m_clothCollision; }
+	int getClothCollisionPairs() { return m_collision.getNumPairs(); }
+
+	// simulate SoA cloths attached afterwards factor times finer around the cursor (see
+	// ClothRefinement), 1 for a uniform grid
+	void setClothRefinement(int factor) { m_refinementFactor = factor; }
+	int getClothRefinement() { return m_refinementFactor; }
+
+	// render the cursor contact of cloths attached afterwards on their triangle surface (see
+	// SurfaceContact) instead of on their node spheres, they are then not refined
+	void setSurfaceContact(bool surfaceContact) { m_surfaceContact = surfaceContact; }
+	bool isSurfaceContact() { return m_surfaceContact; }
+
 	void cameraMoveForward();
 	void cameraMoveBack();
 	void cameraMoveLeft();
 	void cameraMoveRight();
 
-	void updateCloth(Polygons* polygonCloth);
+	// scene registry, objects register in their AttachToWorld and are simulated by updateHapticsMulti
+	// or updateClothMulti. only change the scene while these loops are not running
+	void addRigid(Rigid* rigid);
+	void addDeformable(Deformable* deformable);
+	void removeDeformable(Deformable* deformable);
+	void addPolygons(Polygons* polygons);
+	const std::vector<Rigid*>& getRigids() { return m_rigids; }
+	const std::vector<Deformable*>& getDeformables() { return m_deformables; }
+	const std::vector<Polygons*>& getPolygons() { return m_polygons; }
+
+	// graphics thread: take the latest published state of all deformables and polygons,
+	// returns false if none of them changed
+	bool updateDisplay();
+
+	// graphics thread: bumped by camera moves and display toggles (markSceneChanged), anything
+	// that needs a redraw without a change of the simulated state
+	unsigned long getSceneVersion() { return m_sceneVersion; }
+	void markSceneChanged() { m_sceneVersion++; }
 
 	// main haptics simulation loop
 	void updateHaptics(double time, Deformable* cloth, Rigid* table, Deformable* cloth2 = nullptr, Polygons* polygonCloth = nullptr) {};
 
 	void updateHapticsRigid(double time, Rigid* table, Deformable* cloth, Polygons* polygonCloth) {};
 
-	void updateHapticsMulti(double time, Rigid* table, Deformable* cloth, Polygons* polygonCloth);
+	// one haptic tick over the whole scene
+	void updateHapticsMulti(double time);
+
+	// multi-rate mode: the cloth is stepped by updateClothMulti on its own thread and the haptic
+	// loop only renders the contact patch of the latest cloth step. set before the threads start
+	void setMultiRate(bool multiRate) { m_multiRate = multiRate; }
+	bool isMultiRate() { return m_multiRate; }
+
+	// cloth thread of the multi-rate mode, steps the scene against the latest cursor position in
+	// substeps of at most 1 ms
+	void updateClothMulti(double time);
 
 
 	// compute forces between tool and environment
@@ -58,6 +123,21 @@ public:
 	static ChaiWorld chaiWorld;
 
 private:
+	// one step of all registered objects against the cursor at renderPos, returns the (unscaled) force
+	// on the cursor. cloths out of reach of the cursor skip contact, resting SoA cloths are not stepped
+	chai3d::cVector3d stepScene(double time, const chai3d::cVector3d& renderPos);
+
+	// contact of the cursor with one cloth, fills m_contactSlot and m_candidateForceX/Y/Z. nodes of
+	// a refined patch take the slots after the coarse nodes
+	chai3d::cVector3d computeClothContact(Deformable* cloth, const chai3d::cVector3d& renderPos);
+
+	// the same for a cloth with surface contact, the candidates are the nodes of the triangle
+	// under the proxy and share its force by their barycentric weights
+	chai3d::cVector3d computeSurfaceContact(Deformable* cloth, const chai3d::cVector3d& renderPos);
+
+	// node-node contact of all cloths into m_collision, wakes sleeping cloths an awake one runs into
+	void collideCloths();
+
 	// a world that contains all objects of the virtual environment
 	chai3d::cWorld* m_world;
 
@@ -99,4 +179,59 @@ private:
 	// a cursor that can touch both deformable(cGELMesh) and rigidbody(cMesh)
 	MultiCursor* m_multiCursor;
 	double m_multiCursorRadius;
+
+	// batched cursor-node contact, same model as computeForce
+	ContactKernel m_contactKernel;
+
+	// registered scene objects
+	std::vector<Rigid*> m_rigids;
+	std::vector<Deformable*> m_deformables;
+	std::vector<Polygons*> m_polygons;
+
+	// records the device, nullptr if not recording
+	DeviceRecorder* m_recorder;
+
+	// phase timer of the haptic tick, nullptr if not tracing
+	TickTrace* m_trace;
+
+	// workers for the cloth step, nullptr if single threaded
+	ThreadPool* m_threadPool;
+
+	// broadphase candidates of the current tick, their packed positions and
+	// the candidate slot of each node (-1 if none)
+	std::vector<int> m_contactCandidates;
+	std::vector<double> m_candidateX;
+	std::vector<double> m_candidateY;
+	std::vector<double> m_candidateZ;
+	std::vector<int> m_contactSlot;
+
+	// force of each candidate on the cursor, the kernel output or m_weightedForceX/Y/Z if a
+	// refined patch is in contact
+	const double* m_candidateForceX;
+	const double* m_candidateForceY;
+	const double* m_candidateForceZ;
+	std::vector<double> m_weightedForceX;
+	std::vector<double> m_weightedForceY;
+	std::vector<double> m_weightedForceZ;
+
+	// refinement factor of new SoA cloths
+	int m_refinementFactor;
+
+	// surface contact for new cloths
+	bool m_surfaceContact;
+
+	// cloth collision and the first node of each deformable in it
+	bool m_clothCollision;
+	ClothCollision m_collision;
+	std::vector<int> m_collisionFirst;
+
+	// multi-rate mode
+	bool m_multiRate;
+
+	// version of the displayed scene apart from the simulated state
+	unsigned long m_sceneVersion;
+
+	// cursor position haptic -> cloth thread, contact patch cloth -> haptic thread
+	TripleBuffer<chai3d::cVector3d> m_cursorPositions;
+	TripleBuffer<ContactPatch> m_contactPatches;
 };
@@ -0,0 +1,178 @@
+#include "ClothCollision.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace {
+
+    // nodes of one cloth this many grid steps apart or less never collide
+    const int kSelfExclusion = 2;
+}
+
+ClothCollision::ClothCollision(int maxCells) :
+    m_maxCells(std::max(maxCells, 27)), m_maxRadius(0.0), m_maxContact2(0.0), m_numPairs(0) {
+}
+
+void ClothCollision::clear() {
+    m_clothRadius.clear();
+    m_clothActive.clear();
+    m_maxRadius = 0.0;
+    m_x.clear();
+    m_y.clear();
+    m_z.clear();
+    m_nodeCloth.clear();
+    m_nodeRow.clear();
+    m_nodeColumn.clear();
+    m_numPairs = 0;
+}
+
+int ClothCollision::addCloth(const double* x, const double* y, const double* z, int width, int length, double radius,
+    bool active) {
+    int first = (int)m_x.size();
+    int count = width * length;
+    m_nodeCloth.resize(first + count, (int)m_clothRadius.size());
+    m_clothRadius.push_back(radius);
+    m_clothActive.push_back(active ? 1 : 0);
+    m_maxRadius = std::max(m_maxRadius, radius);
+
+    m_x.insert(m_x.end(), x, x + count);
+    m_y.insert(m_y.end(), y, y + count);
+    m_z.insert(m_z.end(), z, z + count);
+    m_nodeRow.resize(first + count);
+    m_nodeColumn.resize(first + count);
+    for (int i = 0; i < length; i++) {
+        for (int j = 0; j < width; j++) {
+            m_nodeRow[first + i * width + j] = i;
+            m_nodeColumn[first + i * width + j] = j;
+        }
+    }
+    return first;
+}
+
+int ClothCollision::resolve(double stiffness) {
+    int numNodes = (int)m_x.size();
+    m_forceX.assign(numNodes, 0.0);
+    m_forceY.assign(numNodes, 0.0);
+    m_forceZ.assign(numNodes, 0.0);
+    m_clothTouched.assign(m_clothRadius.size(), 0);
+    m_numPairs = 0;
+    if (numNodes == 0 || m_maxRadius <= 0.0)
+        return 0;
+
+    double lower[3] = { m_x[0], m_y[0], m_z[0] };
+    double upper[3] = { m_x[0], m_y[0], m_z[0] };
+    for (int a = 1; a < numNodes; a++) {
+        lower[0] = std::min(lower[0], m_x[a]);
+        lower[1] = std::min(lower[1], m_y[a]);
+        lower[2] = std::min(lower[2], m_z[a]);
+        upper[0] = std::max(upper[0], m_x[a]);
+        upper[1] = std::max(upper[1], m_y[a]);
+        upper[2] = std::max(upper[2], m_z[a]);
+    }
+
+    // cells as large as the largest contact distance, coarser if the bounds are huge. an empty
+    // layer of cells on every side keeps the neighbour offsets from wrapping around a row
+    double cellSize = 2.0 * m_maxRadius;
+    m_maxContact2 = cellSize * cellSize;
+    double cells = 1.0;
+    for (int axis = 0; axis < 3; axis++)
+        cells *= (upper[axis] - lower[axis]) / cellSize + 3.0;
+    if (cells > m_maxCells)
+        cellSize *= std::cbrt(cells / m_maxCells);
+
+    double invCellSize = 1.0 / cellSize;
+    int size[3];
+    for (int axis = 0; axis < 3; axis++)
+        size[axis] = (int)((upper[axis] - lower[axis]) * invCellSize) + 3;
+    int strideY = size[0];
+    int strideZ = size[0] * size[1];
+    int numCells = strideZ * size[2];
+
+    // counting sort of the nodes by cell
+    m_nodeCell.resize(numNodes);
+    m_cellStart.assign(numCells + 1, 0);
+    for (int a = 0; a < numNodes; a++) {
+        int x = (int)((m_x[a] - lower[0]) * invCellSize) + 1;
+        int y = (int)((m_y[a] - lower[1]) * invCellSize) + 1;
+        int z = (int)((m_z[a] - lower[2]) * invCellSize) + 1;
+        m_nodeCell[a] = x + y * strideY + z * strideZ;
+        m_cellStart[m_nodeCell[a]]++;
+    }
+    for (int c = 1; c <= numCells; c++)
+        m_cellStart[c] += m_cellStart[c - 1];
+
+    m_sortedNode.resize(numNodes);
+    m_sortedCell.resize(numNodes);
+    m_sortedX.resize(numNodes);
+    m_sortedY.resize(numNodes);
+    m_sortedZ.resize(numNodes);
+    m_sortedCloth.resize(numNodes);
+    m_sortedRow.resize(numNodes);
+    m_sortedColumn.resize(numNodes);
+    for (int a = numNodes - 1; a >= 0; a--) {
+        int s = --m_cellStart[m_nodeCell[a]];
+        m_sortedNode[s] = a;
+        m_sortedCell[s] = m_nodeCell[a];
+        m_sortedX[s] = m_x[a];
+        m_sortedY[s] = m_y[a];
+        m_sortedZ[s] = m_z[a];
+        m_sortedCloth[s] = m_nodeCloth[a];
+        m_sortedRow[s] = m_nodeRow[a];
+        m_sortedColumn[s] = m_nodeColumn[a];
+    }
+
+    // half of the 26 neighbour cells, the other half tests the same pairs from the other node
+    const int neighbours[13] = {
+        1, strideY - 1, strideY, strideY + 1,
+        strideZ - strideY - 1, strideZ - strideY, strideZ - strideY + 1, strideZ - 1, strideZ,
+        strideZ + 1, strideZ + strideY - 1, strideZ + strideY, strideZ + strideY + 1
+    };
+
+    for (int s = 0; s < numNodes; s++) {
+        int cell = m_sortedCell[s];
+        collideRange(s, s + 1, m_cellStart[cell + 1], stiffness);
+        for (int offset : neighbours)
+            collideRange(s, m_cellStart[cell + offset], m_cellStart[cell + offset + 1], stiffness);
+    }
+    return m_numPairs;
+}
+
+void ClothCollision::collideRange(int s, int begin, int end, double stiffness) {
+    for (int t = begin; t < end; t++) {
+        double dx = m_sortedX[s] - m_sortedX[t];
+        double dy = m_sortedY[s] - m_sortedY[t];
+        double dz = m_sortedZ[s] - m_sortedZ[t];
+        double distance2 = dx * dx + dy * dy + dz * dz;
+        if (distance2 >= m_maxContact2)
+            continue;
+
+        int clothA = m_sortedCloth[s];
+        int clothB = m_sortedCloth[t];
+        if (!m_clothActive[clothA] && !m_clothActive[clothB])
+            continue;
+        if (clothA == clothB && abs(m_sortedRow[s] - m_sortedRow[t]) <= kSelfExclusion &&
+            abs(m_sortedColumn[s] - m_sortedColumn[t]) <= kSelfExclusion)
+            continue;
+
+        double contactDistance = m_clothRadius[clothA] + m_clothRadius[clothB];
+        if (distance2 >= contactDistance * contactDistance || distance2 < 1e-14)
+            continue;
+
+        // push both nodes apart along the line between them
+        int a = m_sortedNode[s];
+        int b = m_sortedNode[t];
+        double distance = sqrt(distance2);
+        double scale = stiffness * (contactDistance - distance) / distance;
+        m_forceX[a] += scale * dx;
+        m_forceY[a] += scale * dy;
+        m_forceZ[a] += scale * dz;
+        m_forceX[b] -= scale * dx;
+        m_forceY[b] -= scale * dy;
+        m_forceZ[b] -= scale * dz;
+
+        m_clothTouched[clothA] = 1;
+        m_clothTouched[clothB] = 1;
+        m_numPairs++;
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+
+// node-node collision within and between cloths. every step the nodes of all cloths are sorted
+// from scratch into a dense grid over their bounds (counting sort, no allocation once warmed up)
+// with cells of the largest contact distance, each node then checks its own cell and 13 of its
+// neighbours, so every pair is tested once and neighbour cells are fixed index offsets. pairs
+// closer than the sum of their radii get an equal and opposite penalty force. nodes within two
+// grid steps of each other on the same cloth are skipped, the links hold them apart. with a
+// contact distance of at least the link length divided by sqrt(2) a node cannot pass through
+// a cell of another cloth without touching one of its nodes.
+// limits: there is no node-triangle test, so that only holds while the links stay near their
+// rest length; a stretched cell opens a gap wider than the contact distance and a thin fold or
+// a fast node can pass between its nodes. the fine patch of a ClothRefinement is not added, its
+// nodes take the forces of the coarse nodes they coincide with and the rest of it is not collided
+
+class ClothCollision
+{
+public:
+	// the grid gets coarser cells if the bounds of the nodes would need more than maxCells
+	ClothCollision(int maxCells = 1 << 18);
+	~ClothCollision() = default;
+
+	// start collecting the nodes of a step
+	void clear();
+
+	// copy the nodes of a width x length cloth, node (i, j) at i * width + j. pairs of two
+	// inactive (resting) cloths are not tested. returns the index of its first node in the force arrays
+	int addCloth(const double* x, const double* y, const double* z, int width, int length, double radius,
+		bool active = true);
+
+	// find the colliding pairs and their forces, returns the number of pairs
+	int resolve(double stiffness);
+
+	// force on each node of the last resolve, cloths in the order they were added
+	const double* getForceX() const { return m_forceX.data(); }
+	const double* getForceY() const { return m_forceY.data(); }
+	const double* getForceZ() const { return m_forceZ.data(); }
+
+	// true if a node of the cloth (in order added) collided in the last resolve
+	bool isTouched(int cloth) const { return m_clothTouched[cloth] != 0; }
+
+	int getNumNodes() const { return (int)m_x.size(); }
+	int getNumPairs() const { return m_numPairs; }
+
+private:
+	// test the node at sorted position s against the sorted nodes [begin, end)
+	void collideRange(int s, int begin, int end, double stiffness);
+
+	int m_maxCells;
+
+	// contact radius of the nodes of each cloth and whether it is active
+	std::vector<double> m_clothRadius;
+	std::vector<unsigned char> m_clothActive;
+	double m_maxRadius;
+	double m_maxContact2;
+
+	// per node: position, cloth and grid coordinates on the cloth
+	std::vector<double> m_x;
+	std::vector<double> m_y;
+	std::vector<double> m_z;
+	std::vector<int> m_nodeCloth;
+	std::vector<int> m_nodeRow;
+	std::vector<int> m_nodeColumn;
+
+	// nodes sorted by cell, cell c holds sorted positions [m_cellStart[c], m_cellStart[c + 1])
+	std::vector<int> m_nodeCell;
+	std::vector<int> m_cellStart;
+	std::vector<int> m_sortedNode;
+	std::vector<int> m_sortedCell;
+	std::vector<double> m_sortedX;
+	std::vector<double> m_sortedY;
+	std::vector<double> m_sortedZ;
+	std::vector<int> m_sortedCloth;
+	std::vector<int> m_sortedRow;
+	std::vector<int> m_sortedColumn;
+
+	std::vector<double> m_forceX;
+	std::vector<double> m_forceY;
+	std::vector<double> m_forceZ;
+	std::vector<unsigned char> m_clothTouched;
+	int m_numPairs;
+};
@@ -0,0 +1,275 @@
+#include "ClothRefinement.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+
+    // the window moves once the nearest coarse node is more than this many cells off its center
+    const int kHysteresis = 1;
+
+    // steps without the cursor in reach before the window is dropped
+    const int kCoarsenSteps = 500;
+}
+
+ClothRefinement::ClothRefinement() :
+    m_coarse(nullptr), m_width(0), m_length(0), m_factor(1), m_cells(0), m_side(0),
+    m_active(false), m_originI(0), m_originJ(0), m_farSteps(0) {
+}
+
+void ClothRefinement::attach(SoACloth* coarse, int width, int length, double spacing, int factor, int radius,
+    double kElongation, double kFlexion, double kTorsion) {
+
+    m_coarse = coarse;
+    m_width = width;
+    m_length = length;
+    m_factor = std::max(1, factor);
+    m_cells = std::max(1, std::min(2 * radius, std::min(width, length) - 1));
+    m_side = m_cells * m_factor + 1;
+    m_active = false;
+    m_farSteps = 0;
+
+    m_coarseFixed = coarse->m_fixed;
+    m_slaved.assign(coarse->getNumNodes(), 0);
+
+    // lighter nodes, the same damping rate
+    double weight = getNodeWeight();
+    m_patch = SoACloth();
+    m_patch.setNodeProperties(coarse->m_mass * weight, coarse->m_inertia * weight, coarse->m_kDampingPos,
+        coarse->m_kDampingRot, coarse->m_useGravity, coarse->m_gravity);
+    m_patch.setIntegrator(coarse->getIntegrator());
+    m_patch.setConstraintIterations(coarse->getConstraintIterations());
+
+    // flat rest shape in the layout of the coarse grid, the window edge is driven by the coarse cloth
+    double fineSpacing = spacing / m_factor;
+    int numCells = (m_side - 1) * (m_side - 1);
+    m_patch.reserve(m_side * m_side, 4 * numCells);
+    m_boundary.clear();
+    for (int i = 0; i < m_side; i++) {
+        for (int j = 0; j < m_side; j++) {
+            bool edge = i == 0 || j == 0 || i == m_side - 1 || j == m_side - 1;
+            m_patch.addNode(chai3d::cVector3d(fineSpacing * i, fineSpacing * j, 0.0), edge);
+            if (edge)
+                m_boundary.push_back(fineIndex(i, j));
+        }
+    }
+
+    // same four links per cell as Deformable::buildSoACloth
+    for (int i = 0; i < m_side - 1; i++) {
+        for (int j = 0; j < m_side - 1; j++) {
+            int n00 = fineIndex(i, j);
+            int n01 = fineIndex(i, j + 1);
+            int n10 = fineIndex(i + 1, j);
+            int n11 = fineIndex(i + 1, j + 1);
+            m_patch.addLink(n00, n10, kElongation, kFlexion, kTorsion);
+            m_patch.addLink(n01, n11, kElongation, kFlexion, kTorsion);
+            m_patch.addLink(n00, n01, kElongation, kFlexion, kTorsion);
+            m_patch.addLink(n10, n11, kElongation, kFlexion, kTorsion);
+        }
+    }
+
+    // a fine cell is as wide as the contact distance divided by the factor
+    m_spatialHash.setCellSize(spacing);
+
+    int numWindow = (m_cells + 1) * (m_cells + 1);
+    m_windowX.resize(numWindow);
+    m_windowY.resize(numWindow);
+    m_windowZ.resize(numWindow);
+}
+
+void ClothRefinement::follow(int nearestNode) {
+    if (!m_coarse)
+        return;
+
+    if (nearestNode < 0) {
+        if (m_active && ++m_farSteps >= kCoarsenSteps)
+            release();
+        return;
+    }
+    m_farSteps = 0;
+
+    // window centered on the nearest node, shifted inside the cloth at its edges
+    int half = m_cells / 2;
+    int originI = std::max(0, std::min(nearestNode / m_width - half, m_length - 1 - m_cells));
+    int originJ = std::max(0, std::min(nearestNode % m_width - half, m_width - 1 - m_cells));
+    if (!m_active || abs(originI - m_originI) > kHysteresis || abs(originJ - m_originJ) > kHysteresis)
+        moveWindow(originI, originJ);
+}
+
+int ClothRefinement::getCoarseNode(int fineNode) const {
+    int i = fineNode / m_side;
+    int j = fineNode % m_side;
+    if (!m_active || i % m_factor != 0 || j % m_factor != 0)
+        return -1;
+    return coarseIndex(i / m_factor, j / m_factor);
+}
+
+void ClothRefinement::getPackedNodePositions(const double*& x, const double*& y, const double*& z) {
+    x = m_patch.m_posX.data();
+    y = m_patch.m_posY.data();
+    z = m_patch.m_posZ.data();
+}
+
+void ClothRefinement::query(const chai3d::cVector3d& center, double radius, std::vector<int>& result) {
+    m_spatialHash.update(m_patch.m_posX.data(), m_patch.m_posY.data(), m_patch.m_posZ.data(), getNumNodes());
+    m_spatialHash.query(center, radius, result);
+}
+
+void ClothRefinement::copyNode(const SoACloth& from, int a, SoACloth& to, int b) {
+    to.m_posX[b] = from.m_posX[a];
+    to.m_posY[b] = from.m_posY[a];
+    to.m_posZ[b] = from.m_posZ[a];
+    to.m_velX[b] = from.m_velX[a];
+    to.m_velY[b] = from.m_velY[a];
+    to.m_velZ[b] = from.m_velZ[a];
+    to.m_angVelX[b] = from.m_angVelX[a];
+    to.m_angVelY[b] = from.m_angVelY[a];
+    to.m_angVelZ[b] = from.m_angVelZ[a];
+    std::copy(&from.m_rot[9 * a], &from.m_rot[9 * a] + 9, &to.m_rot[9 * b]);
+}
+
+void ClothRefinement::moveWindow(int originI, int originJ) {
+    // the coarse nodes of the old window already hold the patch state
+    bool keep = m_active;
+    int oldI = m_originI;
+    int oldJ = m_originJ;
+    if (m_active) {
+        m_previous = m_patch;
+        release();
+    }
+    m_originI = originI;
+    m_originJ = originJ;
+
+    for (int i = 0; i < m_side; i++) {
+        for (int j = 0; j < m_side; j++) {
+            int fine = fineIndex(i, j);
+
+            // same place on the cloth in the old window, in fine steps
+            int pi = i + (originI - oldI) * m_factor;
+            int pj = j + (originJ - oldJ) * m_factor;
+            if (keep && pi >= 0 && pj >= 0 && pi < m_side && pj < m_side) {
+                copyNode(m_previous, fineIndex(pi, pj), m_patch, fine);
+                continue;
+            }
+
+            // new ground: bilinear on the coarse cell, rotation of its nearest coarse node
+            int ci = std::min(i / m_factor, m_cells - 1);
+            int cj = std::min(j / m_factor, m_cells - 1);
+            double u = (double)(i - ci * m_factor) / m_factor;
+            double v = (double)(j - cj * m_factor) / m_factor;
+            int c00 = coarseIndex(ci, cj);
+            int c01 = coarseIndex(ci, cj + 1);
+            int c10 = coarseIndex(ci + 1, cj);
+            int c11 = coarseIndex(ci + 1, cj + 1);
+            double w00 = (1.0 - u) * (1.0 - v), w01 = (1.0 - u) * v, w10 = u * (1.0 - v), w11 = u * v;
+            const SoACloth& c = *m_coarse;
+            m_patch.m_posX[fine] = w00 * c.m_posX[c00] + w01 * c.m_posX[c01] + w10 * c.m_posX[c10] + w11 * c.m_posX[c11];
+            m_patch.m_posY[fine] = w00 * c.m_posY[c00] + w01 * c.m_posY[c01] + w10 * c.m_posY[c10] + w11 * c.m_posY[c11];
+            m_patch.m_posZ[fine] = w00 * c.m_posZ[c00] + w01 * c.m_posZ[c01] + w10 * c.m_posZ[c10] + w11 * c.m_posZ[c11];
+            m_patch.m_velX[fine] = w00 * c.m_velX[c00] + w01 * c.m_velX[c01] + w10 * c.m_velX[c10] + w11 * c.m_velX[c11];
+            m_patch.m_velY[fine] = w00 * c.m_velY[c00] + w01 * c.m_velY[c01] + w10 * c.m_velY[c10] + w11 * c.m_velY[c11];
+            m_patch.m_velZ[fine] = w00 * c.m_velZ[c00] + w01 * c.m_velZ[c01] + w10 * c.m_velZ[c10] + w11 * c.m_velZ[c11];
+
+            int nearest = coarseIndex(ci + (u > 0.5 ? 1 : 0), cj + (v > 0.5 ? 1 : 0));
+            std::copy(&c.m_rot[9 * nearest], &c.m_rot[9 * nearest] + 9, &m_patch.m_rot[9 * fine]);
+            m_patch.m_angVelX[fine] = c.m_angVelX[nearest];
+            m_patch.m_angVelY[fine] = c.m_angVelY[nearest];
+            m_patch.m_angVelZ[fine] = c.m_angVelZ[nearest];
+        }
+    }
+
+    // the inside of the window follows the patch from now on
+    for (int i = 1; i < m_cells; i++) {
+        for (int j = 1; j < m_cells; j++) {
+            int coarse = coarseIndex(i, j);
+            m_slaved[coarse] = 1;
+            m_coarse->m_fixed[coarse] = 1;
+        }
+    }
+    m_active = true;
+}
+
+void ClothRefinement::release() {
+    for (int i = 1; i < m_cells; i++) {
+        for (int j = 1; j < m_cells; j++) {
+            int coarse = coarseIndex(i, j);
+            m_slaved[coarse] = 0;
+            m_coarse->m_fixed[coarse] = m_coarseFixed[coarse];
+        }
+    }
+    m_active = false;
+}
+
+void ClothRefinement::beginStep() {
+    if (!m_active)
+        return;
+    for (int i = 0; i <= m_cells; i++) {
+        for (int j = 0; j <= m_cells; j++) {
+            int coarse = coarseIndex(i, j);
+            int window = i * (m_cells + 1) + j;
+            m_windowX[window] = m_coarse->m_posX[coarse];
+            m_windowY[window] = m_coarse->m_posY[coarse];
+            m_windowZ[window] = m_coarse->m_posZ[coarse];
+        }
+    }
+}
+
+void ClothRefinement::interpolate(int i, int j, double alpha, double invTime) {
+    int ci = std::min(i / m_factor, m_cells - 1);
+    int cj = std::min(j / m_factor, m_cells - 1);
+    double u = (double)(i - ci * m_factor) / m_factor;
+    double v = (double)(j - cj * m_factor) / m_factor;
+    double weights[4] = { (1.0 - u) * (1.0 - v), (1.0 - u) * v, u * (1.0 - v), u * v };
+    int corners[4][2] = { { ci, cj }, { ci, cj + 1 }, { ci + 1, cj }, { ci + 1, cj + 1 } };
+
+    double x = 0.0, y = 0.0, z = 0.0, vx = 0.0, vy = 0.0, vz = 0.0;
+    for (int k = 0; k < 4; k++) {
+        int coarse = coarseIndex(corners[k][0], corners[k][1]);
+        int window = corners[k][0] * (m_cells + 1) + corners[k][1];
+        double dx = m_coarse->m_posX[coarse] - m_windowX[window];
+        double dy = m_coarse->m_posY[coarse] - m_windowY[window];
+        double dz = m_coarse->m_posZ[coarse] - m_windowZ[window];
+        x += weights[k] * (m_windowX[window] + alpha * dx);
+        y += weights[k] * (m_windowY[window] + alpha * dy);
+        z += weights[k] * (m_windowZ[window] + alpha * dz);
+        vx += weights[k] * dx * invTime;
+        vy += weights[k] * dy * invTime;
+        vz += weights[k] * dz * invTime;
+    }
+
+    // the frame of the nearest coarse node, the fine edge bends and twists with the coarse cloth
+    int fine = fineIndex(i, j);
+    int nearest = coarseIndex(ci + (u > 0.5 ? 1 : 0), cj + (v > 0.5 ? 1 : 0));
+    std::copy(&m_coarse->m_rot[9 * nearest], &m_coarse->m_rot[9 * nearest] + 9, &m_patch.m_rot[9 * fine]);
+    m_patch.m_angVelX[fine] = m_coarse->m_angVelX[nearest];
+    m_patch.m_angVelY[fine] = m_coarse->m_angVelY[nearest];
+    m_patch.m_angVelZ[fine] = m_coarse->m_angVelZ[nearest];
+
+    m_patch.m_posX[fine] = x;
+    m_patch.m_posY[fine] = y;
+    m_patch.m_posZ[fine] = z;
+    m_patch.m_velX[fine] = vx;
+    m_patch.m_velY[fine] = vy;
+    m_patch.m_velZ[fine] = vz;
+}
+
+void ClothRefinement::updateDynamics(double time) {
+    if (!m_active || time <= 0.0)
+        return;
+
+    // the flexion forces of a link grow with 1 / length on nodes 1 / factor^2 as heavy, so the
+    // explicit flexion (also in the implicit step) needs factor^2 substeps. XPBD keeps its step
+    int substeps = (m_patch.getIntegrator() == SoAIntegrator::XPBD) ? 1 : m_factor * m_factor;
+    double h = time / substeps;
+    for (int step = 1; step <= substeps; step++) {
+        double alpha = (double)step / substeps;
+        for (int fine : m_boundary)
+            interpolate(fine / m_side, fine % m_side, alpha, 1.0 / time);
+        m_patch.updateDynamics(h);
+    }
+
+    // the inside of the window takes the fine solution
+    for (int i = 1; i < m_cells; i++)
+        for (int j = 1; j < m_cells; j++)
+            copyNode(m_patch, fineIndex(i * m_factor, j * m_factor), *m_coarse, coarseIndex(i, j));
+}
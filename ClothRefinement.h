@@ -0,0 +1,109 @@
+#pragma once
+
+#include <vector>
+
+#include "chai3d.h"
+
+#include "SoACloth.h"
+#include "SpatialHash.h"
+
+// adaptive resolution of a SoACloth grid: a square window of coarse cells around the cursor is
+// simulated again by a patch factor times finer, the rest of the cloth stays coarse. the two
+// overlap and drive each other every step: the boundary nodes of the patch are fixed to the
+// coarse cloth (interpolated along the window edges), the coarse nodes inside the window are
+// fixed to the patch node they coincide with. the window moves with the cursor, keeping the
+// patch state where old and new window overlap, and is dropped a while after the cursor left.
+// fine nodes carry 1 / factor^2 of the mass of a coarse node and the same share of any external
+// force; the link springs keep their stiffness (the membrane stiffness of the grid does not
+// depend on its spacing)
+
+class ClothRefinement
+{
+public:
+	ClothRefinement();
+	~ClothRefinement() = default;
+
+	// coarse cloth of width x length nodes spacing apart, node (i, j) at i * width + j, at rest
+	// along x (i) and y (j). the window spans 2 * radius cells, less if the cloth is smaller
+	void attach(SoACloth* coarse, int width, int length, double spacing, int factor, int radius,
+		double kElongation, double kFlexion, double kTorsion);
+
+	// move the window to the coarse node nearest to the cursor, -1 if the cursor is out of reach
+	void follow(int nearestNode);
+
+	bool isActive() const { return m_active; }
+	int getFactor() const { return m_factor; }
+
+	// share of the mass and of the external forces of a coarse node on a fine node
+	double getNodeWeight() const { return 1.0 / (m_factor * m_factor); }
+
+	// true if the coarse node is inside the active window and follows the patch
+	bool isSlaved(int coarseNode) const { return m_slaved[coarseNode] != 0; }
+
+	// the coarse node a fine node coincides with, -1 if none or not inside the window
+	int getCoarseNode(int fineNode) const;
+
+	SoACloth& getPatch() { return m_patch; }
+	int getNumNodes() const { return m_patch.getNumNodes(); }
+
+	// contiguous fine node coordinates
+	void getPackedNodePositions(const double*& x, const double*& y, const double*& z);
+
+	// append the fine nodes in cells overlapping the sphere (see SpatialHash::query)
+	void query(const chai3d::cVector3d& center, double radius, std::vector<int>& result);
+
+	// before the coarse step: remember the window nodes to interpolate the boundary from
+	void beginStep();
+
+	// after the coarse step: step the patch with its boundary on the coarse cloth, then move
+	// the coarse nodes inside the window to the patch
+	void updateDynamics(double time);
+
+private:
+	// fill the patch for the window at (originI, originJ), keeping the nodes the old window shares
+	void moveWindow(int originI, int originJ);
+
+	// hand the inside of the window back to the coarse cloth
+	void release();
+
+	// coarse node and fine node from window coordinates
+	int coarseIndex(int i, int j) const { return (m_originI + i) * m_width + m_originJ + j; }
+	int fineIndex(int i, int j) const { return i * m_side + j; }
+
+	// bilinear position and velocity of fine node (i, j) on the coarse window nodes, blending the
+	// nodes remembered by beginStep into the current ones by alpha
+	void interpolate(int i, int j, double alpha, double invTime);
+
+	// copy node state, the patch and the coarse cloth share the layout of SoACloth
+	static void copyNode(const SoACloth& from, int a, SoACloth& to, int b);
+
+	SoACloth* m_coarse;
+	int m_width;
+	int m_length;
+	int m_factor;
+
+	// window cells per side and fine nodes per side
+	int m_cells;
+	int m_side;
+
+	SoACloth m_patch;
+	SpatialHash m_spatialHash;
+
+	bool m_active;
+	int m_originI;
+	int m_originJ;
+	int m_farSteps;
+
+	// per coarse node: fixed before it was slaved, and slaved to the patch
+	std::vector<unsigned char> m_coarseFixed;
+	std::vector<unsigned char> m_slaved;
+
+	// fine nodes on the window edge
+	std::vector<int> m_boundary;
+
+	// coarse window nodes before the coarse step, (m_cells + 1)^2
+	std::vector<double> m_windowX, m_windowY, m_windowZ;
+
+	// patch state of the old window while it moves
+	SoACloth m_previous;
+};
@@ -0,0 +1,241 @@
+#include "ContactKernel.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CONTACT_KERNEL_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define CONTACT_TARGET_AVX2
+#else
+#define CONTACT_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// NOTE: the reference and vectorized paths only agree bitwise if the compiler does not contract
+// a * b + c into fma, which is the default for MSVC (/fp:precise) and for gcc without -mfma
+
+namespace {
+
+    // number of interleaved partial sums, node i is accumulated into lane i % LANES
+    const int LANES = 4;
+
+    // force on the cursor from one node, zero outside of contact
+    inline void nodeForce(double x, double y, double z, double cx, double cy, double cz,
+        double radius, double stiffness, double& fx, double& fy, double& fz) {
+        double vx = cx - x;
+        double vy = cy - y;
+        double vz = cz - z;
+        double len = sqrt(vx * vx + vy * vy + vz * vz);
+        double invLen = 1.0 / len;
+        double mag = (radius - len) * stiffness;
+        bool contact = (len >= 0.0000001) && (len <= radius);
+        fx = contact ? mag * (vx * invLen) : 0.0;
+        fy = contact ? mag * (vy * invLen) : 0.0;
+        fz = contact ? mag * (vz * invLen) : 0.0;
+    }
+
+    // scalar tail shared by all modes
+    void computeScalar(int first, const double* x, const double* y, const double* z, int count,
+        double cx, double cy, double cz, double radius, double stiffness,
+        double* fx, double* fy, double* fz, double* sumX, double* sumY, double* sumZ) {
+        for (int i = first; i < count; i++) {
+            nodeForce(x[i], y[i], z[i], cx, cy, cz, radius, stiffness, fx[i], fy[i], fz[i]);
+            sumX[i % LANES] += fx[i];
+            sumY[i % LANES] += fy[i];
+            sumZ[i % LANES] += fz[i];
+        }
+    }
+
+#ifdef CONTACT_KERNEL_X86
+
+    int computeSSE2(const double* x, const double* y, const double* z, int count,
+        double cx, double cy, double cz, double radius, double stiffness,
+        double* fx, double* fy, double* fz, double* sumX, double* sumY, double* sumZ) {
+        const __m128d vcx = _mm_set1_pd(cx), vcy = _mm_set1_pd(cy), vcz = _mm_set1_pd(cz);
+        const __m128d vradius = _mm_set1_pd(radius), vstiffness = _mm_set1_pd(stiffness);
+        const __m128d one = _mm_set1_pd(1.0), eps = _mm_set1_pd(0.0000001);
+
+        // lanes 0-1 and 2-3 of the partial sums
+        __m128d accX[2] = { _mm_loadu_pd(sumX), _mm_loadu_pd(sumX + 2) };
+        __m128d accY[2] = { _mm_loadu_pd(sumY), _mm_loadu_pd(sumY + 2) };
+        __m128d accZ[2] = { _mm_loadu_pd(sumZ), _mm_loadu_pd(sumZ + 2) };
+
+        int last = count - count % LANES;
+        for (int i = 0; i < last; i += 2) {
+            int half = (i / 2) % 2;
+            __m128d vx = _mm_sub_pd(vcx, _mm_loadu_pd(x + i));
+            __m128d vy = _mm_sub_pd(vcy, _mm_loadu_pd(y + i));
+            __m128d vz = _mm_sub_pd(vcz, _mm_loadu_pd(z + i));
+            __m128d len = _mm_sqrt_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(vx, vx), _mm_mul_pd(vy, vy)), _mm_mul_pd(vz, vz)));
+            __m128d invLen = _mm_div_pd(one, len);
+            __m128d mag = _mm_mul_pd(_mm_sub_pd(vradius, len), vstiffness);
+            __m128d contact = _mm_and_pd(_mm_cmpge_pd(len, eps), _mm_cmple_pd(len, vradius));
+            __m128d rx = _mm_and_pd(contact, _mm_mul_pd(mag, _mm_mul_pd(vx, invLen)));
+            __m128d ry = _mm_and_pd(contact, _mm_mul_pd(mag, _mm_mul_pd(vy, invLen)));
+            __m128d rz = _mm_and_pd(contact, _mm_mul_pd(mag, _mm_mul_pd(vz, invLen)));
+            _mm_storeu_pd(fx + i, rx);
+            _mm_storeu_pd(fy + i, ry);
+            _mm_storeu_pd(fz + i, rz);
+            accX[half] = _mm_add_pd(accX[half], rx);
+            accY[half] = _mm_add_pd(accY[half], ry);
+            accZ[half] = _mm_add_pd(accZ[half], rz);
+        }
+
+        _mm_storeu_pd(sumX, accX[0]); _mm_storeu_pd(sumX + 2, accX[1]);
+        _mm_storeu_pd(sumY, accY[0]); _mm_storeu_pd(sumY + 2, accY[1]);
+        _mm_storeu_pd(sumZ, accZ[0]); _mm_storeu_pd(sumZ + 2, accZ[1]);
+        return last;
+    }
+
+    CONTACT_TARGET_AVX2
+    int computeAVX2(const double* x, const double* y, const double* z, int count,
+        double cx, double cy, double cz, double radius, double stiffness,
+        double* fx, double* fy, double* fz, double* sumX, double* sumY, double* sumZ) {
+        const __m256d vcx = _mm256_set1_pd(cx), vcy = _mm256_set1_pd(cy), vcz = _mm256_set1_pd(cz);
+        const __m256d vradius = _mm256_set1_pd(radius), vstiffness = _mm256_set1_pd(stiffness);
+        const __m256d one = _mm256_set1_pd(1.0), eps = _mm256_set1_pd(0.0000001);
+
+        __m256d accX = _mm256_loadu_pd(sumX);
+        __m256d accY = _mm256_loadu_pd(sumY);
+        __m256d accZ = _mm256_loadu_pd(sumZ);
+
+        int last = count - count % LANES;
+        for (int i = 0; i < last; i += 4) {
+            __m256d vx = _mm256_sub_pd(vcx, _mm256_loadu_pd(x + i));
+            __m256d vy = _mm256_sub_pd(vcy, _mm256_loadu_pd(y + i));
+            __m256d vz = _mm256_sub_pd(vcz, _mm256_loadu_pd(z + i));
+            __m256d len = _mm256_sqrt_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(vx, vx), _mm256_mul_pd(vy, vy)), _mm256_mul_pd(vz, vz)));
+            __m256d invLen = _mm256_div_pd(one, len);
+            __m256d mag = _mm256_mul_pd(_mm256_sub_pd(vradius, len), vstiffness);
+            __m256d contact = _mm256_and_pd(_mm256_cmp_pd(len, eps, _CMP_GE_OQ), _mm256_cmp_pd(len, vradius, _CMP_LE_OQ));
+            __m256d rx = _mm256_and_pd(contact, _mm256_mul_pd(mag, _mm256_mul_pd(vx, invLen)));
+            __m256d ry = _mm256_and_pd(contact, _mm256_mul_pd(mag, _mm256_mul_pd(vy, invLen)));
+            __m256d rz = _mm256_and_pd(contact, _mm256_mul_pd(mag, _mm256_mul_pd(vz, invLen)));
+            _mm256_storeu_pd(fx + i, rx);
+            _mm256_storeu_pd(fy + i, ry);
+            _mm256_storeu_pd(fz + i, rz);
+            accX = _mm256_add_pd(accX, rx);
+            accY = _mm256_add_pd(accY, ry);
+            accZ = _mm256_add_pd(accZ, rz);
+        }
+
+        _mm256_storeu_pd(sumX, accX);
+        _mm256_storeu_pd(sumY, accY);
+        _mm256_storeu_pd(sumZ, accZ);
+        return last;
+    }
+
+#endif
+}
+
+ContactKernel::ContactKernel() : m_mode(detectMode()) {
+}
+
+ContactKernelMode ContactKernel::detectMode() {
+    if (isSupported(ContactKernelMode::AVX2))
+        return ContactKernelMode::AVX2;
+    if (isSupported(ContactKernelMode::SSE2))
+        return ContactKernelMode::SSE2;
+    return ContactKernelMode::Scalar;
+}
+
+bool ContactKernel::isSupported(ContactKernelMode mode) {
+    switch (mode) {
+    case ContactKernelMode::Scalar:
+        return true;
+#ifdef CONTACT_KERNEL_X86
+    case ContactKernelMode::SSE2:
+        // baseline of every x86-64 cpu
+        return true;
+    case ContactKernelMode::AVX2:
+#if defined(_MSC_VER)
+    {
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+            return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+    }
+#else
+        return __builtin_cpu_supports("avx2") != 0;
+#endif
+#endif
+    default:
+        return false;
+    }
+}
+
+const char* ContactKernel::getModeName(ContactKernelMode mode) {
+    switch (mode) {
+    case ContactKernelMode::SSE2: return "sse2";
+    case ContactKernelMode::AVX2: return "avx2";
+    default: return "scalar";
+    }
+}
+
+void ContactKernel::setMode(ContactKernelMode mode) {
+    m_mode = isSupported(mode) ? mode : ContactKernelMode::Scalar;
+}
+
+chai3d::cVector3d ContactKernel::computeForces(const double* x, const double* y, const double* z, int count,
+    const chai3d::cVector3d& cursor, double cursorRadius, double nodeRadius, double stiffness) {
+    return compute(m_mode, x, y, z, count, cursor, cursorRadius, nodeRadius, stiffness);
+}
+
+bool ContactKernel::compareWithReference(const double* x, const double* y, const double* z, int count,
+    const chai3d::cVector3d& cursor, double cursorRadius, double nodeRadius, double stiffness) {
+    chai3d::cVector3d reference = compute(ContactKernelMode::Scalar, x, y, z, count, cursor, cursorRadius, nodeRadius, stiffness);
+    std::vector<double> referenceX(m_forceX.begin(), m_forceX.begin() + count);
+    std::vector<double> referenceY(m_forceY.begin(), m_forceY.begin() + count);
+    std::vector<double> referenceZ(m_forceZ.begin(), m_forceZ.begin() + count);
+
+    chai3d::cVector3d result = compute(m_mode, x, y, z, count, cursor, cursorRadius, nodeRadius, stiffness);
+
+    size_t bytes = count * sizeof(double);
+    double sums[6] = { reference.x(), reference.y(), reference.z(), result.x(), result.y(), result.z() };
+    return memcmp(sums, sums + 3, sizeof(double) * 3) == 0 &&
+        (count == 0 || (memcmp(referenceX.data(), m_forceX.data(), bytes) == 0 &&
+                        memcmp(referenceY.data(), m_forceY.data(), bytes) == 0 &&
+                        memcmp(referenceZ.data(), m_forceZ.data(), bytes) == 0));
+}
+
+chai3d::cVector3d ContactKernel::compute(ContactKernelMode mode, const double* x, const double* y, const double* z, int count,
+    const chai3d::cVector3d& cursor, double cursorRadius, double nodeRadius, double stiffness) {
+    if ((int)m_forceX.size() < count) {
+        m_forceX.resize(count);
+        m_forceY.resize(count);
+        m_forceZ.resize(count);
+    }
+
+    double cx = cursor.x(), cy = cursor.y(), cz = cursor.z();
+    double radius = cursorRadius + nodeRadius;
+    double* fx = m_forceX.data();
+    double* fy = m_forceY.data();
+    double* fz = m_forceZ.data();
+
+    double sumX[LANES] = { 0.0, 0.0, 0.0, 0.0 };
+    double sumY[LANES] = { 0.0, 0.0, 0.0, 0.0 };
+    double sumZ[LANES] = { 0.0, 0.0, 0.0, 0.0 };
+
+    int done = 0;
+#ifdef CONTACT_KERNEL_X86
+    if (mode == ContactKernelMode::AVX2)
+        done = computeAVX2(x, y, z, count, cx, cy, cz, radius, stiffness, fx, fy, fz, sumX, sumY, sumZ);
+    else if (mode == ContactKernelMode::SSE2)
+        done = computeSSE2(x, y, z, count, cx, cy, cz, radius, stiffness, fx, fy, fz, sumX, sumY, sumZ);
+#endif
+    computeScalar(done, x, y, z, count, cx, cy, cz, radius, stiffness, fx, fy, fz, sumX, sumY, sumZ);
+
+    return chai3d::cVector3d((sumX[0] + sumX[1]) + (sumX[2] + sumX[3]),
+        (sumY[0] + sumY[1]) + (sumY[2] + sumY[3]),
+        (sumZ[0] + sumZ[1]) + (sumZ[2] + sumZ[3]));
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+
+#include "chai3d.h"
+
+// batched cursor-node penalty forces over packed node coordinates, same model as
+// ChaiWorld::computeForce. all modes sum in the same order (four interleaved partial sums)
+// so the scalar reference is bitwise identical to the vectorized paths
+
+enum class ContactKernelMode
+{
+	Scalar,		// portable reference
+	SSE2,		// 2 doubles per instruction
+	AVX2		// 4 doubles per instruction
+};
+
+class ContactKernel
+{
+public:
+	ContactKernel();
+	~ContactKernel() = default;
+
+	// best mode supported by this cpu
+	static ContactKernelMode detectMode();
+	static bool isSupported(ContactKernelMode mode);
+	static const char* getModeName(ContactKernelMode mode);
+
+	// falls back to scalar if the cpu lacks the instruction set
+	void setMode(ContactKernelMode mode);
+	ContactKernelMode getMode() { return m_mode; }
+
+	// force on the cursor from each node (getForceX/Y/Z), returns their sum
+	chai3d::cVector3d computeForces(const double* x, const double* y, const double* z, int count,
+		const chai3d::cVector3d& cursor, double cursorRadius, double nodeRadius, double stiffness);
+
+	// run the current mode and the scalar reference on the same input, true if bitwise equal
+	bool compareWithReference(const double* x, const double* y, const double* z, int count,
+		const chai3d::cVector3d& cursor, double cursorRadius, double nodeRadius, double stiffness);
+
+	const double* getForceX() { return m_forceX.data(); }
+	const double* getForceY() { return m_forceY.data(); }
+	const double* getForceZ() { return m_forceZ.data(); }
+
+private:
+	chai3d::cVector3d compute(ContactKernelMode mode, const double* x, const double* y, const double* z, int count,
+		const chai3d::cVector3d& cursor, double cursorRadius, double nodeRadius, double stiffness);
+
+	ContactKernelMode m_mode;
+
+	// per node output, resized on demand
+	std::vector<double> m_forceX;
+	std::vector<double> m_forceY;
+	std::vector<double> m_forceZ;
+};
@@ -0,0 +1,73 @@
+#include "ContactPatch.h"
+
+#include <cmath>
+
+ContactPatch::ContactPatch() : m_point(0.0, 0.0, 0.0), m_normal(0.0, 0.0, 1.0), m_stiffness(0.0), m_valid(false) {
+}
+
+void ContactPatch::build(const chai3d::cVector3d& cursor,
+    const double* x, const double* y, const double* z,
+    const double* forceX, const double* forceY, const double* forceZ, int count,
+    double contactDistance, double stiffness) {
+
+    m_valid = false;
+
+    chai3d::cVector3d total(0.0, 0.0, 0.0);
+    for (int k = 0; k < count; k++)
+        total.add(chai3d::cVector3d(forceX[k], forceY[k], forceZ[k]));
+
+    double magnitude = total.length();
+    if (magnitude > 0.0000001) {
+        m_normal = total / magnitude;
+
+        // stiffness of all node springs along the normal
+        m_stiffness = 0.0;
+        for (int k = 0; k < count; k++) {
+            chai3d::cVector3d f(forceX[k], forceY[k], forceZ[k]);
+            double length = f.length();
+            if (length < 0.0000001)
+                continue;
+            double cosine = f.dot(m_normal) / length;
+            m_stiffness += stiffness * cosine * cosine;
+        }
+        if (m_stiffness < stiffness)
+            m_stiffness = stiffness;
+
+        // place the plane so the model reproduces the current force at the cursor
+        m_point = cursor + m_normal * (magnitude / m_stiffness);
+        m_valid = true;
+        return;
+    }
+
+    // no contact, keep the surface of the nearest node
+    int nearest = -1;
+    double nearestDistance = 2.0 * contactDistance;
+    for (int k = 0; k < count; k++) {
+        double d = sqrt((cursor.x() - x[k]) * (cursor.x() - x[k]) +
+            (cursor.y() - y[k]) * (cursor.y() - y[k]) +
+            (cursor.z() - z[k]) * (cursor.z() - z[k]));
+        if (d < nearestDistance && d > 0.0000001) {
+            nearest = k;
+            nearestDistance = d;
+        }
+    }
+    if (nearest < 0)
+        return;
+
+    chai3d::cVector3d node(x[nearest], y[nearest], z[nearest]);
+    m_normal = (cursor - node) / nearestDistance;
+    m_point = node + m_normal * contactDistance;
+    m_stiffness = stiffness;
+    m_valid = true;
+}
+
+chai3d::cVector3d ContactPatch::computeForce(const chai3d::cVector3d& cursor) const {
+    if (!m_valid)
+        return chai3d::cVector3d(0.0, 0.0, 0.0);
+
+    double depth = (m_point - cursor).dot(m_normal);
+    if (depth <= 0.0)
+        return chai3d::cVector3d(0.0, 0.0, 0.0);
+
+    return m_normal * (m_stiffness * depth);
+}
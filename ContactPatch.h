@@ -0,0 +1,36 @@
+#pragma once
+
+#include "chai3d.h"
+
+// local linear contact model of the cloth around the cursor, fitted after a cloth step and
+// evaluated by the haptic loop until the next one (multi-rate mode)
+
+class ContactPatch
+{
+public:
+	ContactPatch();
+	~ContactPatch() = default;
+
+	// fit a plane to the penalty forces of the candidate nodes at the cursor position.
+	// without contact, a plane in front of the nearest node closer than twice the contact
+	// distance is kept, so a fast cursor still meets the cloth before the next step
+	void build(const chai3d::cVector3d& cursor,
+		const double* x, const double* y, const double* z,
+		const double* forceX, const double* forceY, const double* forceZ, int count,
+		double contactDistance, double stiffness);
+
+	// force on the cursor, zero in front of the plane
+	chai3d::cVector3d computeForce(const chai3d::cVector3d& cursor) const;
+
+	bool isValid() const { return m_valid; }
+
+private:
+	// point on the plane and its normal, pointing away from the cloth
+	chai3d::cVector3d m_point;
+	chai3d::cVector3d m_normal;
+
+	// stiffness along the normal [N/m]
+	double m_stiffness;
+
+	bool m_valid;
+};
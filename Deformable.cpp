@@ -2,15 +2,31 @@
 
 #include "ChaiWorld.h"
 
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+// a cloth whose nodes all stay within kSleepTolerance [m] for kSleepSteps published steps is settled
+const double kSleepTolerance = 0.0001;
+const int kSleepSteps = 100;
+
+// a reduced cloth reconstructs all of its nodes for the display every kReconstructSlices steps
+const int kReconstructSlices = 16;
+
+}
+
 Deformable::Deformable(int width, int length, chai3d::cVector3d offset,
 	double elongation, double flexion, double torsion,
-    double c11, double c12, double c22, double c33) :
-		m_width(width), m_length(length), m_offset(offset),
+    double c11, double c12, double c22, double c33, ClothEngine engine) :
+		m_engine(engine), m_width(width), m_length(length), m_offset(offset),
+		m_simObject(nullptr), m_soaCloth(nullptr), m_refinement(nullptr), m_reduced(nullptr), m_reducedModes(32), m_reconstructFirst(0), m_surface(nullptr), m_step(0), m_version(0), m_displayedVersion(0), m_stillSteps(0), m_sleeping(false),
 		m_elongation(elongation), m_flexion(flexion), m_torsion(torsion),
-		m_stiffness(100), m_modelRadius(0.0f), m_staticFriction(0.3), m_dynamicFriction(0.2),
-    m_c11(c11), m_c12(c12), m_c22(c22), m_c33(c33){
+		m_stiffness(100), m_modelRadius(0.0f), m_constraintIterations(8), m_staticFriction(0.3), m_dynamicFriction(0.2),
+    m_c11(c11), m_c12(c12), m_c22(c22), m_c33(c33), m_elasticModel(c11, c12, c22, c33){
 
 	m_nodes = std::vector<std::vector<cGELSkeletonNode*>>(length, std::vector<cGELSkeletonNode*>(width, nullptr));
+	m_simNodes = m_nodes;
 
 	m_defObject = new cGELMesh();
 }
@@ -26,9 +42,15 @@ Deformable::Deformable(int width, int length, chai3d::cVector3d offset,
 }*/
 
 
-void Deformable::AttachToWorld(ChaiWorld& chaiWorld) {
+void Deformable::AttachToWorld(ChaiWorld& chaiWorld, const SoAClothTopology* topology) {
 
-    chaiWorld.getDefWorld()->m_gelMeshes.push_front(m_defObject);
+    // rendered only, simulated by m_simObject (GEL) or m_soaCloth (SoA)
+    chaiWorld.getWorld()->addChild(m_defObject);
+    if (m_engine == ClothEngine::GEL) {
+        m_simObject = new cGELMesh();
+        chaiWorld.getDefWorld()->m_gelMeshes.push_front(m_simObject);
+        m_simObject->buildVertices();
+    }
 
     // build dynamic vertices
     m_defObject->buildVertices();
@@ -44,8 +66,62 @@ void Deformable::AttachToWorld(ChaiWorld& chaiWorld) {
     cGELSkeletonNode::s_default_gravity.set(0.00, 0.00, -9.81);
     m_modelRadius = cGELSkeletonNode::s_default_radius;
 
+    // the displayed skeleton, it is only written from published frames (see updateDisplay)
+    createSkeleton(m_defObject, m_nodes);
+
+    // GEL simulates its own hidden copy so the renderer never reads nodes while they are integrated
+    if (m_engine == ClothEngine::GEL) {
+        createSkeleton(m_simObject, m_simNodes, &m_simLinks);
+        m_simObject->m_showSkeletonModel = false;
+    }
+
+    if (m_engine != ClothEngine::GEL) {
+        buildSoACloth(topology);
+        m_soaCloth->setThreadPool(chaiWorld.getThreadPool());
+        if (m_engine == ClothEngine::Implicit)
+            m_soaCloth->setIntegrator(SoAIntegrator::Implicit);
+        if (m_engine == ClothEngine::XPBD)
+            m_soaCloth->setIntegrator(SoAIntegrator::XPBD);
+        m_soaCloth->setConstraintIterations(m_constraintIterations);
+        if (m_engine == ClothEngine::Reduced)
+            buildReducedCloth();
+    }
+
+    // new links start at m_elongation, the elastic model has to write all of them again
+    m_elasticModel.invalidate();
+
+    // a cursor contact query then covers at most 2x2x2 cells
+    const double* x;
+    const double* y;
+    const double* z;
+    getPackedNodePositions(x, y, z);
+    m_spatialHash.setCellSize(chaiWorld.getMultiCursorRadius() + m_modelRadius);
+    m_spatialHash.build(x, y, z, m_length * m_width);
+
+    // preallocate the frames so publishing never allocates on the haptic thread
+    for (int k = 0; k < 3; k++) {
+        m_frames.getBuffer(k).positions.resize(m_length * m_width);
+        m_frames.getBuffer(k).step = 0;
+        m_frames.getBuffer(k).version = 0;
+    }
+    m_step = 0;
+    m_version = 0;
+    m_displayedVersion = 0;
+
+    // the first publish always counts as motion
+    m_sleepReference.assign(m_length * m_width, chai3d::cVector3d(0.0, 0.0, 1.0e9));
+    m_stillSteps = 0;
+    m_sleeping = false;
+    publishState();
+
+    chaiWorld.addDeformable(this);
+}
+
+void Deformable::createSkeleton(cGELMesh* mesh, std::vector<std::vector<cGELSkeletonNode*>>& nodes,
+    std::vector<cGELSkeletonLink*>* links) {
+
     // use internal skeleton as deformable model
-    m_defObject->m_useSkeletonModel = true;
+    mesh->m_useSkeletonModel = true;
 
     // create an array of nodes
     for (int i = 0; i < m_length; i++)
@@ -53,19 +129,19 @@ void Deformable::AttachToWorld(ChaiWorld& chaiWorld) {
         for (int j = 0; j < m_width; j++)
         {
             cGELSkeletonNode* newNode = new cGELSkeletonNode();
-            m_defObject->m_nodes.push_front(newNode);
+            mesh->m_nodes.push_front(newNode);
             newNode->m_pos.set((m_offset.x() - 0.1 * m_length / 2 + 0.1 * (double)i),
                 (m_offset.y() - 0.1 * m_width / 2 + 0.1 * (double)j),
                 m_offset.z());
-            m_nodes[i][j] = newNode;
+            nodes[i][j] = newNode;
         }
     }
 
     // set corner nodes as fixed
-    m_nodes.front().front()->m_fixed = true;
-    m_nodes.front().back()->m_fixed = true;
-    m_nodes.back().front()->m_fixed = true;
-    m_nodes.back().back()->m_fixed = true;
+    nodes.front().front()->m_fixed = true;
+    nodes.front().back()->m_fixed = true;
+    nodes.back().front()->m_fixed = true;
+    nodes.back().back()->m_fixed = true;
 
     // set default physical properties for links
     cGELSkeletonLink::s_default_kSpringElongation = m_elongation;  // [N/m]
@@ -74,24 +150,339 @@ void Deformable::AttachToWorld(ChaiWorld& chaiWorld) {
     cGELSkeletonLink::s_default_color.setWhite();
 
     // create links between nodes
+    if (links)
+        links->resize(4 * (m_length - 1) * (m_width - 1));
     for (int i = 0; i < m_length - 1; i++)
     {
         for (int j = 0; j < m_width - 1; j++)
         {
-            cGELSkeletonLink* newLinkX0 = new cGELSkeletonLink(m_nodes[i + 0][j + 0], m_nodes[i + 1][j + 0]);
-            cGELSkeletonLink* newLinkX1 = new cGELSkeletonLink(m_nodes[i + 0][j + 1], m_nodes[i + 1][j + 1]);
-            cGELSkeletonLink* newLinkY0 = new cGELSkeletonLink(m_nodes[i + 0][j + 0], m_nodes[i + 0][j + 1]);
-            cGELSkeletonLink* newLinkY1 = new cGELSkeletonLink(m_nodes[i + 1][j + 0], m_nodes[i + 1][j + 1]);
-            m_defObject->m_links.push_front(newLinkX0);
-            m_defObject->m_links.push_front(newLinkX1);
-            m_defObject->m_links.push_front(newLinkY0);
-            m_defObject->m_links.push_front(newLinkY1);
+            cGELSkeletonLink* newLinkX0 = new cGELSkeletonLink(nodes[i + 0][j + 0], nodes[i + 1][j + 0]);
+            cGELSkeletonLink* newLinkX1 = new cGELSkeletonLink(nodes[i + 0][j + 1], nodes[i + 1][j + 1]);
+            cGELSkeletonLink* newLinkY0 = new cGELSkeletonLink(nodes[i + 0][j + 0], nodes[i + 0][j + 1]);
+            cGELSkeletonLink* newLinkY1 = new cGELSkeletonLink(nodes[i + 1][j + 0], nodes[i + 1][j + 1]);
+            mesh->m_links.push_front(newLinkX0);
+            mesh->m_links.push_front(newLinkX1);
+            mesh->m_links.push_front(newLinkY0);
+            mesh->m_links.push_front(newLinkY1);
+            if (links) {
+                (*links)[getLinkIndex(i, j, LINK_X0)] = newLinkX0;
+                (*links)[getLinkIndex(i, j, LINK_X1)] = newLinkX1;
+                (*links)[getLinkIndex(i, j, LINK_Y0)] = newLinkY0;
+                (*links)[getLinkIndex(i, j, LINK_Y1)] = newLinkY1;
+            }
         }
     }
 
     // connect skin (mesh) to skeleton (GEM)
-    m_defObject->connectVerticesToSkeleton(false);
+    mesh->connectVerticesToSkeleton(false);
 
     // show/hide underlying dynamic skeleton model
-    m_defObject->m_showSkeletonModel = true;
+    mesh->m_showSkeletonModel = true;
+}
+
+void Deformable::destroySkeleton(cGELMesh* mesh, std::vector<std::vector<cGELSkeletonNode*>>& nodes) {
+
+    // skeleton was allocated in createSkeleton
+    for (cGELSkeletonLink* link : mesh->m_links)
+        delete link;
+    mesh->m_links.clear();
+
+    for (cGELSkeletonNode* node : mesh->m_nodes)
+        delete node;
+    mesh->m_nodes.clear();
+
+    for (int i = 0; i < m_length; i++)
+        for (int j = 0; j < m_width; j++)
+            nodes[i][j] = nullptr;
+
+    delete mesh;
+}
+
+void Deformable::buildSoACloth(const SoAClothTopology* topology) {
+    m_soaCloth = new SoACloth();
+
+    // take node properties from the skeleton so both engines behave the same
+    cGELSkeletonNode* node = m_nodes[0][0];
+    m_soaCloth->setNodeProperties(node->m_mass, node->m_inertia, node->m_kDampingPos, node->m_kDampingRot,
+        node->m_useGravity, node->m_gravity);
+
+    if (topology && topology->numNodes == m_length * m_width && topology->numLinks == getNumLinks()) {
+        m_soaCloth->setTopology(*topology);
+        return;
+    }
+
+    m_soaCloth->reserve(m_length * m_width, 4 * (m_length - 1) * (m_width - 1));
+
+    // node (i, j) is stored at i * m_width + j
+    for (int i = 0; i < m_length; i++)
+        for (int j = 0; j < m_width; j++)
+            m_soaCloth->addNode(m_nodes[i][j]->m_pos, m_nodes[i][j]->m_fixed);
+
+    // same four links per cell as the skeleton, added in getLinkIndex order
+    for (int i = 0; i < m_length - 1; i++)
+    {
+        for (int j = 0; j < m_width - 1; j++)
+        {
+            int n00 = (i + 0) * m_width + (j + 0);
+            int n01 = (i + 0) * m_width + (j + 1);
+            int n10 = (i + 1) * m_width + (j + 0);
+            int n11 = (i + 1) * m_width + (j + 1);
+            m_soaCloth->addLink(n00, n10, m_elongation, m_flexion, m_torsion);
+            m_soaCloth->addLink(n01, n11, m_elongation, m_flexion, m_torsion);
+            m_soaCloth->addLink(n00, n01, m_elongation, m_flexion, m_torsion);
+            m_soaCloth->addLink(n10, n11, m_elongation, m_flexion, m_torsion);
+        }
+    }
+}
+
+void Deformable::buildReducedCloth() {
+    m_reduced = new ReducedCloth();
+
+    // fitted once per cloth configuration, the cache file is named after it
+    unsigned long long key = ReducedCloth::computeKey(*m_soaCloth, m_reducedModes);
+    char path[64];
+    snprintf(path, sizeof(path), "cloth_%dx%d_%016llx.cache", m_width, m_length, key);
+    if (!m_reduced->load(path, key)) {
+        std::cout << "fitting a reduced model of the " << m_width << "x" << m_length << " cloth..." << std::endl;
+        if (!m_reduced->build(*m_soaCloth, m_reducedModes)) {
+            std::cout << "cannot fit a reduced model, simulating the full cloth" << std::endl;
+            delete m_reduced;
+            m_reduced = nullptr;
+            return;
+        }
+        if (!m_reduced->save(path, key))
+            std::cout << "cannot write reduced model: " << path << std::endl;
+    }
+
+    // the cloth starts settled, where the modes are measured from
+    m_reduced->reconstruct(0, m_length * m_width, m_soaCloth->m_posX.data(), m_soaCloth->m_posY.data(), m_soaCloth->m_posZ.data());
+    m_reconstructFirst = 0;
+}
+
+void Deformable::getPackedNodePositions(const double*& x, const double*& y, const double*& z) {
+    if (m_soaCloth) {
+        x = m_soaCloth->m_posX.data();
+        y = m_soaCloth->m_posY.data();
+        z = m_soaCloth->m_posZ.data();
+        return;
+    }
+
+    m_packedX.resize(m_length * m_width);
+    m_packedY.resize(m_length * m_width);
+    m_packedZ.resize(m_length * m_width);
+    for (int i = 0; i < m_length; i++) {
+        for (int j = 0; j < m_width; j++) {
+            const chai3d::cVector3d& pos = m_simNodes[i][j]->m_pos;
+            m_packedX[i * m_width + j] = pos.x();
+            m_packedY[i * m_width + j] = pos.y();
+            m_packedZ[i * m_width + j] = pos.z();
+        }
+    }
+    x = m_packedX.data();
+    y = m_packedY.data();
+    z = m_packedZ.data();
+}
+
+void Deformable::setConstraintIterations(int iterations) {
+    m_constraintIterations = iterations;
+    if (m_soaCloth)
+        m_soaCloth->setConstraintIterations(iterations);
+}
+
+void Deformable::setRefinement(int factor, int radius) {
+    delete m_refinement;
+    m_refinement = nullptr;
+    if (!m_soaCloth || m_reduced || m_surface || factor <= 1)
+        return;
+
+    m_refinement = new ClothRefinement();
+    m_refinement->attach(m_soaCloth, m_width, m_length, 0.1, factor, radius, m_elongation, m_flexion, m_torsion);
+}
+
+void Deformable::setSurfaceContact(bool surfaceContact) {
+    delete m_surface;
+    m_surface = nullptr;
+    if (!surfaceContact)
+        return;
+
+    // the surface does not need finer nodes to be smooth
+    setRefinement(1);
+
+    const double* x;
+    const double* y;
+    const double* z;
+    getPackedNodePositions(x, y, z);
+    m_surface = new SurfaceContact();
+    m_surface->attach(m_width, m_length, x, y, z);
+}
+
+void Deformable::followCursor(const chai3d::cVector3d& point, double reach) {
+    if (!m_refinement)
+        return;
+    if (!isNear(point, reach)) {
+        m_refinement->follow(-1);
+        return;
+    }
+
+    const double* x;
+    const double* y;
+    const double* z;
+    getPackedNodePositions(x, y, z);
+    m_spatialHash.update(x, y, z, m_length * m_width);
+    m_refineCandidates.clear();
+    m_spatialHash.query(point, reach, m_refineCandidates);
+
+    int nearest = -1;
+    double best = reach * reach;
+    for (int index : m_refineCandidates) {
+        double dx = x[index] - point.x();
+        double dy = y[index] - point.y();
+        double dz = z[index] - point.z();
+        double distance2 = dx * dx + dy * dy + dz * dz;
+        if (distance2 <= best) {
+            best = distance2;
+            nearest = index;
+        }
+    }
+    m_refinement->follow(nearest);
+}
+
+int Deformable::updateElasticModel() {
+    // the reduced model keeps the stiffness it was fitted with, and without measured samples
+    // the links keep the elongation they were built with
+    if (m_reduced || !m_elasticModel.hasSamples())
+        return 0;
+
+    const double* x;
+    const double* y;
+    const double* z;
+    getPackedNodePositions(x, y, z);
+
+    m_linkStiffness.resize(getNumLinks());
+    m_changedLinks.clear();
+    m_elasticModel.updateLinkStiffness(x, y, z, m_width, m_length, 0.1, m_linkStiffness.data(), m_changedLinks);
+
+    for (int link : m_changedLinks)
+        setLinkElongation(link, m_linkStiffness[link]);
+    return (int)m_changedLinks.size();
+}
+
+void Deformable::updateDynamics(double time) {
+    if (!m_soaCloth)
+        return;
+
+    if (m_reduced) {
+        m_reduced->updateDynamics(time);
+
+        // the display and the broadphase follow by slices, contact reads the nodes near the
+        // cursor from the modes (see ChaiWorld::computeClothContact)
+        int numNodes = m_length * m_width;
+        int last = std::min(numNodes, m_reconstructFirst + (numNodes + kReconstructSlices - 1) / kReconstructSlices);
+        m_reduced->reconstruct(m_reconstructFirst, last, m_soaCloth->m_posX.data(), m_soaCloth->m_posY.data(), m_soaCloth->m_posZ.data());
+        m_spatialHash.updateRange(m_soaCloth->m_posX.data(), m_soaCloth->m_posY.data(), m_soaCloth->m_posZ.data(), m_reconstructFirst, last);
+        m_reconstructFirst = (last == numNodes) ? 0 : last;
+        return;
+    }
+
+    // the coarse step first, the patch then takes its boundary from it
+    if (m_refinement)
+        m_refinement->beginStep();
+    m_soaCloth->updateDynamics(time);
+    if (m_refinement)
+        m_refinement->updateDynamics(time);
+}
+
+void Deformable::publishState() {
+    ClothFrame& frame = m_frames.getWriteBuffer();
+
+    const double* x;
+    const double* y;
+    const double* z;
+    getPackedNodePositions(x, y, z);
+
+    bool moved = false;
+    m_boundsMin.set(x[0], y[0], z[0]);
+    m_boundsMax.set(x[0], y[0], z[0]);
+    for (int index = 0; index < m_length * m_width; index++) {
+        chai3d::cVector3d& pos = frame.positions[index];
+        pos.set(x[index], y[index], z[index]);
+        m_boundsMin.set(std::min(m_boundsMin.x(), pos.x()), std::min(m_boundsMin.y(), pos.y()), std::min(m_boundsMin.z(), pos.z()));
+        m_boundsMax.set(std::max(m_boundsMax.x(), pos.x()), std::max(m_boundsMax.y(), pos.y()), std::max(m_boundsMax.z(), pos.z()));
+        if (!moved && (pos - m_sleepReference[index]).lengthsq() > kSleepTolerance * kSleepTolerance)
+            moved = true;
+    }
+    frame.step = ++m_step;
+
+    // measure the next motion from here, and let the display know there is something to show
+    if (moved) {
+        m_version++;
+        std::copy(frame.positions.begin(), frame.positions.end(), m_sleepReference.begin());
+        m_stillSteps = 0;
+    }
+    else {
+        m_stillSteps++;
+    }
+    frame.version = m_version;
+
+    m_frames.publish();
+}
+
+bool Deformable::isNear(const chai3d::cVector3d& point, double radius) {
+    // distance from the point to the box, per axis
+    double dx = std::max(0.0, std::max(m_boundsMin.x() - point.x(), point.x() - m_boundsMax.x()));
+    double dy = std::max(0.0, std::max(m_boundsMin.y() - point.y(), point.y() - m_boundsMax.y()));
+    double dz = std::max(0.0, std::max(m_boundsMin.z() - point.z(), point.z() - m_boundsMax.z()));
+    return dx * dx + dy * dy + dz * dz <= radius * radius;
+}
+
+bool Deformable::isSettled() {
+    return m_stillSteps >= kSleepSteps;
+}
+
+bool Deformable::updateDisplay() {
+    if (!m_frames.update())
+        return false;
+
+    // steps below the sleep tolerance are not worth a copy, a re-skin and a redraw
+    const ClothFrame& frame = m_frames.getReadBuffer();
+    if (frame.version == m_displayedVersion)
+        return false;
+    m_displayedVersion = frame.version;
+
+    for (int i = 0; i < m_length; i++)
+        for (int j = 0; j < m_width; j++)
+            m_nodes[i][j]->m_pos = frame.positions[i * m_width + j];
+
+    // the displayed mesh is not in cGELWorld, its skin follows the frame here and nowhere else
+    m_defObject->updateVertexPosition();
+    m_defObject->computeAllNormals();
+    return true;
+}
+
+void Deformable::DetachFromWorld(ChaiWorld& chaiWorld) {
+
+    chaiWorld.removeDeformable(this);
+
+    chaiWorld.getWorld()->removeChild(m_defObject);
+    destroySkeleton(m_defObject, m_nodes);
+    m_defObject = nullptr;
+
+    if (m_simObject) {
+        chaiWorld.getDefWorld()->m_gelMeshes.remove(m_simObject);
+        destroySkeleton(m_simObject, m_simNodes);
+        m_simLinks.clear();
+        m_simObject = nullptr;
+    }
+
+    delete m_refinement;
+    m_refinement = nullptr;
+
+    delete m_reduced;
+    m_reduced = nullptr;
+
+    delete m_surface;
+    m_surface = nullptr;
+
+    delete m_soaCloth;
+    m_soaCloth = nullptr;
 }
\ No newline at end of file
@@ -4,6 +4,41 @@
 
 #include "GEL3D.h"
 
+#include "ClothRefinement.h"
+#include "ElasticModel.h"
+#include "ReducedCloth.h"
+#include "SoACloth.h"
+#include "SpatialHash.h"
+#include "SurfaceContact.h"
+#include "TripleBuffer.h"
+
+// simulation backend of a Deformable
+enum class ClothEngine
+{
+	GEL,		// cGELWorld skeleton, one heap object per node and link
+	SoA,		// SoACloth, flat arrays
+	Implicit,	// SoACloth with backward euler, stable for much stiffer links at the same step
+	XPBD,		// SoACloth with compliant position constraints, fixed cost per step
+	Reduced		// ReducedCloth fitted to a SoACloth once (cached on disk), a few modes per step
+};
+
+// the four links of a grid cell, X along i (length) and Y along j (width)
+enum ClothLink
+{
+	LINK_X0,	// (i, j) - (i + 1, j)
+	LINK_X1,	// (i, j + 1) - (i + 1, j + 1)
+	LINK_Y0,	// (i, j) - (i, j + 1)
+	LINK_Y1		// (i + 1, j) - (i + 1, j + 1)
+};
+
+// cloth state handed from the haptic thread to the graphics thread, node (i, j) at i * width + j
+struct ClothFrame
+{
+	std::vector<chai3d::cVector3d> positions;
+	unsigned long step;
+	unsigned long version;
+};
+
 class Deformable
 {
 	friend class ChaiWorld;
@@ -11,32 +46,184 @@ class Deformable
 public:
 	Deformable(int width, int length, chai3d::cVector3d offset, 
 		double elongation = 25.0, double flexion = 0.5, double torsion = 0.1,
-    double c11 = 42.871021, double c12 = -0.234556, double c22 = 65.166023, double c33 = 83.175644);
+    double c11 = 42.871021, double c12 = -0.234556, double c22 = 65.166023, double c33 = 83.175644,
+		ClothEngine engine = ClothEngine::GEL);
 	~Deformable() = default;
 
 	cGELMesh* getDefObject() { return m_defObject; }
+	double getModelRadius() { return m_modelRadius; }
+	double getStiffness() { return m_stiffness; }
+	ClothEngine getEngine() { return m_engine; }
+	ElasticModel& getElasticModel() { return m_elasticModel; }
+	int getWidth() { return m_width; }
+	int getLength() { return m_length; }
+
+	// nullptr for ClothEngine::GEL
+	SoACloth* getSoACloth() { return m_soaCloth; }
+
+	// constraint iterations per step of ClothEngine::XPBD, trades accuracy for a time bound
+	void setConstraintIterations(int iterations);
+
+	// simulate a window of 2 * radius cells around the cursor factor times finer (see ClothRefinement),
+	// factor 1 turns it off. engines other than GEL, after AttachToWorld
+	void setRefinement(int factor, int radius = 3);
+
+	// nullptr unless refined
+	ClothRefinement* getRefinement() { return m_refinement; }
+
+	// modes of ClothEngine::Reduced, before AttachToWorld
+	void setReducedModes(int numModes) { m_reducedModes = numModes; }
+
+	// nullptr unless ClothEngine::Reduced
+	ReducedCloth* getReducedCloth() { return m_reduced; }
+
+	// render the cursor contact on the triangle surface through the nodes instead of on their
+	// spheres (see SurfaceContact), drops the refined window. after AttachToWorld
+	void setSurfaceContact(bool surfaceContact);
+
+	// nullptr unless surface contact is on
+	SurfaceContact* getSurfaceContact() { return m_surface; }
+
+	// haptic thread: move the refined window to the node nearest to point if one is within reach
+	void followCursor(const chai3d::cVector3d& point, double reach);
+
+	// node access independent of the engine, i along length and j along width
+	chai3d::cVector3d getNodePos(int i, int j) {
+		return m_soaCloth ? m_soaCloth->getNodePos(i * m_width + j) : m_simNodes[i][j]->m_pos;
+	}
+	void setExternalForce(int i, int j, const chai3d::cVector3d& force) {
+		if (m_soaCloth)
+			m_soaCloth->setExternalForce(i * m_width + j, force);
+		else
+			m_simNodes[i][j]->setExternalForce(force);
+	}
+
+	// link access independent of the engine, link (i, j, k) of cell (i, j) at (i * (width - 1) + j) * 4 + k
+	int getLinkIndex(int i, int j, ClothLink k) { return (i * (m_width - 1) + j) * 4 + k; }
+	int getNumLinks() { return 4 * (m_length - 1) * (m_width - 1); }
+	void setLinkElongation(int link, double kElongation) {
+		if (m_soaCloth)
+			m_soaCloth->setLinkElongation(link, kElongation);
+		else
+			m_simLinks[link]->m_kSpringElongation = kElongation;
+	}
+
+	// contiguous node coordinates indexed i * width + j, gathered from the skeleton for GEL
+	void getPackedNodePositions(const double*& x, const double*& y, const double*& z);
+
+	// set the elongation stiffness of the links from the current strain (data driven elastic model),
+	// only links of cells that deformed since the last call are written. returns their number, no
+	// link is written until getElasticModel().setSamples() was called
+	int updateElasticModel();
+
+	// step engines that are not driven by cGELWorld, no-op for GEL
+	void updateDynamics(double time);
+
+	// haptic thread: publish the current node positions, never blocks
+	void publishState();
 
-	// setup object properties in world
-	void AttachToWorld(ChaiWorld& chaiWorld);
+	// true if a sphere at point with the given radius overlaps the bounds of the last published state
+	bool isNear(const chai3d::cVector3d& point, double radius);
+
+	// true once no node moved more than the sleep tolerance for a while (see publishState)
+	bool isSettled();
+
+	// haptic thread: state version, bumped by publishState when a node moved more than the sleep tolerance
+	unsigned long getVersion() { return m_version; }
+
+	// graphics thread: move the displayed skeleton and its skin to the latest published frame,
+	// returns false if its version is already displayed
+	bool updateDisplay();
+
+	// setup object properties in world. engines other than GEL take their SoACloth from topology
+	// if given (see SceneFile), it must come from a Deformable with the same constructor arguments
+	void AttachToWorld(ChaiWorld& chaiWorld, const SoAClothTopology* topology = nullptr);
+
+	// remove object from world and release its skeleton
+	void DetachFromWorld(ChaiWorld& chaiWorld);
 
 private:
+	// grid of nodes with four links per cell, the same for display and simulation
+	// links are also stored indexed as in getLinkIndex if requested
+	void createSkeleton(cGELMesh* mesh, std::vector<std::vector<cGELSkeletonNode*>>& nodes,
+		std::vector<cGELSkeletonLink*>* links = nullptr);
+	void destroySkeleton(cGELMesh* mesh, std::vector<std::vector<cGELSkeletonNode*>>& nodes);
+
+	// mirror the skeleton built in AttachToWorld into a SoACloth, or copy a prebuilt topology
+	void buildSoACloth(const SoAClothTopology* topology);
+
+	// load the reduced model of m_soaCloth from its cache file, or fit and save it
+	void buildReducedCloth();
+
+	ClothEngine m_engine;
+
 	int m_width;
 	int m_length;
 
 	chai3d::cVector3d m_offset;
 
-	// object mesh
+	// object mesh, display only
 	cGELMesh* m_defObject;
 
-	// dynamic nodes
+	// displayed nodes
 	std::vector<std::vector<cGELSkeletonNode*>> m_nodes;
 
+	// simulated skeleton in cGELWorld, nullptr unless m_engine is ClothEngine::GEL
+	cGELMesh* m_simObject;
+	std::vector<std::vector<cGELSkeletonNode*>> m_simNodes;
+	std::vector<cGELSkeletonLink*> m_simLinks;
+
+	// flat array engine, nullptr for ClothEngine::GEL
+	SoACloth* m_soaCloth;
+
+	// finer patch around the cursor, nullptr unless refined
+	ClothRefinement* m_refinement;
+	std::vector<int> m_refineCandidates;
+
+	// reduced model, nullptr unless ClothEngine::Reduced. m_soaCloth then only holds its
+	// reconstructed nodes, the next slice of them starts at m_reconstructFirst
+	ReducedCloth* m_reduced;
+	int m_reducedModes;
+	int m_reconstructFirst;
+
+	// cursor contact on the triangle surface, nullptr if the nodes are touched one by one
+	SurfaceContact* m_surface;
+
+	// broadphase over node positions for cursor contact, cell size is the contact distance
+	SpatialHash m_spatialHash;
+
+	// published frames and the number of steps published so far
+	TripleBuffer<ClothFrame> m_frames;
+	unsigned long m_step;
+
+	// state version of the haptic thread and the one in the displayed skeleton
+	unsigned long m_version;
+	unsigned long m_displayedVersion;
+
+	// bounds of the last published state
+	chai3d::cVector3d m_boundsMin;
+	chai3d::cVector3d m_boundsMax;
+
+	// node positions the cloth last moved away from and the published steps since then,
+	// a settled cloth out of reach of the cursor is not stepped (m_sleeping, see ChaiWorld::stepScene)
+	std::vector<chai3d::cVector3d> m_sleepReference;
+	int m_stillSteps;
+	bool m_sleeping;
+
+	// gather buffers for getPackedNodePositions with the GEL engine
+	std::vector<double> m_packedX;
+	std::vector<double> m_packedY;
+	std::vector<double> m_packedZ;
+
 	// radius of the dynamic model sphere (GEM)
 	double m_modelRadius;
 
 	// stiffness properties between the haptic device tool and the model (GEM)
 	double m_stiffness;
 
+	// XPBD constraint iterations
+	int m_constraintIterations;
+
 	// spring parameters
 	double m_elongation;
 	double m_flexion;
@@ -51,4 +238,9 @@ private:
 	double m_c12;
 	double m_c22;
 	double m_c33;
+	ElasticModel m_elasticModel;
+
+	// output of m_elasticModel by link index and the links it changed this tick
+	std::vector<double> m_linkStiffness;
+	std::vector<int> m_changedLinks;
 };
\ No newline at end of file
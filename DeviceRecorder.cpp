@@ -0,0 +1,92 @@
+#include "DeviceRecorder.h"
+
+#include <cstring>
+
+const char DeviceRecorder::MAGIC[8] = { 'C', 'L', 'O', 'T', 'H', 'R', 'E', 'C' };
+
+DeviceRecorder::DeviceRecorder() : m_file(nullptr), m_running(false), m_ring(4096), m_dropped(0) {
+}
+
+DeviceRecorder::~DeviceRecorder() {
+    stop();
+}
+
+bool DeviceRecorder::start(const std::string& path, const chai3d::cHapticDeviceInfo& info) {
+    stop();
+
+    m_file = fopen(path.c_str(), "wb");
+    if (!m_file)
+        return false;
+
+    DeviceRecordingHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.sampleSize = sizeof(DeviceSample);
+    header.workspaceRadius = info.m_workspaceRadius;
+    header.maxLinearStiffness = info.m_maxLinearStiffness;
+    header.maxLinearForce = info.m_maxLinearForce;
+    fwrite(&header, sizeof(header), 1, m_file);
+
+    m_dropped = 0;
+    m_start = std::chrono::steady_clock::now();
+    m_running = true;
+    m_writer = std::thread(&DeviceRecorder::writerLoop, this);
+    return true;
+}
+
+void DeviceRecorder::stop() {
+    if (!m_file)
+        return;
+
+    m_running = false;
+    m_writer.join();
+
+    // the haptic thread is done with the ring by now
+    flush();
+    fclose(m_file);
+    m_file = nullptr;
+}
+
+void DeviceRecorder::record(chai3d::cGenericHapticDevice* device, const chai3d::cVector3d& position) {
+    DeviceSample sample;
+    sample.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    sample.position[0] = position.x();
+    sample.position[1] = position.y();
+    sample.position[2] = position.z();
+
+    chai3d::cMatrix3d rotation;
+    rotation.identity();
+    device->getRotation(rotation);
+    for (int row = 0; row < 3; row++)
+        for (int col = 0; col < 3; col++)
+            sample.rotation[3 * row + col] = (float)rotation(row, col);
+
+    double gripperAngle = 0.0;
+    device->getGripperAngleRad(gripperAngle);
+    sample.gripperAngle = (float)gripperAngle;
+
+    sample.userSwitches = 0;
+    device->getUserSwitches(sample.userSwitches);
+    sample.padding = 0;
+
+    if (!m_ring.push(sample))
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+size_t DeviceRecorder::flush() {
+    size_t written = 0;
+    size_t count;
+    while ((count = m_ring.pop(m_chunk, sizeof(m_chunk) / sizeof(m_chunk[0]))) > 0) {
+        fwrite(m_chunk, sizeof(DeviceSample), count, m_file);
+        written += count;
+    }
+    return written;
+}
+
+void DeviceRecorder::writerLoop() {
+    while (m_running.load(std::memory_order_acquire)) {
+        if (flush() == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "chai3d.h"
+#include "SpscRing.h"
+
+// one haptic tick of device state. a recording is a DeviceRecordingHeader followed by samples
+// in time order, appended as they come, so a cut off file is still valid up to its last sample
+
+struct DeviceSample
+{
+	double time;			// [s] since the recording started
+	double position[3];		// [m] device workspace
+	float rotation[9];		// row major
+	float gripperAngle;		// [rad]
+	unsigned int userSwitches;
+	unsigned int padding;
+};
+
+struct DeviceRecordingHeader
+{
+	char magic[8];
+	unsigned int version;
+	unsigned int sampleSize;
+
+	// of the recorded device, so a replay maps the workspace the same way
+	double workspaceRadius;
+	double maxLinearStiffness;
+	double maxLinearForce;
+};
+
+// records device state at full haptic rate. record() only pushes to a lock-free ring, a writer
+// thread appends the ring to the file, so the haptic thread never waits for the disk
+
+class DeviceRecorder
+{
+public:
+	DeviceRecorder();
+	~DeviceRecorder();
+
+	// not copyable
+	DeviceRecorder(const DeviceRecorder&) = delete;
+	DeviceRecorder& operator= (const DeviceRecorder&) = delete;
+
+	// create the file and start the writer thread, returns false if the file cannot be created
+	bool start(const std::string& path, const chai3d::cHapticDeviceInfo& info);
+
+	// write the remaining samples and close the file
+	void stop();
+
+	bool isRecording() { return m_file != nullptr; }
+
+	// haptic thread: sample the device, position is the raw one already read this tick
+	void record(chai3d::cGenericHapticDevice* device, const chai3d::cVector3d& position);
+
+	// samples lost because the ring was full
+	unsigned long getDroppedSamples() { return m_dropped.load(std::memory_order_relaxed); }
+
+	static const char MAGIC[8];
+	static const unsigned int VERSION = 1;
+
+private:
+	void writerLoop();
+
+	// drain the ring to the file, returns the number of samples written
+	size_t flush();
+
+	FILE* m_file;
+	std::thread m_writer;
+	std::atomic<bool> m_running;
+
+	// a few seconds at 1 kHz, the writer empties it every couple of milliseconds
+	SpscRing<DeviceSample> m_ring;
+	DeviceSample m_chunk[256];
+
+	std::atomic<unsigned long> m_dropped;
+
+	// start of the recording
+	std::chrono::steady_clock::time_point m_start;
+};
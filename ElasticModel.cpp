@@ -0,0 +1,201 @@
+#include "ElasticModel.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+    // piecewise linear interpolation over ascending samples, clamped at both ends
+    void bracket(const std::vector<double>& samples, double value, int& index, double& fraction) {
+        if (samples.size() < 2 || value <= samples.front()) {
+            index = 0;
+            fraction = 0.0;
+            return;
+        }
+        if (value >= samples.back()) {
+            index = (int)samples.size() - 2;
+            fraction = 1.0;
+            return;
+        }
+        index = (int)(std::upper_bound(samples.begin(), samples.end(), value) - samples.begin()) - 1;
+        fraction = (value - samples[index]) / (samples[index + 1] - samples[index]);
+    }
+
+    // green strain of cell j between rows 0 and 1, reduced to lambda_max and cos(2 phi)
+    inline void cellStrain(const double* x0, const double* y0, const double* z0,
+        const double* x1, const double* y1, const double* z1, int j, double invRest2,
+        double& lambdaMax, double& cos2Phi) {
+
+        // cell edges along x (i) and y (j), averaged over both sides
+        double ux = 0.5 * ((x1[j] - x0[j]) + (x1[j + 1] - x0[j + 1]));
+        double uy = 0.5 * ((y1[j] - y0[j]) + (y1[j + 1] - y0[j + 1]));
+        double uz = 0.5 * ((z1[j] - z0[j]) + (z1[j + 1] - z0[j + 1]));
+        double vx = 0.5 * ((x0[j + 1] - x0[j]) + (x1[j + 1] - x1[j]));
+        double vy = 0.5 * ((y0[j + 1] - y0[j]) + (y1[j + 1] - y1[j]));
+        double vz = 0.5 * ((z0[j + 1] - z0[j]) + (z1[j + 1] - z1[j]));
+
+        // green strain of the cell in cloth coordinates
+        double exx = 0.5 * ((ux * ux + uy * uy + uz * uz) * invRest2 - 1.0);
+        double eyy = 0.5 * ((vx * vx + vy * vy + vz * vz) * invRest2 - 1.0);
+        double exy = 0.5 * (ux * vx + uy * vy + uz * vz) * invRest2;
+
+        // principal strain and its direction, phi = 45 deg when the strain is isotropic
+        double center = 0.5 * (exx + eyy);
+        double half = 0.5 * (exx - eyy);
+        double radius = sqrt(half * half + exy * exy);
+        lambdaMax = center + radius;
+        cos2Phi = half / (radius + 1e-12);
+    }
+
+    ElasticCoefficients lerp(const ElasticCoefficients& a, const ElasticCoefficients& b, double t) {
+        return { a.c11 + (b.c11 - a.c11) * t, a.c12 + (b.c12 - a.c12) * t,
+            a.c22 + (b.c22 - a.c22) * t, a.c33 + (b.c33 - a.c33) * t };
+    }
+}
+
+ElasticModel::ElasticModel(double c11, double c12, double c22, double c33) :
+    m_lambdaMin(0.0), m_invLambdaStep(1.0), m_table(LAMBDA_SAMPLES * PHI_SAMPLES, ElasticCoefficients{ c11, c12, c22, c33 }),
+    m_tolerance(0.0001), m_dirtyAll(true), m_hasSamples(false) {
+}
+
+void ElasticModel::setSamples(const std::vector<double>& lambdas, const std::vector<double>& phis,
+    const std::vector<ElasticCoefficients>& coefficients) {
+
+    if (lambdas.empty() || phis.empty() || coefficients.size() != lambdas.size() * phis.size())
+        return;
+
+    m_lambdaMin = lambdas.front();
+    double lambdaRange = lambdas.back() - lambdas.front();
+    m_invLambdaStep = lambdaRange > 0.0 ? (LAMBDA_SAMPLES - 1) / lambdaRange : 1.0;
+
+    int numPhis = (int)phis.size();
+    for (int a = 0; a < LAMBDA_SAMPLES; a++) {
+        double lambda = m_lambdaMin + a / m_invLambdaStep;
+        int la;
+        double fa;
+        bracket(lambdas, lambda, la, fa);
+        int lb = std::min(la + 1, (int)lambdas.size() - 1);
+
+        for (int b = 0; b < PHI_SAMPLES; b++) {
+            // grid column b sits at cos(2 phi) = 1 - 2b / (PHI_SAMPLES - 1)
+            double phi = 0.5 * acos(1.0 - 2.0 * b / (PHI_SAMPLES - 1));
+            int pa;
+            double fp;
+            bracket(phis, phi, pa, fp);
+            int pb = std::min(pa + 1, numPhis - 1);
+
+            ElasticCoefficients low = lerp(coefficients[la * numPhis + pa], coefficients[la * numPhis + pb], fp);
+            ElasticCoefficients high = lerp(coefficients[lb * numPhis + pa], coefficients[lb * numPhis + pb], fp);
+            m_table[a * PHI_SAMPLES + b] = lerp(low, high, fa);
+        }
+    }
+    m_dirtyAll = true;
+    m_hasSamples = true;
+}
+
+void ElasticModel::computeLinkStiffness(const double* x, const double* y, const double* z,
+    int width, int length, double restLength, double* stiffness) {
+
+    double invRest2 = 1.0 / (restLength * restLength);
+    m_lambdaMax.resize(width);
+    m_cos2Phi.resize(width);
+    double* lambdaMax = m_lambdaMax.data();
+    double* cos2Phi = m_cos2Phi.data();
+
+    for (int i = 0; i < length - 1; i++) {
+        const double* x0 = x + i * width;
+        const double* y0 = y + i * width;
+        const double* z0 = z + i * width;
+        const double* x1 = x0 + width;
+        const double* y1 = y0 + width;
+        const double* z1 = z0 + width;
+
+        // strain of one row of cells, a plain loop over arrays so the compiler can vectorize it
+        for (int j = 0; j < width - 1; j++)
+            cellStrain(x0, y0, z0, x1, y1, z1, j, invRest2, lambdaMax[j], cos2Phi[j]);
+
+        // the cell spans restLength x restLength, its membrane stiffness along x is shared
+        // by its two x links and, for inner edges, with the neighbouring cell's links.
+        // the links are axis aligned, so c12 and c33 have no spring to act on
+        double* k = stiffness + i * (width - 1) * 4;
+        for (int j = 0; j < width - 1; j++, k += 4) {
+            ElasticCoefficients c = lookup(lambdaMax[j], cos2Phi[j]);
+            k[0] = 0.5 * c.c11;
+            k[1] = 0.5 * c.c11;
+            k[2] = 0.5 * c.c22;
+            k[3] = 0.5 * c.c22;
+        }
+    }
+}
+
+void ElasticModel::updateLinkStiffness(const double* x, const double* y, const double* z,
+    int width, int length, double restLength, double* stiffness, std::vector<int>& changedLinks) {
+
+    int numNodes = width * length;
+    if (m_dirtyAll || (int)m_nodeMoved.size() != numNodes) {
+        computeLinkStiffness(x, y, z, width, length, restLength, stiffness);
+        for (int link = 0; link < 4 * (width - 1) * (length - 1); link++)
+            changedLinks.push_back(link);
+
+        m_referenceX.assign(x, x + numNodes);
+        m_referenceY.assign(y, y + numNodes);
+        m_referenceZ.assign(z, z + numNodes);
+        m_nodeMoved.assign(numNodes, 0);
+        m_dirtyAll = false;
+        return;
+    }
+
+    // nodes that moved past the tolerance, the only cells that can have a new strain are theirs
+    double tolerance2 = m_tolerance * m_tolerance;
+    bool anyMoved = false;
+    for (int n = 0; n < numNodes; n++) {
+        double dx = x[n] - m_referenceX[n];
+        double dy = y[n] - m_referenceY[n];
+        double dz = z[n] - m_referenceZ[n];
+        m_nodeMoved[n] = dx * dx + dy * dy + dz * dz > tolerance2;
+        anyMoved |= m_nodeMoved[n] != 0;
+    }
+    if (!anyMoved)
+        return;
+
+    double invRest2 = 1.0 / (restLength * restLength);
+    for (int i = 0; i < length - 1; i++) {
+        const char* moved0 = &m_nodeMoved[i * width];
+        const char* moved1 = moved0 + width;
+        const double* x0 = x + i * width;
+        const double* y0 = y + i * width;
+        const double* z0 = z + i * width;
+        const double* x1 = x0 + width;
+        const double* y1 = y0 + width;
+        const double* z1 = z0 + width;
+
+        for (int j = 0; j < width - 1; j++) {
+            if (!(moved0[j] | moved0[j + 1] | moved1[j] | moved1[j + 1]))
+                continue;
+
+            double lambdaMax;
+            double cos2Phi;
+            cellStrain(x0, y0, z0, x1, y1, z1, j, invRest2, lambdaMax, cos2Phi);
+            ElasticCoefficients c = lookup(lambdaMax, cos2Phi);
+
+            // same split as computeLinkStiffness
+            double cellStiffness[4] = { 0.5 * c.c11, 0.5 * c.c11, 0.5 * c.c22, 0.5 * c.c22 };
+            int first = (i * (width - 1) + j) * 4;
+            for (int k = 0; k < 4; k++) {
+                if (stiffness[first + k] != cellStiffness[k]) {
+                    stiffness[first + k] = cellStiffness[k];
+                    changedLinks.push_back(first + k);
+                }
+            }
+        }
+    }
+
+    // every cell of a moved node was evaluated at the new position
+    for (int n = 0; n < numNodes; n++) {
+        if (m_nodeMoved[n]) {
+            m_referenceX[n] = x[n];
+            m_referenceY[n] = y[n];
+            m_referenceZ[n] = z[n];
+        }
+    }
+}
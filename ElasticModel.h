@@ -0,0 +1,115 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+// data-driven piecewise linear elastic model for cloth (Wang et al. 2011, "Data-Driven Elastic
+// Models for Cloth: Modeling and Measurement"). the stiffness C = (c11, c12, c22, c33) of an
+// element is interpolated over its maximum principal strain lambda_max and the angle phi between
+// that strain and the warp (x) direction. samples are resampled once onto a small uniform grid,
+// so each element costs a bilinear lookup without branches. until samples are set the table
+// only holds the constructor's constant C, hasSamples() tells the caller not to apply it.
+// the links of a grid cell are axis aligned: c11 and c22 set their elongation stiffness, c12
+// (poisson coupling) and c33 (shear) are interpolated but need diagonal links or a membrane
+// force per cell to act on, which the cloth does not have yet
+
+// planar orthotropic stiffness, stress = C * strain
+struct ElasticCoefficients
+{
+	double c11;
+	double c12;
+	double c22;
+	double c33;
+};
+
+class ElasticModel
+{
+public:
+	// linear model with the same C everywhere
+	ElasticModel(double c11 = 42.871021, double c12 = -0.234556, double c22 = 65.166023, double c33 = 83.175644);
+	~ElasticModel() = default;
+
+	// measured data points, coefficients[a * phis.size() + b] at (lambdas[a], phis[b]) with both
+	// axes ascending and phi in [0, pi/2]. lookups outside of the samples are clamped
+	void setSamples(const std::vector<double>& lambdas, const std::vector<double>& phis,
+		const std::vector<ElasticCoefficients>& coefficients);
+
+	// false while the table is the constant C of the constructor
+	bool hasSamples() const { return m_hasSamples; }
+
+	// C at a strain state, lambda_max from the principal strains, cos2Phi = cos(2 phi)
+	inline ElasticCoefficients lookup(double lambdaMax, double cos2Phi) const;
+
+	// elongation stiffness of the four links of every cell of a width x length grid with
+	// spacing restLength, node (i, j) at i * width + j. the links of cell (i, j) are written to
+	// (i * (width - 1) + j) * 4 + k with k = X0, X1, Y0, Y1, as in Deformable::createSkeleton
+	void computeLinkStiffness(const double* x, const double* y, const double* z,
+		int width, int length, double restLength, double* stiffness);
+
+	// same as computeLinkStiffness, but only cells with a node that moved more than the tolerance
+	// since the cell was last evaluated are recomputed, and only links whose stiffness changed
+	// are appended to changedLinks. the first call, setSamples and size changes redo all cells
+	void updateLinkStiffness(const double* x, const double* y, const double* z,
+		int width, int length, double restLength, double* stiffness, std::vector<int>& changedLinks);
+
+	// make the next updateLinkStiffness redo all cells
+	void invalidate() { m_dirtyAll = true; }
+
+	// node displacement [m] below which a cell keeps its stiffness
+	void setTolerance(double tolerance) { m_tolerance = tolerance; }
+	double getTolerance() { return m_tolerance; }
+
+private:
+	// C at grid point (a, b)
+	const ElasticCoefficients& at(int a, int b) const { return m_table[a * PHI_SAMPLES + b]; }
+
+	// grid resolution, 16 x 8 x 32 bytes stays in L1
+	static const int LAMBDA_SAMPLES = 16;
+	static const int PHI_SAMPLES = 8;
+
+	// lambda_max axis, uniform in [m_lambdaMin, m_lambdaMin + (LAMBDA_SAMPLES - 1) / m_invLambdaStep]
+	double m_lambdaMin;
+	double m_invLambdaStep;
+
+	// phi axis, stored uniform in cos(2 phi) from 1 (warp) to -1 (weft), so no atan2 per element
+	std::vector<ElasticCoefficients> m_table;
+
+	// strain state of one row of cells
+	std::vector<double> m_lambdaMax;
+	std::vector<double> m_cos2Phi;
+
+	// dirty tracking for updateLinkStiffness: node positions at the last evaluation of their
+	// cells, nodes past the tolerance this tick, and whether everything needs a recompute
+	double m_tolerance;
+	std::vector<double> m_referenceX;
+	std::vector<double> m_referenceY;
+	std::vector<double> m_referenceZ;
+	std::vector<char> m_nodeMoved;
+	bool m_dirtyAll;
+
+	bool m_hasSamples;
+};
+
+inline ElasticCoefficients ElasticModel::lookup(double lambdaMax, double cos2Phi) const {
+	// clamp to the last cell with min/max so the compiler emits no branches
+	double u = std::min(std::max((lambdaMax - m_lambdaMin) * m_invLambdaStep, 0.0), LAMBDA_SAMPLES - 1.000001);
+	double v = std::min(std::max((1.0 - cos2Phi) * 0.5 * (PHI_SAMPLES - 1), 0.0), PHI_SAMPLES - 1.000001);
+	int a = (int)u;
+	int b = (int)v;
+	double fu = u - a;
+	double fv = v - b;
+
+	const ElasticCoefficients& c00 = at(a, b);
+	const ElasticCoefficients& c01 = at(a, b + 1);
+	const ElasticCoefficients& c10 = at(a + 1, b);
+	const ElasticCoefficients& c11 = at(a + 1, b + 1);
+	double w00 = (1.0 - fu) * (1.0 - fv);
+	double w01 = (1.0 - fu) * fv;
+	double w10 = fu * (1.0 - fv);
+	double w11 = fu * fv;
+
+	return { w00 * c00.c11 + w01 * c01.c11 + w10 * c10.c11 + w11 * c11.c11,
+		w00 * c00.c12 + w01 * c01.c12 + w10 * c10.c12 + w11 * c11.c12,
+		w00 * c00.c22 + w01 * c01.c22 + w10 * c10.c22 + w11 * c11.c22,
+		w00 * c00.c33 + w01 * c01.c33 + w10 * c10.c33 + w11 * c11.c33 };
+}
@@ -0,0 +1,140 @@
+#include "FramePacer.h"
+
+#include <ctime>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <time.h>
+#endif
+
+namespace {
+
+    // frames per statistics update
+    const int kStatsWindow = 60;
+
+    // [ns] a fence wait returns to check for failure this often
+    const GLuint64 kFenceTimeout = 100000000;
+}
+
+FramePacer::FramePacer(int framesInFlight) :
+    m_framesInFlight(framesInFlight < 0 ? 0 : framesInFlight), m_frames(0), m_beginCpu(0.0), m_wait(0.0),
+    m_windowFrames(0), m_windowWall(0.0), m_windowWait(0.0), m_windowCpu(0.0),
+    m_frameTime(0.0), m_waitTime(0.0), m_cpuUsage(0.0), m_totalWall(0.0), m_totalWait(0.0), m_totalCpu(0.0) {
+}
+
+bool FramePacer::initialize() {
+    m_frames = 0;
+    m_totalWall = 0.0;
+    m_totalWait = 0.0;
+    m_totalCpu = 0.0;
+    m_windowFrames = 0;
+    m_windowWall = 0.0;
+    m_windowWait = 0.0;
+    m_windowCpu = 0.0;
+
+#ifdef GLEW_VERSION
+    if (m_framesInFlight > 0 && !GLEW_VERSION_3_2 && !GLEW_ARB_sync)
+        m_framesInFlight = 0;
+#endif
+    m_fences.assign(m_framesInFlight, nullptr);
+    return m_framesInFlight > 0;
+}
+
+void FramePacer::release() {
+    for (GLsync& fence : m_fences) {
+        if (fence)
+            waitForFence(fence);
+        fence = nullptr;
+    }
+}
+
+double FramePacer::threadCpuTime() {
+#if defined(_WIN32)
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+        return 0.0;
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    return (double)(k.QuadPart + u.QuadPart) * 1e-7;
+#elif defined(__linux__)
+    timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+#else
+    return (double)std::clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+void FramePacer::waitForFence(GLsync fence) {
+    // flush once so the fence reaches the GPU, then keep waiting until it signals
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    while (glClientWaitSync(fence, flags, kFenceTimeout) == GL_TIMEOUT_EXPIRED)
+        flags = 0;
+    glDeleteSync(fence);
+}
+
+void FramePacer::beginFrame() {
+    m_beginWall = std::chrono::steady_clock::now();
+    m_beginCpu = threadCpuTime();
+    m_wait = 0.0;
+}
+
+void FramePacer::waitForFrame() {
+    if (m_framesInFlight == 0)
+        return;
+
+    // the slot of this frame holds the fence of the frame framesInFlight back
+    GLsync& fence = m_fences[m_frames % m_framesInFlight];
+    if (fence) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        waitForFence(fence);
+        fence = nullptr;
+        m_wait += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+void FramePacer::endFrame() {
+    if (m_framesInFlight == 0) {
+        // wait until all GL commands are completed
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        glFinish();
+        m_wait += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    else {
+        // a wait skipped by a frame that did not call waitForFrame leaves its fence in the slot
+        GLsync& fence = m_fences[m_frames % m_framesInFlight];
+        if (fence)
+            waitForFence(fence);
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        // submit the frame without waiting for it
+        glFlush();
+    }
+    m_frames++;
+
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_beginWall).count();
+    double cpu = threadCpuTime() - m_beginCpu;
+    m_totalWall += wall;
+    m_totalWait += m_wait;
+    m_totalCpu += cpu;
+
+    m_windowWall += wall;
+    m_windowWait += m_wait;
+    m_windowCpu += cpu;
+    if (++m_windowFrames == kStatsWindow) {
+        m_frameTime = 1000.0 * m_windowWall / m_windowFrames;
+        m_waitTime = 1000.0 * m_windowWait / m_windowFrames;
+        m_cpuUsage = m_windowWall > 0.0 ? 100.0 * m_windowCpu / m_windowWall : 0.0;
+        m_windowFrames = 0;
+        m_windowWall = 0.0;
+        m_windowWait = 0.0;
+        m_windowCpu = 0.0;
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+#include "chai3d.h"
+
+// paces the graphics loop against the GL driver. with no frames in flight every frame ends in
+// glFinish, the CPU waits for the GPU before it polls events and prepares the next frame. with
+// N frames in flight each frame ends in a fence instead, and a frame only waits for the fence of
+// the frame N back before its first GL command, so the skins, polygons and labels of frame N + 1
+// are prepared while the driver still works on frame N. needs GL 3.2 or ARB_sync (Mesa llvmpipe
+// has both), without them it falls back to glFinish. also measures the frame time, the time
+// spent waiting for the GPU and the CPU usage of the graphics thread, so both modes can be compared
+
+class FramePacer
+{
+public:
+	// framesInFlight 0 finishes every frame
+	FramePacer(int framesInFlight = 0);
+	~FramePacer() = default;
+
+	// not copyable
+	FramePacer(const FramePacer&) = delete;
+	FramePacer& operator= (const FramePacer&) = delete;
+
+	// with the context current (after glewInit), false if fences are not supported and every
+	// frame is finished instead
+	bool initialize();
+
+	// with the context current, wait for and delete the fences still in flight
+	void release();
+
+	// start of the CPU-side preparation of a frame, a frame that is not rendered after all
+	// simply gets no endFrame
+	void beginFrame();
+
+	// before the first GL command of the frame: wait for the frame framesInFlight frames back
+	void waitForFrame();
+
+	// after the last GL command of the frame: fence (or finish) and update the statistics
+	void endFrame();
+
+	int getFramesInFlight() const { return m_framesInFlight; }
+	bool isPipelined() const { return m_framesInFlight > 0; }
+
+	// over the last window of frames: wall time from beginFrame to endFrame [ms], time of it
+	// blocked on the GPU [ms] and CPU time of the graphics thread per wall time [%]
+	double getFrameTime() const { return m_frameTime; }
+	double getWaitTime() const { return m_waitTime; }
+	double getCpuUsage() const { return m_cpuUsage; }
+
+	// the same since initialize
+	unsigned long getFrames() const { return m_frames; }
+	double getMeanFrameTime() const { return m_frames ? 1000.0 * m_totalWall / m_frames : 0.0; }
+	double getMeanWaitTime() const { return m_frames ? 1000.0 * m_totalWait / m_frames : 0.0; }
+	double getMeanCpuUsage() const { return m_totalWall > 0.0 ? 100.0 * m_totalCpu / m_totalWall : 0.0; }
+
+private:
+	// CPU time of the calling thread [s]
+	static double threadCpuTime();
+
+	// block until the fence signals, then delete it
+	static void waitForFence(GLsync fence);
+
+	int m_framesInFlight;
+
+	// fence of each frame in flight, indexed by frame modulo framesInFlight
+	std::vector<GLsync> m_fences;
+	unsigned long m_frames;
+
+	// current frame
+	std::chrono::steady_clock::time_point m_beginWall;
+	double m_beginCpu;
+	double m_wait;
+
+	// statistics window
+	int m_windowFrames;
+	double m_windowWall;
+	double m_windowWait;
+	double m_windowCpu;
+	double m_frameTime;
+	double m_waitTime;
+	double m_cpuUsage;
+
+	double m_totalWall;
+	double m_totalWait;
+	double m_totalCpu;
+};
@@ -0,0 +1,577 @@
+#include "HapticBenchmark.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+#include "FramePacer.h"
+#include "TriangleBVH.h"
+
+#include <GLFW/glfw3.h> // must include after chai3d
+
+namespace {
+
+    // brute force reference of the tree queries: segment ab against the box of one triangle
+    // grown by radius
+    bool segmentHitsTriangleBox(const chai3d::cVector3d& a, const chai3d::cVector3d& b, double radius,
+        const chai3d::cVector3d& p0, const chai3d::cVector3d& p1, const chai3d::cVector3d& p2) {
+        double t0 = 0.0, t1 = 1.0;
+        for (int k = 0; k < 3; k++) {
+            double lo = std::min(p0.get(k), std::min(p1.get(k), p2.get(k))) - radius;
+            double hi = std::max(p0.get(k), std::max(p1.get(k), p2.get(k))) + radius;
+            double origin = a.get(k);
+            double dir = b.get(k) - a.get(k);
+            if (fabs(dir) < 1e-12) {
+                if (origin < lo || origin > hi)
+                    return false;
+                continue;
+            }
+            double ta = (lo - origin) / dir;
+            double tb = (hi - origin) / dir;
+            t0 = std::max(t0, std::min(ta, tb));
+            t1 = std::min(t1, std::max(ta, tb));
+            if (t0 > t1)
+                return false;
+        }
+        return true;
+    }
+}
+
+HapticBenchmark::HapticBenchmark(ChaiWorld& chaiWorld, int ticks, int warmupTicks) :
+    m_chaiWorld(chaiWorld), m_ticks(ticks), m_warmupTicks(warmupTicks), m_validateKernel(false), m_tracePhases(false), m_stiffnessScale(1.0), m_constraintIterations(8), m_timeStep(0.001) {
+
+    m_device = std::make_shared<VirtualHapticDevice>();
+}
+
+bool HapticBenchmark::parseArguments(int argc, char* argv[]) {
+    bool ticksSet = false;
+    for (int k = 0; k < argc; k++) {
+        std::string arg = argv[k];
+        if (arg == "gel")
+            addEngine(ClothEngine::GEL);
+        else if (arg == "soa")
+            addEngine(ClothEngine::SoA);
+        else if (arg == "implicit")
+            addEngine(ClothEngine::Implicit);
+        else if (arg == "xpbd")
+            addEngine(ClothEngine::XPBD);
+        else if (arg == "reduced")
+            addEngine(ClothEngine::Reduced);
+        else if (arg == "scalar")
+            m_chaiWorld.getContactKernel().setMode(ContactKernelMode::Scalar);
+        else if (arg == "sse2")
+            m_chaiWorld.getContactKernel().setMode(ContactKernelMode::SSE2);
+        else if (arg == "avx2")
+            m_chaiWorld.getContactKernel().setMode(ContactKernelMode::AVX2);
+        else if (arg == "validate")
+            setValidateKernel(true);
+        else if (arg == "trace")
+            setTracePhases(true);
+        else if (arg == "nocollision")
+            m_chaiWorld.setClothCollision(false);
+        else if (arg == "surface")
+            m_chaiWorld.setSurfaceContact(true);
+        else if (arg.compare(0, 8, "threads=") == 0)
+            m_chaiWorld.setClothThreads(atoi(arg.c_str() + 8));
+        else if (arg.compare(0, 7, "refine=") == 0)
+            m_chaiWorld.setClothRefinement(std::max(1, atoi(arg.c_str() + 7)));
+        else if (arg.compare(0, 10, "stiffness=") == 0)
+            setStiffnessScale(atof(arg.c_str() + 10));
+        else if (arg.compare(0, 11, "iterations=") == 0)
+            setConstraintIterations(atoi(arg.c_str() + 11));
+        else if (arg.compare(0, 7, "replay=") == 0) {
+            if (!setReplay(arg.substr(7))) {
+                std::cout << "cannot replay " << arg.substr(7) << std::endl;
+                return false;
+            }
+        }
+        else if (!arg.empty() && isdigit((unsigned char)arg[0])) {
+            if (!ticksSet)
+                m_ticks = atoi(arg.c_str());
+            else
+                addClothSize(atoi(arg.c_str()));
+            ticksSet = true;
+        }
+        else {
+            std::cout << "unknown benchmark argument: " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool HapticBenchmark::setReplay(const std::string& path) {
+    std::shared_ptr<ReplayHapticDevice> replay = std::make_shared<ReplayHapticDevice>();
+    if (!replay->load(path))
+        return false;
+    m_replay = replay;
+    m_device = replay;
+    return true;
+}
+
+int HapticBenchmark::run(std::ostream& out) {
+    if (m_sizes.empty())
+        m_sizes = { 14, 32, 64, 128, 256 };
+    // reduced only on request, fitting the larger sizes takes minutes (once, then cached)
+    if (m_engines.empty())
+        m_engines = { ClothEngine::GEL, ClothEngine::SoA, ClothEngine::Implicit, ClothEngine::XPBD };
+
+    // drive the world with the scripted device instead of the physical one
+    m_chaiWorld.setHapticDevice(m_device);
+
+    // same table as the interactive scene, the cloths meet it through the scene registry
+    Rigid* table = new Rigid(4.0, 4.0, chai3d::cVector3d(-0.5, 0.0, -3.5), 0.8, 0.3, 0.2, 1.0);
+    table->AttachToWorld(m_chaiWorld);
+
+    ContactKernel& kernel = m_chaiWorld.getContactKernel();
+    out << "haptic tick latency, " << m_ticks << " ticks per size, dt = " << m_timeStep * 1000.0 << " ms, "
+        << "contact kernel " << ContactKernel::getModeName(kernel.getMode()) << ", "
+        << (m_chaiWorld.getThreadPool() ? m_chaiWorld.getThreadPool()->getNumThreads() : 1) << " cloth thread(s), "
+        << "stiffness x" << m_stiffnessScale << ", " << m_constraintIterations << " xpbd iterations";
+    if (m_replay)
+        out << ", replaying " << m_replay->getNumSamples() << " samples (" << m_replay->getDuration() << " s)";
+    out << std::endl;
+    out << std::setw(10) << "engine"
+        << std::setw(10) << "cloth"
+        << std::setw(12) << "mean[us]"
+        << std::setw(12) << "p50[us]"
+        << std::setw(12) << "p99[us]"
+        << std::setw(12) << "p99.9[us]"
+        << std::setw(12) << "max[us]"
+        << std::setw(10) << "budget"
+        << std::setw(10) << "stable";
+    if (m_validateKernel)
+        out << std::setw(12) << "mismatch";
+    out << std::endl;
+
+    int failures = 0;
+    for (ClothEngine engine : m_engines) {
+        for (int size : m_sizes) {
+            Result r = runSize(engine, size);
+            if (m_validateKernel && r.kernelMismatches > 0)
+                failures++;
+
+            // ticks that would not have fit into a 1 kHz loop
+            std::string budget = r.p999 < 1000.0 ? "ok" : "over";
+
+            out << std::setw(10) << getEngineName(r.engine)
+                << std::setw(10) << (std::to_string(r.size) + "x" + std::to_string(r.size))
+                << std::fixed << std::setprecision(1)
+                << std::setw(12) << r.mean
+                << std::setw(12) << r.p50
+                << std::setw(12) << r.p99
+                << std::setw(12) << r.p999
+                << std::setw(12) << r.max
+                << std::setw(10) << budget
+                << std::setw(10) << (r.stable ? "yes" : "no");
+            if (m_validateKernel)
+                out << std::setw(12) << r.kernelMismatches;
+            out << std::endl;
+
+            if (r.traced) {
+                out << std::setw(20) << "phases[us]";
+                for (int p = 0; p < NUM_PHASES; p++)
+                    out << " " << TickTrace::getPhaseName((TracePhase)p) << " " << r.phases.mean[p];
+                out << std::endl;
+            }
+        }
+    }
+
+    if (m_validateKernel) {
+        out << std::endl << "checks" << std::endl;
+        if (!checkKernelModes(out))
+            failures++;
+        if (!checkTriangleBVH(out))
+            failures++;
+        if (!checkFramePacer(out))
+            failures++;
+        if (!checkReducedCloth(out))
+            failures++;
+    }
+
+    return failures > 0 ? 1 : 0;
+}
+
+HapticBenchmark::Result HapticBenchmark::runSize(ClothEngine engine, int size) {
+    chai3d::cVector3d offset(-0.5, 0.0, -0.1);
+
+    double k = m_stiffnessScale;
+    Deformable* cloth = new Deformable(size, size, offset, 10 * k, 0.5, 0.1,
+        42.871021 * k, -0.234556 * k, 65.166023 * k, 83.175644 * k, engine);
+    cloth->setConstraintIterations(m_constraintIterations);
+    cloth->AttachToWorld(m_chaiWorld);
+
+    // start 0.2 above the cloth center and press 0.25 into it, in world units
+    double scale = m_chaiWorld.getWorkspaceScaleFactor();
+    chai3d::cVector3d start(offset.x() / scale, offset.y() / scale, (offset.z() + 0.2) / scale);
+    if (!m_replay)
+        m_device->setTrajectory(VirtualHapticDevice::pokeAndCircle(start, 0.25 / scale, 0.3 / scale, 2.0));
+    m_device->setTime(0.0);
+
+    std::vector<double> samples;
+    samples.reserve(m_ticks);
+
+    int kernelMismatches = 0;
+
+    // one summary over all measured ticks
+    TickTrace trace(m_ticks);
+
+    for (int tick = 0; tick < m_warmupTicks + m_ticks; tick++) {
+        m_device->advance(m_timeStep);
+        if (m_tracePhases && tick == m_warmupTicks)
+            m_chaiWorld.setTrace(&trace);
+
+        auto begin = std::chrono::steady_clock::now();
+        m_chaiWorld.updateHapticsMulti(m_timeStep);
+        auto end = std::chrono::steady_clock::now();
+
+        if (tick < m_warmupTicks)
+            continue;
+
+        samples.push_back(std::chrono::duration<double, std::micro>(end - begin).count());
+
+        // outside of the timed region, the kernel output buffers are scratch by now
+        if (m_validateKernel) {
+            const double* x;
+            const double* y;
+            const double* z;
+            cloth->getPackedNodePositions(x, y, z);
+            chai3d::cVector3d cursor = m_chaiWorld.getCursor()->getHapticPoint(0)->getGlobalPosProxy();
+            if (!m_chaiWorld.getContactKernel().compareWithReference(x, y, z, size * size, cursor,
+                m_chaiWorld.getMultiCursorRadius(), cloth->getModelRadius(), cloth->getStiffness()))
+                kernelMismatches++;
+        }
+    }
+
+    // a diverged cloth ends up non-finite or far away from where it hangs
+    bool stable = true;
+    const double* x;
+    const double* y;
+    const double* z;
+    cloth->getPackedNodePositions(x, y, z);
+    for (int index = 0; index < size * size; index++) {
+        chai3d::cVector3d pos(x[index], y[index], z[index]);
+        if (!std::isfinite(pos.length()) || (pos - offset).length() > 0.1 * size + 5.0)
+            stable = false;
+    }
+
+    m_chaiWorld.setTrace(nullptr);
+    cloth->DetachFromWorld(m_chaiWorld);
+    delete cloth;
+
+    Result r;
+    r.traced = trace.getSummary(r.phases);
+    r.engine = engine;
+    r.size = size;
+    r.ticks = (int)samples.size();
+    r.kernelMismatches = kernelMismatches;
+    r.stable = stable;
+    r.mean = 0.0;
+    for (double s : samples)
+        r.mean += s;
+    r.mean /= std::max(1, r.ticks);
+
+    std::sort(samples.begin(), samples.end());
+    r.p50 = percentile(samples, 0.50);
+    r.p99 = percentile(samples, 0.99);
+    r.p999 = percentile(samples, 0.999);
+    r.max = samples.empty() ? 0.0 : samples.back();
+
+    return r;
+}
+
+bool HapticBenchmark::checkKernelModes(std::ostream& out) {
+    // a jittered grid of nodes, the odd count leaves a scalar tail in every mode
+    const int count = 1001;
+    const int inputs = 100;
+    std::vector<double> x(count), y(count), z(count);
+    unsigned int random = 12345;
+    auto uniform = [&random]() {
+        random = random * 1664525u + 1013904223u;
+        return (random >> 8) * (1.0 / 16777216.0);
+    };
+    for (int k = 0; k < count; k++) {
+        x[k] = 0.05 * (k % 32) + 0.01 * uniform();
+        y[k] = 0.05 * (k / 32) + 0.01 * uniform();
+        z[k] = 0.02 * uniform();
+    }
+
+    bool passed = true;
+    ContactKernel kernel;
+    for (ContactKernelMode mode : { ContactKernelMode::SSE2, ContactKernelMode::AVX2 }) {
+        std::string name = std::string("contact kernel ") + ContactKernel::getModeName(mode) + " = scalar";
+        if (!ContactKernel::isSupported(mode)) {
+            printCheck(out, name, "skipped", "not supported by this cpu");
+            continue;
+        }
+
+        // the cursor sweeps over the grid, the first input sits exactly on a node
+        kernel.setMode(mode);
+        int mismatches = 0;
+        for (int input = 0; input < inputs; input++) {
+            chai3d::cVector3d cursor(x[0], y[0], z[0]);
+            if (input > 0)
+                cursor.set(1.6 * uniform(), 1.6 * uniform(), 0.1 * uniform() - 0.05);
+            if (!kernel.compareWithReference(x.data(), y.data(), z.data(), count, cursor, 0.1, 0.05, 100.0))
+                mismatches++;
+        }
+        printCheck(out, name, mismatches == 0 ? "ok" : "FAILED", std::to_string(mismatches) + " of " + std::to_string(inputs) + " inputs differ");
+        passed = passed && mismatches == 0;
+    }
+    return passed;
+}
+
+bool HapticBenchmark::checkTriangleBVH(std::ostream& out) {
+    // a 64 x 64 grid triangulated like Polygons, waves of growing height run over part of it
+    const int side = 64;
+    const int frames = 20;
+    const int queries = 200;
+    std::vector<int> indices;
+    for (int i = 0; i < side - 1; i++) {
+        for (int j = 0; j < side - 1; j++) {
+            int i0 = i * side + j;
+            indices.insert(indices.end(), { i0, i0 + side, i0 + side + 1 });
+            indices.insert(indices.end(), { i0, i0 + side + 1, i0 + 1 });
+        }
+    }
+    std::vector<chai3d::cVector3d> positions(side * side);
+    for (int i = 0; i < side; i++)
+        for (int j = 0; j < side; j++)
+            positions[i * side + j].set(0.05 * i, 0.05 * j, 0.0);
+
+    TriangleBVH bvh;
+    bvh.build(indices, positions);
+
+    unsigned int random = 12345;
+    auto uniform = [&random]() {
+        random = random * 1664525u + 1013904223u;
+        return (random >> 8) * (1.0 / 16777216.0);
+    };
+
+    int missed = 0;
+    long long found = 0;
+    long long candidates = 0;
+    std::vector<int> result;
+    std::vector<unsigned char> inResult(indices.size() / 3);
+    for (int frame = 0; frame < frames; frame++) {
+        for (int i = 0; i < side / 2; i++)
+            for (int j = 0; j < side; j++)
+                positions[i * side + j].z(0.01 * frame * sin(0.3 * (i + j) + 0.5 * frame));
+        bvh.refit(positions);
+
+        for (int query = 0; query < queries; query++) {
+            chai3d::cVector3d a(3.2 * uniform(), 3.2 * uniform(), 0.4 * uniform() - 0.2);
+            chai3d::cVector3d b = a + chai3d::cVector3d(0.2 * uniform() - 0.1, 0.2 * uniform() - 0.1, 0.2 * uniform() - 0.1);
+            if (query % 2)
+                b = a;
+            double radius = 0.02 * uniform();
+
+            result.clear();
+            bvh.querySegment(a, b, radius, result);
+            candidates += result.size();
+            for (int t : result)
+                inResult[t] = 1;
+            for (int t = 0; t < (int)inResult.size(); t++) {
+                if (segmentHitsTriangleBox(a, b, radius, positions[indices[3 * t]], positions[indices[3 * t + 1]], positions[indices[3 * t + 2]])) {
+                    found++;
+                    if (!inResult[t])
+                        missed++;
+                }
+            }
+            for (int t : result)
+                inResult[t] = 0;
+        }
+    }
+    bool passed = missed == 0;
+    printCheck(out, "triangle tree refit = brute force", passed ? "ok" : "FAILED", std::to_string(missed) + " of " +
+        std::to_string(found) + " boxes hit missed, " + std::to_string(candidates) + " candidates");
+    return passed;
+}
+
+bool HapticBenchmark::checkFramePacer(std::ostream& out) {
+    // an invisible window for the GL context, there may be no display to open it on
+    if (!glfwInit()) {
+        printCheck(out, "frame pacer", "skipped", "no display");
+        return true;
+    }
+    glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    GLFWwindow* window = glfwCreateWindow(256, 256, "benchmark", NULL, NULL);
+    if (!window) {
+        glfwTerminate();
+        printCheck(out, "frame pacer", "skipped", "no GL context");
+        return true;
+    }
+    glfwMakeContextCurrent(window);
+#ifdef GLEW_VERSION
+    if (glewInit() != GLEW_OK) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        printCheck(out, "frame pacer", "skipped", "no GLEW");
+        return true;
+    }
+#endif
+
+    // frames overdraw the window quads times in black and white by turns, after release the last
+    // (white) frame has to be in the framebuffer and the driver must not have reported an error
+    const int frames = 120;
+    const int quads = 50;
+    bool passed = true;
+    for (int framesInFlight : { 0, 2 }) {
+        std::string name = framesInFlight ? "frame pacer 2 frames in flight" : "frame pacer finish";
+        FramePacer pacer(framesInFlight);
+        if (!pacer.initialize() && framesInFlight > 0) {
+            printCheck(out, name, "skipped", "no GL 3.2 or ARB_sync");
+            continue;
+        }
+
+        for (int frame = 0; frame < frames; frame++) {
+            pacer.beginFrame();
+            pacer.waitForFrame();
+            float level = (float)(frame % 2);
+            glClearColor(level, level, level, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            glColor3f(level, level, level);
+            for (int quad = 0; quad < quads; quad++) {
+                glBegin(GL_QUADS);
+                glVertex2f(-1.0f, -1.0f);
+                glVertex2f(1.0f, -1.0f);
+                glVertex2f(1.0f, 1.0f);
+                glVertex2f(-1.0f, 1.0f);
+                glEnd();
+            }
+            pacer.endFrame();
+        }
+        pacer.release();
+
+        unsigned char pixel[4] = {};
+        glReadPixels(128, 128, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+        bool ok = glGetError() == GL_NO_ERROR && pacer.getFrames() == (unsigned long)frames && pixel[0] == 255;
+
+        std::ostringstream detail;
+        detail << std::fixed << std::setprecision(2) << pacer.getMeanFrameTime() << " ms per frame, "
+            << pacer.getMeanWaitTime() << " ms waiting";
+        printCheck(out, name, ok ? "ok" : "FAILED", detail.str());
+        passed = passed && ok;
+    }
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return passed;
+}
+
+bool HapticBenchmark::checkReducedCloth(std::ostream& out) {
+    // a reduced cloth fitted like in the scene (cached after the first run) and the full cloth it
+    // was fitted to are pressed at the same spots, the forces on the cursor are compared while it
+    // touches either of them
+    const int size = 40;
+    const int settleSteps = 5000;
+    const int pressSteps = 3000;
+    const double tolerance = 0.1;
+    std::string name = "reduced " + std::to_string(size) + "x" + std::to_string(size) + " force = full";
+
+    Deformable* cloth = new Deformable(size, size, chai3d::cVector3d(-0.5, 0.0, -0.1), 10, 0.5, 0.1,
+        42.871021, -0.234556, 65.166023, 83.175644, ClothEngine::Reduced);
+    cloth->AttachToWorld(m_chaiWorld);
+    ReducedCloth* reduced = cloth->getReducedCloth();
+    if (!reduced) {
+        cloth->DetachFromWorld(m_chaiWorld);
+        delete cloth;
+        printCheck(out, name, "FAILED", "no reduced model");
+        return false;
+    }
+
+    // the full cloth starts from the settled shape of the model, its node frames settle again
+    int numNodes = size * size;
+    SoACloth settled = *cloth->getSoACloth();
+    settled.setThreadPool(nullptr);
+    settled.clearExternalForces();
+    for (int step = 0; step < settleSteps; step++)
+        settled.updateDynamics(m_timeStep);
+
+    ContactKernel kernel;
+    double cursorRadius = m_chaiWorld.getMultiCursorRadius();
+    double nodeRadius = cloth->getModelRadius();
+    double stiffness = cloth->getStiffness();
+    std::vector<double> x(numNodes), y(numNodes), z(numNodes);
+    double error = 0.0;
+    double magnitude = 0.0;
+    int contacts = 0;
+
+    // in the middle, off center and near an edge, 0.2 above the cloth and 0.3 into it over the
+    // first half of the press
+    int spots[3] = { (size / 2) * size + size / 2, (size / 3) * size + size / 2, (size / 5) * size + size / 3 };
+    for (int spot : spots) {
+        SoACloth full = settled;
+        reduced->reset();
+        chai3d::cVector3d start = full.getNodePos(spot) + chai3d::cVector3d(0.0, 0.0, 0.2);
+        for (int step = 0; step < pressSteps; step++) {
+            double press = std::min(1.0, 2.0 * step / pressSteps);
+            chai3d::cVector3d cursor = start - chai3d::cVector3d(0.0, 0.0, 0.3 * press);
+
+            for (int n = 0; n < numNodes; n++) {
+                chai3d::cVector3d pos = full.getNodePos(n);
+                x[n] = pos.x();
+                y[n] = pos.y();
+                z[n] = pos.z();
+            }
+            chai3d::cVector3d fullForce = kernel.computeForces(x.data(), y.data(), z.data(), numNodes, cursor, cursorRadius, nodeRadius, stiffness);
+            for (int n = 0; n < numNodes; n++)
+                full.setExternalForce(n, chai3d::cVector3d(-kernel.getForceX()[n], -kernel.getForceY()[n], -kernel.getForceZ()[n]));
+            full.updateDynamics(m_timeStep);
+
+            reduced->reconstruct(0, numNodes, x.data(), y.data(), z.data());
+            chai3d::cVector3d reducedForce = kernel.computeForces(x.data(), y.data(), z.data(), numNodes, cursor, cursorRadius, nodeRadius, stiffness);
+            for (int n = 0; n < numNodes; n++)
+                if (kernel.getForceX()[n] != 0.0 || kernel.getForceY()[n] != 0.0 || kernel.getForceZ()[n] != 0.0)
+                    reduced->addNodeForce(n, chai3d::cVector3d(-kernel.getForceX()[n], -kernel.getForceY()[n], -kernel.getForceZ()[n]));
+            reduced->updateDynamics(m_timeStep);
+
+            if (fullForce.length() > 0.0 || reducedForce.length() > 0.0) {
+                error += (reducedForce - fullForce).length();
+                magnitude += fullForce.length();
+                contacts++;
+            }
+        }
+    }
+    int numModes = reduced->getNumModes();
+    cloth->DetachFromWorld(m_chaiWorld);
+    delete cloth;
+
+    double relative = magnitude > 0.0 ? error / magnitude : 1.0;
+    bool passed = contacts > 0 && relative < tolerance;
+    std::ostringstream detail;
+    detail << std::fixed << std::setprecision(1) << 100.0 * relative << "% mean error over " << contacts
+        << " ticks in contact, " << numModes << " modes";
+    printCheck(out, name, passed ? "ok" : "FAILED", detail.str());
+    return passed;
+}
+
+void HapticBenchmark::printCheck(std::ostream& out, const std::string& name, const char* status, const std::string& detail) {
+    out << "  " << std::left << std::setw(40) << name << std::setw(10) << status << std::right << detail << std::endl;
+}
+
+const char* HapticBenchmark::getEngineName(ClothEngine engine) {
+    switch (engine) {
+    case ClothEngine::GEL:
+        return "gel";
+    case ClothEngine::SoA:
+        return "soa";
+    case ClothEngine::Implicit:
+        return "implicit";
+    case ClothEngine::XPBD:
+        return "xpbd";
+    case ClothEngine::Reduced:
+        return "reduced";
+    }
+    return "?";
+}
+
+double HapticBenchmark::percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty())
+        return 0.0;
+    size_t rank = (size_t)std::ceil(p * sorted.size());
+    return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "ChaiWorld.h"
+#include "ReplayHapticDevice.h"
+#include "VirtualHapticDevice.h"
+
+// headless benchmark of ChaiWorld::updateHapticsMulti driven by a VirtualHapticDevice,
+// reports per-tick latency percentiles for a range of cloth sizes
+
+class HapticBenchmark
+{
+public:
+	HapticBenchmark(ChaiWorld& chaiWorld, int ticks = 5000, int warmupTicks = 500);
+	~HapticBenchmark() = default;
+
+	// cloth sizes (nodes per side) to measure, defaults to 14..256 if none added
+	void addClothSize(int size) { m_sizes.push_back(size); }
+
+	// cloth engines to measure, defaults to all if none added
+	void addEngine(ClothEngine engine) { m_engines.push_back(engine); }
+
+	// compare the contact kernel against its scalar reference on every measured tick, and run
+	// the accuracy checks after the tables. run then fails on any mismatch or failed check
+	void setValidateKernel(bool validate) { m_validateKernel = validate; }
+
+	// scale all cloth stiffnesses (links and elastic model), to compare engines on stiff fabrics
+	void setStiffnessScale(double scale) { m_stiffnessScale = scale; }
+
+	// XPBD constraint iterations per step
+	void setConstraintIterations(int iterations) { m_constraintIterations = iterations; }
+
+	// time the phases of the measured ticks (TickTrace) and print their means below each size
+	void setTracePhases(bool trace) { m_tracePhases = trace; }
+
+	// drive the cloth with a DeviceRecorder file instead of the scripted poke, one m_timeStep of the
+	// recording per tick without waiting. returns false if the file cannot be replayed
+	bool setReplay(const std::string& path);
+
+	// [ticks] [sizes...] [gel|soa|implicit|xpbd|reduced...] [scalar|sse2|avx2] [threads=N] [stiffness=X]
+	// [iterations=N] [replay=file] [trace] [validate] [nocollision] [refine=N] [surface], returns false
+	// on an unknown argument
+	bool parseArguments(int argc, char* argv[]);
+
+	// run all sizes and print a table (and the checks), returns a process exit code
+	int run(std::ostream& out);
+
+private:
+	struct Result
+	{
+		ClothEngine engine;
+		int size;
+		int ticks;
+		double mean;	// [us]
+		double p50;
+		double p99;
+		double p999;
+		double max;
+		int kernelMismatches;
+		bool stable;	// all nodes finite and near the table at the end
+		bool traced;
+		TickSummary phases;	// over the measured ticks if traced
+	};
+
+	Result runSize(ClothEngine engine, int size);
+
+	// accuracy checks, each prints a line with ok, FAILED or skipped and returns false if it failed
+
+	// every vectorized kernel mode bitwise equal to the scalar reference
+	bool checkKernelModes(std::ostream& out);
+
+	// every triangle whose box meets a query found by TriangleBVH after refits of a deforming grid
+	bool checkTriangleBVH(std::ostream& out);
+
+	// FramePacer finishing and with fences in a hidden window renders every frame without GL errors,
+	// skipped without a display or GL context
+	bool checkFramePacer(std::ostream& out);
+
+	// forces on a cursor pressing a ReducedCloth within 10% of the full cloth it was fitted to
+	bool checkReducedCloth(std::ostream& out);
+
+	static void printCheck(std::ostream& out, const std::string& name, const char* status, const std::string& detail);
+
+	static const char* getEngineName(ClothEngine engine);
+
+	// nearest-rank percentile of sorted samples
+	static double percentile(const std::vector<double>& sorted, double p);
+
+	ChaiWorld& m_chaiWorld;
+
+	std::shared_ptr<VirtualHapticDevice> m_device;
+
+	// set if m_device replays a recording
+	std::shared_ptr<ReplayHapticDevice> m_replay;
+
+	std::vector<int> m_sizes;
+	std::vector<ClothEngine> m_engines;
+
+	int m_ticks;
+	int m_warmupTicks;
+
+	bool m_validateKernel;
+	bool m_tracePhases;
+
+	double m_stiffnessScale;
+	int m_constraintIterations;
+
+	// fixed simulation step passed to the haptic loop [s]
+	double m_timeStep;
+};
@@ -0,0 +1,141 @@
+#include "HapticScheduler.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <thread>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#endif
+
+namespace {
+
+    // ticks per jitter statistics update
+    const int kJitterWindow = 1000;
+}
+
+HapticScheduler::HapticScheduler(double period, double spinTail) :
+    m_period(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(period))),
+    m_spinTail(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(spinTail))),
+    m_ticks(0), m_missed(0), m_windowTicks(0), m_jitterSum(0.0), m_jitterPeak(0.0),
+    m_jitterMean(0.0), m_jitterMax(0.0), m_timer(nullptr) {
+
+#if defined(_WIN32)
+    // Sleep() has the granularity of the system timer (up to 15.6 ms), the high resolution timer
+    // (Windows 10 1803 and later) wakes within about 0.5 ms
+    m_timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+
+    // spin past the wake-up error of the timer, or the whole period without one. a scheduler
+    // without spin tail only ever sleeps and takes that error
+    std::chrono::steady_clock::duration wakeError = m_timer ? std::chrono::microseconds(600) : m_period;
+    if (m_spinTail.count() > 0)
+        m_spinTail = std::max(m_spinTail, wakeError);
+#endif
+}
+
+HapticScheduler::~HapticScheduler() {
+#if defined(_WIN32)
+    if (m_timer)
+        CloseHandle((HANDLE)m_timer);
+#endif
+}
+
+bool HapticScheduler::setRealTimePriority(int priority) {
+#if defined(_WIN32)
+    return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+#elif defined(__linux__)
+    sched_param param;
+    param.sched_priority = std::max(sched_get_priority_min(SCHED_FIFO), std::min(priority, sched_get_priority_max(SCHED_FIFO)));
+    return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+#else
+    return false;
+#endif
+}
+
+void HapticScheduler::start() {
+    m_lastWake = std::chrono::steady_clock::now();
+    m_deadline = m_lastWake + m_period;
+
+    m_ticks = 0;
+    m_missed = 0;
+    m_windowTicks = 0;
+    m_jitterSum = 0.0;
+    m_jitterPeak = 0.0;
+}
+
+void HapticScheduler::sleepUntil(std::chrono::steady_clock::time_point time) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (time <= now)
+        return;
+
+#if defined(_WIN32)
+    if (m_timer) {
+        // relative due time in 100 ns units
+        LARGE_INTEGER due;
+        due.QuadPart = -(LONGLONG)(std::chrono::duration_cast<std::chrono::nanoseconds>(time - now).count() / 100);
+        if (SetWaitableTimer((HANDLE)m_timer, &due, 0, NULL, NULL, FALSE)) {
+            WaitForSingleObject((HANDLE)m_timer, INFINITE);
+            return;
+        }
+    }
+    std::this_thread::sleep_until(time);
+#elif defined(__linux__)
+    // steady_clock is CLOCK_MONOTONIC, an absolute deadline does not drift with the sleep call
+    long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    timespec deadline;
+    deadline.tv_sec = (time_t)(ns / 1000000000LL);
+    deadline.tv_nsec = (long)(ns % 1000000000LL);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {}
+#else
+    std::this_thread::sleep_until(time);
+#endif
+}
+
+double HapticScheduler::wait() {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    double jitter;
+    if (now > m_deadline) {
+        // the tick overran its deadline, run the next one right away
+        m_missed.fetch_add(1, std::memory_order_relaxed);
+        jitter = std::chrono::duration<double, std::micro>(now - m_deadline).count();
+
+        // more than a period behind, drop the lost ticks instead of catching up in a burst
+        if (now - m_deadline > m_period)
+            m_deadline = now;
+    }
+    else {
+        // sleep most of the way, spin the tail
+        sleepUntil(m_deadline - m_spinTail);
+        while ((now = std::chrono::steady_clock::now()) < m_deadline) {}
+        jitter = std::chrono::duration<double, std::micro>(now - m_deadline).count();
+    }
+
+    double elapsed = std::chrono::duration<double>(now - m_lastWake).count();
+    m_lastWake = now;
+    m_deadline += m_period;
+    m_ticks.fetch_add(1, std::memory_order_relaxed);
+
+    m_jitterSum += jitter;
+    m_jitterPeak = std::max(m_jitterPeak, jitter);
+    if (++m_windowTicks == kJitterWindow) {
+        m_jitterMean.store(m_jitterSum / m_windowTicks, std::memory_order_relaxed);
+        m_jitterMax.store(m_jitterPeak, std::memory_order_relaxed);
+        m_windowTicks = 0;
+        m_jitterSum = 0.0;
+        m_jitterPeak = 0.0;
+    }
+
+    return elapsed;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+// fixed period scheduler of the haptic thread. wait() sleeps until an absolute deadline minus a
+// spin tail and spins the rest, so the wake-up error is the spin resolution and not the sleep
+// granularity of the OS, and deadlines never drift. late ticks are counted as missed instead of
+// being hidden, a tick later than a whole period starts a new schedule instead of bursting
+
+class HapticScheduler
+{
+public:
+	// period and spin tail [s], a spin tail of 0 never spins (threads that must not hold a core,
+	// e.g. the cloth thread of the multi-rate mode)
+	HapticScheduler(double period = 0.001, double spinTail = 0.0002);
+	~HapticScheduler();
+
+	// not copyable
+	HapticScheduler(const HapticScheduler&) = delete;
+	HapticScheduler& operator= (const HapticScheduler&) = delete;
+
+	double getPeriod() const { return std::chrono::duration<double>(m_period).count(); }
+
+	// calling thread: SCHED_FIFO at priority on Linux (needs CAP_SYS_NICE), time critical priority
+	// on Windows. returns false if not permitted or not supported
+	static bool setRealTimePriority(int priority = 80);
+
+	// calling thread: first deadline one period from now
+	void start();
+
+	// calling thread: block until the next deadline, returns the time since the previous wake-up [s]
+	double wait();
+
+	// any thread: statistics since start
+	unsigned long getTicks() { return m_ticks.load(std::memory_order_relaxed); }
+	unsigned long getMissedDeadlines() { return m_missed.load(std::memory_order_relaxed); }
+
+	// any thread: wake-up error [us] over the last window of ticks
+	double getJitterMean() { return m_jitterMean.load(std::memory_order_relaxed); }
+	double getJitterMax() { return m_jitterMax.load(std::memory_order_relaxed); }
+
+private:
+	// sleep until about time, may return early but never late by more than the OS granularity
+	void sleepUntil(std::chrono::steady_clock::time_point time);
+
+	std::chrono::steady_clock::duration m_period;
+	std::chrono::steady_clock::duration m_spinTail;
+
+	std::chrono::steady_clock::time_point m_deadline;
+	std::chrono::steady_clock::time_point m_lastWake;
+
+	std::atomic<unsigned long> m_ticks;
+	std::atomic<unsigned long> m_missed;
+
+	// jitter window
+	int m_windowTicks;
+	double m_jitterSum;
+	double m_jitterPeak;
+	std::atomic<double> m_jitterMean;
+	std::atomic<double> m_jitterMax;
+
+	// high resolution waitable timer on Windows, nullptr elsewhere
+	void* m_timer;
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// read-only memory mapping of a whole file, the pages are loaded by the OS on first access
+// instead of being read up front
+
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	// not copyable
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator= (const MappedFile&) = delete;
+
+	// returns false if the file does not exist, is empty or cannot be mapped
+	bool open(const std::string& path);
+	void close();
+
+	bool isOpen() const { return m_data != nullptr; }
+	const char* getData() const { return m_data; }
+	size_t getSize() const { return m_size; }
+
+private:
+	const char* m_data;
+	size_t m_size;
+
+	// platform handles, the file and (on Windows) its mapping object
+	void* m_file;
+	void* m_mapping;
+};
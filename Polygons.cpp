@@ -1,10 +1,12 @@
 #include "Polygons.h"
 
-#include "ChaiWorld.h"
+#include "ChaiWorld.h"
+
+#include <algorithm>
 
 Polygons::Polygons(int width, int length, chai3d::cVector3d offset,
 	double stiffness, double staticFriction, double dynamicFriction, double textureLevel) :
-	m_width(width), m_length(length), m_offset(offset),
+	m_width(width), m_length(length), m_offset(offset), m_source(nullptr), m_sourceVersion(0), m_collisionObject(nullptr), m_collision(nullptr),
 	m_stiffness(stiffness), m_staticFriction(staticFriction), m_dynamicFriction(dynamicFriction), m_textureLevel(textureLevel) {
 
 	// create a mesh
@@ -25,6 +27,11 @@ Polygons::Polygons(int width, int length, chai3d::cVector3d offset,
         }
     }
 
+    for (int k = 0; k < 3; k++) {
+        m_publishedPositions.getBuffer(k) = m_positions;
+        m_collisionPositions.getBuffer(k) = m_positions;
+    }
+
     // fill in indices
     int* id = &m_indices[0];
     for (int i = 0; i < width-1; i++) {
@@ -48,7 +55,7 @@ Polygons::Polygons(int width, int length, chai3d::cVector3d offset,
 Polygons::~Polygons() {
 }
 
-void Polygons::AttachToWorld(ChaiWorld& chaiWorld) {
+void Polygons::AttachToWorld(ChaiWorld& chaiWorld, Deformable* source) {
     chaiWorld.getWorld()->addChild(m_object);
 
     // set the position of the object at the center of the world
@@ -57,45 +64,53 @@ void Polygons::AttachToWorld(ChaiWorld& chaiWorld) {
     // Since we want to see our polygons from both sides, we disable culling.
     m_object->setUseCulling(false);
 
-    for (int i = 0; i < m_indices.size(); i += 3) {
-        // define triangle points
-        chai3d::cVector3d p0 = chai3d::cVector3d(m_positions[m_indices[i + 0]].x(),
-            m_positions[m_indices[i + 0]].y(),
-            m_positions[m_indices[i + 0]].z());
-        chai3d::cVector3d p1 = chai3d::cVector3d(m_positions[m_indices[i + 1]].x(),
-            m_positions[m_indices[i + 1]].y(),
-            m_positions[m_indices[i + 1]].z());
-        chai3d::cVector3d p2 = chai3d::cVector3d(m_positions[m_indices[i + 2]].x(),
-            m_positions[m_indices[i + 2]].y(),
-            m_positions[m_indices[i + 2]].z());
-
-        // create three new vertices
-        int vertex0 = m_object->newVertex();
-        int vertex1 = m_object->newVertex();
-        int vertex2 = m_object->newVertex();
-
-        // set position of each vertex
-        m_object->m_vertices->setLocalPos(vertex0, p0);
-        m_object->m_vertices->setLocalPos(vertex1, p1);
-        m_object->m_vertices->setLocalPos(vertex2, p2);
+    // one vertex per grid point, shared by the triangles around it
+    for (int v = 0; v < (int)m_positions.size(); v++) {
+        const chai3d::cVector3d& p = m_positions[v];
+        int vertex = m_object->newVertex();
+        m_object->m_vertices->setLocalPos(vertex, p);
 
         // assign color to each vertex
-        m_object->m_vertices->setColor(vertex0, chai3d::cColorf((p0.x() + 1.0) * 0.5,
-            (p0.y() + 1.0) * 0.5,
-            0.5));
-        m_object->m_vertices->setColor(vertex1, chai3d::cColorf((p1.x() + 1.0) * 0.5,
-            (p1.y() + 1.0) * 0.5,
-            0.5));
-        m_object->m_vertices->setColor(vertex2, chai3d::cColorf((p2.x() + 1.0) * 0.5,
-            (p2.y() + 1.0) * 0.5,
-            0.5));
-
-        // create new triangle from vertices
-        m_object->newTriangle(vertex0, vertex1, vertex2);
+        m_object->m_vertices->setColor(vertex, chai3d::cColorf((p.x() + 1.0) * 0.5, (p.y() + 1.0) * 0.5, 0.5));
     }
+    for (int i = 0; i < (int)m_indices.size(); i += 3)
+        m_object->newTriangle(m_indices[i], m_indices[i + 1], m_indices[i + 2]);
+
+    // the haptic thread touches a hidden copy with the same triangles, written only by refitCollision.
+    // the displayed mesh belongs to the graphics thread and is not touched by the cursor
+    m_collisionObject = new chai3d::cMesh();
+    chaiWorld.getWorld()->addChild(m_collisionObject);
+    m_collisionObject->setLocalPos(0.0, 0.0, 0.0);
+    for (int v = 0; v < (int)m_positions.size(); v++)
+        m_collisionObject->m_vertices->setLocalPos(m_collisionObject->newVertex(), m_positions[v]);
+    for (int i = 0; i < (int)m_indices.size(); i += 3)
+        m_collisionObject->newTriangle(m_indices[i], m_indices[i + 1], m_indices[i + 2]);
+    m_collisionObject->setShowEnabled(false);
+    m_object->setHapticEnabled(false);
+
+    // triangles around each vertex
+    int numVertices = (int)m_positions.size();
+    int numTriangles = (int)m_indices.size() / 3;
+    m_vertexTriangleStart.assign(numVertices + 1, 0);
+    for (int index : m_indices)
+        m_vertexTriangleStart[index + 1]++;
+    for (int v = 0; v < numVertices; v++)
+        m_vertexTriangleStart[v + 1] += m_vertexTriangleStart[v];
+    m_vertexTriangles.resize(m_indices.size());
+    std::vector<int> fill(m_vertexTriangleStart.begin(), m_vertexTriangleStart.end() - 1);
+    for (int i = 0; i < (int)m_indices.size(); i++)
+        m_vertexTriangles[fill[m_indices[i]]++] = i / 3;
+
+    m_meshPositions = m_positions;
+    m_faceNormals.resize(numTriangles);
+    m_triangleDirty.assign(numTriangles, 0);
+    m_vertexDirty.assign(numVertices, 0);
 
     // compute surface normals
-    m_object->computeAllNormals();
+    m_dirtyTriangles.clear();
+    for (int t = 0; t < numTriangles; t++)
+        m_dirtyTriangles.push_back(t);
+    updateNormals();
 
     // we indicate that we ware rendering triangles by using specific colors for each of them (see above)
     m_object->setUseVertexColors(true);
@@ -109,26 +124,103 @@ void Polygons::AttachToWorld(ChaiWorld& chaiWorld) {
     m_object->computeBoundaryBox(true);
 
     //polygons.m_object->createAABBCollisionDetector(m_toolRadius);
-    m_object->createAABBCollisionDetector(chaiWorld.getMultiCursorRadius());
+    // refittable tree instead of createAABBCollisionDetector, topology never changes
+    m_collision = new BVHCollisionDetector(m_collisionObject->m_triangles, chaiWorld.getMultiCursorRadius());
+    m_collision->getBVH().build(m_indices, m_positions);
+    m_collisionObject->setCollisionDetector(m_collision);
 
     // set haptic properties
-    m_object->m_material->setStiffness(m_stiffness * chaiWorld.getMaxStiffness());
-    m_object->m_material->setStaticFriction(m_staticFriction);
-    m_object->m_material->setDynamicFriction(m_dynamicFriction);
-    m_object->m_material->setTextureLevel(m_textureLevel);
-    m_object->m_material->setHapticTriangleSides(true, true);
+    m_collisionObject->m_material->setStiffness(m_stiffness * chaiWorld.getMaxStiffness());
+    m_collisionObject->m_material->setStaticFriction(m_staticFriction);
+    m_collisionObject->m_material->setDynamicFriction(m_dynamicFriction);
+    m_collisionObject->m_material->setTextureLevel(m_textureLevel);
+    m_collisionObject->m_material->setHapticTriangleSides(true, true);
+
+    m_source = source;
+    chaiWorld.addPolygons(this);
+}
+
+void Polygons::publishPositions() {
+    std::vector<chai3d::cVector3d>& positions = m_publishedPositions.getWriteBuffer();
+    std::copy(m_positions.begin(), m_positions.end(), positions.begin());
+    m_publishedPositions.publish();
+
+    std::vector<chai3d::cVector3d>& collisionPositions = m_collisionPositions.getWriteBuffer();
+    std::copy(m_positions.begin(), m_positions.end(), collisionPositions.begin());
+    m_collisionPositions.publish();
+}
+
+bool Polygons::updatePolygons() {
+    if (!m_publishedPositions.update())
+        return false;
+
+    // write moved vertices once, their triangles need new normals
+    const std::vector<chai3d::cVector3d>& positions = m_publishedPositions.getReadBuffer();
+    m_dirtyTriangles.clear();
+    for (int v = 0; v < (int)positions.size(); v++) {
+        if (positions[v].equals(m_meshPositions[v], 0.0))
+            continue;
+        m_meshPositions[v] = positions[v];
+        m_object->m_vertices->setLocalPos(v, positions[v]);
+
+        for (int k = m_vertexTriangleStart[v]; k < m_vertexTriangleStart[v + 1]; k++) {
+            int t = m_vertexTriangles[k];
+            if (!m_triangleDirty[t]) {
+                m_triangleDirty[t] = 1;
+                m_dirtyTriangles.push_back(t);
+            }
+        }
+    }
+    if (m_dirtyTriangles.empty())
+        return false;
+
+    updateNormals();
+    return true;
+}
+
+void Polygons::updateNormals() {
+    // face normals of the stale triangles, the cross product weights them by area
+    m_dirtyVertices.clear();
+    for (int t : m_dirtyTriangles) {
+        const chai3d::cVector3d& p0 = m_meshPositions[m_indices[3 * t]];
+        const chai3d::cVector3d& p1 = m_meshPositions[m_indices[3 * t + 1]];
+        const chai3d::cVector3d& p2 = m_meshPositions[m_indices[3 * t + 2]];
+        m_faceNormals[t] = (p1 - p0).cross(p2 - p0);
+        m_triangleDirty[t] = 0;
+
+        for (int k = 0; k < 3; k++) {
+            int v = m_indices[3 * t + k];
+            if (!m_vertexDirty[v]) {
+                m_vertexDirty[v] = 1;
+                m_dirtyVertices.push_back(v);
+            }
+        }
+    }
+    m_dirtyTriangles.clear();
+
+    // smooth normal of every vertex touching one of them
+    for (int v : m_dirtyVertices) {
+        chai3d::cVector3d normal(0.0, 0.0, 0.0);
+        for (int k = m_vertexTriangleStart[v]; k < m_vertexTriangleStart[v + 1]; k++)
+            normal.add(m_faceNormals[m_vertexTriangles[k]]);
+        double length = normal.length();
+        if (length > 0.0)
+            m_object->m_vertices->setNormal(v, normal / length);
+        m_vertexDirty[v] = 0;
+    }
 }
 
-void Polygons::updatePolygons() {
-    for (int i = 0; i < m_object->getNumVertices(); i += 3) {
-        chai3d::cVector3d p0 = chai3d::cVector3d(m_positions[m_indices[i + 0]].x(), m_positions[m_indices[i + 0]].y(), m_positions[m_indices[i + 0]].z());
-        chai3d::cVector3d p1 = chai3d::cVector3d(m_positions[m_indices[i + 1]].x(), m_positions[m_indices[i + 1]].y(), m_positions[m_indices[i + 1]].z());
-        chai3d::cVector3d p2 = chai3d::cVector3d(m_positions[m_indices[i + 2]].x(), m_positions[m_indices[i + 2]].y(), m_positions[m_indices[i + 2]].z());
+void Polygons::refitCollision() {
+    if (!m_collision || !m_collisionPositions.update())
+        return;
 
-        m_object->m_vertices->setLocalPos(i, p0);
-        m_object->m_vertices->setLocalPos(i + 1, p1);
-        m_object->m_vertices->setLocalPos(i + 2, p2);
+    // the exact test reads the collision mesh, it has to hold the snapshot the tree is fitted to
+    const std::vector<chai3d::cVector3d>& positions = m_collisionPositions.getReadBuffer();
+    for (int v = 0; v < (int)positions.size(); v++) {
+        if (!positions[v].equals(m_collisionObject->m_vertices->getLocalPos(v), 0.0))
+            m_collisionObject->m_vertices->setLocalPos(v, positions[v]);
     }
+    m_collision->getBVH().refit(positions);
 }
 
 void Polygons::changeWireMode() {
@@ -4,6 +4,11 @@
 #include "Global.h"
 #include "chai3d.h"
 
+#include "BVHCollisionDetector.h"
+#include "TripleBuffer.h"
+
+class Deformable;
+
 class Polygons
 {
 	friend class ChaiWorld;
@@ -13,12 +18,27 @@ public:
 		double stiffness, double staticFriction, double dynamicFriction, double textureLevel);
 	~Polygons();
 
-	// setup object properties in world
-	void AttachToWorld(ChaiWorld& chaiWorld);
-	void updatePolygons();
+	// setup object properties in world, the vertices follow the nodes of source if given
+	void AttachToWorld(ChaiWorld& chaiWorld, Deformable* source = nullptr);
+	// graphics thread: update the mesh from the latest published positions, only moved vertices
+	// and the normals around them are rewritten. returns false if no vertex moved
+	bool updatePolygons();
+
+	// cloth thread: publish m_positions to the graphics thread and the collision tree, never blocks
+	void publishPositions();
+
 	void changeWireMode();
 
+	// haptic thread: move the collision mesh and refit its tree to the latest published positions,
+	// only moved vertices and subtrees with moved vertices are touched
+	void refitCollision();
+
 private:
+	// graphics thread: smooth normals of the vertices around the triangles in m_dirtyTriangles
+	void updateNormals();
+
+	// displayed mesh, one vertex per grid point, triangle t uses m_indices[3 t .. 3 t + 2].
+	// only written on the graphics thread
 	chai3d::cMesh* m_object;
 
 	chai3d::cVector3d m_offset;
@@ -28,7 +48,36 @@ private:
 	double m_length;
 
 	std::vector<int> m_indices;
+
+	// triangles around each vertex (compressed rows)
+	std::vector<int> m_vertexTriangleStart;
+	std::vector<int> m_vertexTriangles;
+
+	// graphics thread: positions in the mesh, area weighted face normals and the triangles
+	// and vertices whose normals are stale
+	std::vector<chai3d::cVector3d> m_meshPositions;
+	std::vector<chai3d::cVector3d> m_faceNormals;
+	std::vector<int> m_dirtyTriangles;
+	std::vector<int> m_dirtyVertices;
+	std::vector<unsigned char> m_triangleDirty;
+	std::vector<unsigned char> m_vertexDirty;
+
+	// deformable whose nodes are copied into m_positions whenever its version changes, may be nullptr
+	Deformable* m_source;
+	unsigned long m_sourceVersion;
+
+	// written by the thread stepping the cloth only
 	std::vector<chai3d::cVector3d> m_positions;
+
+	// m_positions as seen by the graphics thread and by the collision tree
+	TripleBuffer<std::vector<chai3d::cVector3d>> m_publishedPositions;
+	TripleBuffer<std::vector<chai3d::cVector3d>> m_collisionPositions;
+
+	// hidden copy of m_object touched by the cursor, only written on the haptic thread
+	chai3d::cMesh* m_collisionObject;
+
+	// collision tree of m_collisionObject over m_indices, built once in AttachToWorld
+	BVHCollisionDetector* m_collision;
 	//std::vector<chai3d::cVector3d> m_velocity;
 	//std::vector<chai3d::cVector3d> m_acceleration;
 
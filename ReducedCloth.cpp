@@ -0,0 +1,506 @@
+#include "ReducedCloth.h"
+
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+
+namespace {
+
+    // [s] step of the full cloth while the modes are fitted, the haptic step
+    const double kBuildStep = 0.001;
+
+    // settling: stepped until no node is faster than kSettleSpeed [m/s], checked every
+    // kSettleCheck steps
+    const int kSettleCheck = 100;
+    const int kMaxSettleSteps = 20000;
+    const double kSettleSpeed = 0.001;
+
+    // scripted loads: kPushes pushes of up to kPushForce [N] on a gaussian footprint of
+    // kPushRadius [m] around a random node, ramped in, held and released. mostly down onto the
+    // cloth like the cursor, sometimes from below
+    const int kPushes = 24;
+    const double kPushForce = 2.0;
+    const double kPushRadius = 0.15;
+    const int kRampSteps = 40;
+    const int kHoldSteps = 80;
+    const int kFreeSteps = 120;
+    const int kSnapshotInterval = 24;
+
+    // POD modes carrying less than this share of the largest one are noise
+    const double kMinModeEnergy = 1e-10;
+
+    // linearization: each mode is probed with an amplitude that moves its largest node by
+    // kProbeDistance [m], then the node frames turn for kRelaxSteps. large cloths keep a small
+    // limit cycle of the frames instead of converging, both sides of a central difference see
+    // the same one
+    const double kProbeDistance = 0.001;
+    const int kRelaxSteps = 50;
+
+    const char kCacheMagic[8] = { 'C', 'L', 'O', 'T', 'H', 'R', 'O', 'M' };
+
+    // bump when the cache layout or the fitting changes
+    const unsigned int kCacheVersion = 2;
+
+    // nodes per block of reconstruct, their basis rows fit into L1
+    const int kReconstructBlock = 32;
+
+    struct CacheHeader
+    {
+        char magic[8];
+        unsigned int version;
+        int numNodes;
+        unsigned long long key;
+        int numModes;
+        int padding;
+        double mass;
+        double kDampingPos;
+    };
+
+    // FNV-1a
+    unsigned long long hashBytes(const void* data, size_t size, unsigned long long hash = 14695981039346656037ull) {
+        const unsigned char* bytes = (const unsigned char*)data;
+        for (size_t k = 0; k < size; k++) {
+            hash ^= bytes[k];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // eigenvalues in descending order and eigenvectors (columns of vectors) of the symmetric
+    // n x n row major matrix a, by cyclic jacobi rotations. a is destroyed
+    void symmetricEigen(std::vector<double>& a, int n, std::vector<double>& values, std::vector<double>& vectors) {
+        std::vector<double> v(n * n, 0.0);
+        for (int i = 0; i < n; i++)
+            v[i * n + i] = 1.0;
+
+        for (int sweep = 0; sweep < 50; sweep++) {
+            double off = 0.0;
+            double diagonal = 0.0;
+            for (int p = 0; p < n; p++) {
+                diagonal += a[p * n + p] * a[p * n + p];
+                for (int q = p + 1; q < n; q++)
+                    off += a[p * n + q] * a[p * n + q];
+            }
+            if (off <= 1e-24 * diagonal)
+                break;
+
+            for (int p = 0; p < n - 1; p++) {
+                for (int q = p + 1; q < n; q++) {
+                    double apq = a[p * n + q];
+                    if (apq == 0.0)
+                        continue;
+
+                    // rotation in the (p, q) plane that zeroes a[p][q]
+                    double theta = (a[q * n + q] - a[p * n + p]) / (2.0 * apq);
+                    double t = (theta >= 0.0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+                    double c = 1.0 / sqrt(t * t + 1.0);
+                    double s = t * c;
+                    for (int k = 0; k < n; k++) {
+                        double akp = a[k * n + p];
+                        double akq = a[k * n + q];
+                        a[k * n + p] = c * akp - s * akq;
+                        a[k * n + q] = s * akp + c * akq;
+                    }
+                    for (int k = 0; k < n; k++) {
+                        double apk = a[p * n + k];
+                        double aqk = a[q * n + k];
+                        a[p * n + k] = c * apk - s * aqk;
+                        a[q * n + k] = s * apk + c * aqk;
+                    }
+                    for (int k = 0; k < n; k++) {
+                        double vkp = v[k * n + p];
+                        double vkq = v[k * n + q];
+                        v[k * n + p] = c * vkp - s * vkq;
+                        v[k * n + q] = s * vkp + c * vkq;
+                    }
+                }
+            }
+        }
+
+        std::vector<int> order(n);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&a, n](int i, int j) { return a[i * n + i] > a[j * n + j]; });
+        values.resize(n);
+        vectors.resize(n * n);
+        for (int k = 0; k < n; k++) {
+            values[k] = a[order[k] * n + order[k]];
+            for (int i = 0; i < n; i++)
+                vectors[i * n + k] = v[i * n + order[k]];
+        }
+    }
+}
+
+ReducedCloth::ReducedCloth() :
+    m_numNodes(0), m_numModes(0), m_mass(0.002), m_kDampingPos(5.0) {
+}
+
+bool ReducedCloth::build(const SoACloth& full, int numModes) {
+    int numNodes = full.getNumNodes();
+    int size = 3 * numNodes;
+    m_numNodes = 0;
+    m_numModes = 0;
+
+    std::vector<int> free;
+    for (int n = 0; n < numNodes; n++)
+        if (!full.m_fixed[n])
+            free.push_back(n);
+    if (free.empty() || numModes < 1)
+        return false;
+
+    SoACloth cloth = full;
+    cloth.setIntegrator(SoAIntegrator::Explicit);
+    cloth.clearExternalForces();
+
+    // settle under gravity, the modes are displacements from there
+    for (int step = 0; step < kMaxSettleSteps; step += kSettleCheck) {
+        for (int k = 0; k < kSettleCheck; k++)
+            cloth.updateDynamics(kBuildStep);
+        double speed2 = 0.0;
+        for (int n = 0; n < numNodes; n++)
+            speed2 = std::max(speed2, cloth.m_velX[n] * cloth.m_velX[n] + cloth.m_velY[n] * cloth.m_velY[n] + cloth.m_velZ[n] * cloth.m_velZ[n]);
+        if (speed2 < kSettleSpeed * kSettleSpeed)
+            break;
+    }
+    SoACloth settled = cloth;
+
+    // the recorded simulation, float snapshots keep a 100 x 100 cloth at about 20 MB
+    std::vector<float> snapshots;
+    std::vector<int> footprint;
+    std::vector<double> weights;
+    unsigned int random = 12345;
+    auto uniform = [&random]() {
+        random = random * 1664525u + 1013904223u;
+        return (random >> 8) * (1.0 / 16777216.0);
+    };
+
+    int step = 0;
+    double sigma = 0.5 * kPushRadius;
+    for (int push = 0; push < kPushes; push++) {
+        int center = free[std::min((int)free.size() - 1, (int)(uniform() * free.size()))];
+        chai3d::cVector3d direction(0.3 * (2.0 * uniform() - 1.0), 0.3 * (2.0 * uniform() - 1.0), uniform() < 0.75 ? -1.0 : 1.0);
+        direction.normalize();
+        direction.mul(kPushForce * (0.25 + 0.75 * uniform()));
+
+        footprint.clear();
+        weights.clear();
+        double sum = 0.0;
+        for (int n : free) {
+            double dx = settled.m_posX[n] - settled.m_posX[center];
+            double dy = settled.m_posY[n] - settled.m_posY[center];
+            double dz = settled.m_posZ[n] - settled.m_posZ[center];
+            double distance2 = dx * dx + dy * dy + dz * dz;
+            if (distance2 >= kPushRadius * kPushRadius)
+                continue;
+            footprint.push_back(n);
+            weights.push_back(exp(-distance2 / (2.0 * sigma * sigma)));
+            sum += weights.back();
+        }
+
+        for (int s = 0; s < kRampSteps + kHoldSteps + kFreeSteps; s++) {
+            double ramp = (s < kRampSteps) ? (double)s / kRampSteps : (s < kRampSteps + kHoldSteps ? 1.0 : 0.0);
+            for (size_t k = 0; k < footprint.size(); k++)
+                cloth.setExternalForce(footprint[k], (ramp * weights[k] / sum) * direction);
+            cloth.updateDynamics(kBuildStep);
+
+            if (++step % kSnapshotInterval != 0)
+                continue;
+            for (int n = 0; n < numNodes; n++) {
+                snapshots.push_back((float)(cloth.m_posX[n] - settled.m_posX[n]));
+                snapshots.push_back((float)(cloth.m_posY[n] - settled.m_posY[n]));
+                snapshots.push_back((float)(cloth.m_posZ[n] - settled.m_posZ[n]));
+            }
+        }
+    }
+
+    // POD by the method of snapshots: eigenvectors of the snapshot correlations combine the
+    // snapshots into orthonormal modes, the eigenvalues are their energies
+    int numSnapshots = (int)(snapshots.size() / size);
+    std::vector<double> correlation(numSnapshots * numSnapshots);
+    for (int a = 0; a < numSnapshots; a++) {
+        for (int b = 0; b <= a; b++) {
+            const float* sa = &snapshots[(size_t)a * size];
+            const float* sb = &snapshots[(size_t)b * size];
+            double dot = 0.0;
+            for (int i = 0; i < size; i++)
+                dot += (double)sa[i] * sb[i];
+            correlation[a * numSnapshots + b] = dot;
+            correlation[b * numSnapshots + a] = dot;
+        }
+    }
+    std::vector<double> energies;
+    std::vector<double> combinations;
+    symmetricEigen(correlation, numSnapshots, energies, combinations);
+    if (numSnapshots == 0 || energies[0] <= 0.0)
+        return false;
+
+    int modes = 0;
+    while (modes < std::min(numModes, numSnapshots) && energies[modes] > kMinModeEnergy * energies[0])
+        modes++;
+
+    std::vector<double> pod(size * modes, 0.0);
+    std::vector<double> column(size);
+    for (int k = 0; k < modes; k++) {
+        std::fill(column.begin(), column.end(), 0.0);
+        double scale = 1.0 / sqrt(energies[k]);
+        for (int s = 0; s < numSnapshots; s++) {
+            double weight = scale * combinations[s * numSnapshots + k];
+            const float* snapshot = &snapshots[(size_t)s * size];
+            for (int i = 0; i < size; i++)
+                column[i] += weight * snapshot[i];
+        }
+        for (int i = 0; i < size; i++)
+            pod[i * modes + k] = column[i];
+    }
+    snapshots.clear();
+    snapshots.shrink_to_fit();
+
+    // stiffness of the subspace at the settled shape, central differences of the full forces
+    SoACloth probe;
+    std::vector<double> displacement(size, 0.0);
+    std::vector<double> forcePlus(size);
+    std::vector<double> forceMinus(size);
+    std::vector<double> restForce(modes, 0.0);
+    computeRelaxedForce(probe, settled, displacement, 0.0, forcePlus);
+    for (int i = 0; i < size; i++)
+        for (int k = 0; k < modes; k++)
+            restForce[k] += pod[i * modes + k] * forcePlus[i];
+
+    std::vector<double> stiffness(modes * modes, 0.0);
+    for (int k = 0; k < modes; k++) {
+        double largest = 0.0;
+        for (int i = 0; i < size; i++) {
+            displacement[i] = pod[i * modes + k];
+            largest = std::max(largest, fabs(displacement[i]));
+        }
+        double amplitude = kProbeDistance / largest;
+        computeRelaxedForce(probe, settled, displacement, amplitude, forcePlus);
+        computeRelaxedForce(probe, settled, displacement, -amplitude, forceMinus);
+        for (int i = 0; i < size; i++) {
+            double df = (forcePlus[i] - forceMinus[i]) / (2.0 * amplitude);
+            for (int j = 0; j < modes; j++)
+                stiffness[j * modes + k] -= pod[i * modes + j] * df;
+        }
+    }
+
+    // the symmetric part decouples the modes. buckling directions (no positive stiffness) are
+    // dropped, a free mode would still be driven by its rest force
+    for (int j = 0; j < modes; j++) {
+        for (int k = j + 1; k < modes; k++) {
+            double mean = 0.5 * (stiffness[j * modes + k] + stiffness[k * modes + j]);
+            stiffness[j * modes + k] = mean;
+            stiffness[k * modes + j] = mean;
+        }
+    }
+    std::vector<double> values;
+    std::vector<double> rotation;
+    symmetricEigen(stiffness, modes, values, rotation);
+
+    int stable = 0;
+    while (stable < modes && values[stable] > 0.0)
+        stable++;
+    if (stable == 0)
+        return false;
+
+    m_numNodes = numNodes;
+    m_numModes = stable;
+    m_basis.resize(size * stable);
+    std::vector<double> row(stable);
+    for (int i = 0; i < size; i++) {
+        std::fill(row.begin(), row.end(), 0.0);
+        for (int j = 0; j < modes; j++)
+            for (int k = 0; k < stable; k++)
+                row[k] += pod[i * modes + j] * rotation[j * modes + k];
+        for (int k = 0; k < stable; k++)
+            m_basis[i * stable + k] = (float)row[k];
+    }
+
+    m_stiffness.assign(values.begin(), values.begin() + stable);
+    m_restForce.assign(stable, 0.0);
+    for (int k = 0; k < stable; k++)
+        for (int j = 0; j < modes; j++)
+            m_restForce[k] += rotation[j * modes + k] * restForce[j];
+
+    m_restX = settled.m_posX;
+    m_restY = settled.m_posY;
+    m_restZ = settled.m_posZ;
+    m_mass = full.m_mass;
+    m_kDampingPos = full.m_kDampingPos;
+    reset();
+    return true;
+}
+
+void ReducedCloth::computeRelaxedForce(SoACloth& probe, const SoACloth& settled, const std::vector<double>& displacement,
+    double amplitude, std::vector<double>& force) {
+    probe = settled;
+    probe.setIntegrator(SoAIntegrator::Explicit);
+    int numNodes = probe.getNumNodes();
+    for (int n = 0; n < numNodes; n++) {
+        probe.m_fixed[n] = 1;
+        probe.m_posX[n] += amplitude * displacement[3 * n + 0];
+        probe.m_posY[n] += amplitude * displacement[3 * n + 1];
+        probe.m_posZ[n] += amplitude * displacement[3 * n + 2];
+        probe.m_velX[n] = probe.m_velY[n] = probe.m_velZ[n] = 0.0;
+        probe.m_angVelX[n] = probe.m_angVelY[n] = probe.m_angVelZ[n] = 0.0;
+    }
+
+    // positions held, the node frames turn towards balanced flexion and torsion
+    for (int step = 0; step < kRelaxSteps; step++)
+        probe.updateDynamics(kBuildStep);
+
+    probe.clearForces(0, numNodes);
+    probe.computeLinkForces(0, probe.getNumLinks());
+    for (int n = 0; n < numNodes; n++) {
+        force[3 * n + 0] = probe.m_forceX[n];
+        force[3 * n + 1] = probe.m_forceY[n];
+        force[3 * n + 2] = probe.m_forceZ[n];
+    }
+}
+
+unsigned long long ReducedCloth::computeKey(SoACloth& full, int numModes) {
+    SoAClothTopology t;
+    full.getTopology(t);
+
+    unsigned long long hash = hashBytes(&kCacheVersion, sizeof(kCacheVersion));
+    hash = hashBytes(&numModes, sizeof(numModes), hash);
+    hash = hashBytes(t.posX, t.numNodes * sizeof(double), hash);
+    hash = hashBytes(t.posY, t.numNodes * sizeof(double), hash);
+    hash = hashBytes(t.posZ, t.numNodes * sizeof(double), hash);
+    hash = hashBytes(t.fixed, t.numNodes, hash);
+    hash = hashBytes(t.link0, t.numLinks * sizeof(int), hash);
+    hash = hashBytes(t.link1, t.numLinks * sizeof(int), hash);
+    hash = hashBytes(t.kElongation, t.numLinks * sizeof(double), hash);
+    hash = hashBytes(t.kFlexion, t.numLinks * sizeof(double), hash);
+    hash = hashBytes(t.kTorsion, t.numLinks * sizeof(double), hash);
+
+    double properties[] = { full.m_mass, full.m_inertia, full.m_kDampingPos, full.m_kDampingRot,
+        full.m_useGravity ? 1.0 : 0.0, full.m_gravity.x(), full.m_gravity.y(), full.m_gravity.z() };
+    return hashBytes(properties, sizeof(properties), hash);
+}
+
+bool ReducedCloth::save(const std::string& path, unsigned long long key) const {
+    CacheHeader header = {};
+    memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+    header.version = kCacheVersion;
+    header.numNodes = m_numNodes;
+    header.key = key;
+    header.numModes = m_numModes;
+    header.mass = m_mass;
+    header.kDampingPos = m_kDampingPos;
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)m_restX.data(), m_numNodes * sizeof(double));
+    file.write((const char*)m_restY.data(), m_numNodes * sizeof(double));
+    file.write((const char*)m_restZ.data(), m_numNodes * sizeof(double));
+    file.write((const char*)m_stiffness.data(), m_numModes * sizeof(double));
+    file.write((const char*)m_restForce.data(), m_numModes * sizeof(double));
+    file.write((const char*)m_basis.data(), m_basis.size() * sizeof(float));
+    return (bool)file;
+}
+
+bool ReducedCloth::load(const std::string& path, unsigned long long key) {
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+
+    CacheHeader header;
+    if (file.getSize() < sizeof(header))
+        return false;
+    memcpy(&header, file.getData(), sizeof(header));
+    if (memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) != 0 || header.version != kCacheVersion ||
+        header.key != key || header.numNodes <= 0 || header.numModes <= 0)
+        return false;
+
+    size_t numNodes = header.numNodes;
+    size_t numModes = header.numModes;
+    size_t size = (3 * numNodes + 2 * numModes) * sizeof(double) + 3 * numNodes * numModes * sizeof(float);
+    if (file.getSize() - sizeof(header) < size)
+        return false;
+
+    // the header is 8 byte aligned, so are the doubles after it, the basis comes last
+    const double* data = (const double*)(file.getData() + sizeof(header));
+    m_restX.assign(data, data + numNodes);
+    data += numNodes;
+    m_restY.assign(data, data + numNodes);
+    data += numNodes;
+    m_restZ.assign(data, data + numNodes);
+    data += numNodes;
+    m_stiffness.assign(data, data + numModes);
+    data += numModes;
+    m_restForce.assign(data, data + numModes);
+    data += numModes;
+    const float* basis = (const float*)data;
+    m_basis.assign(basis, basis + 3 * numNodes * numModes);
+
+    m_numNodes = header.numNodes;
+    m_numModes = header.numModes;
+    m_mass = header.mass;
+    m_kDampingPos = header.kDampingPos;
+    reset();
+    return true;
+}
+
+void ReducedCloth::reset() {
+    m_q.assign(m_numModes, 0.0);
+    m_qDot.assign(m_numModes, 0.0);
+    m_force.assign(m_numModes, 0.0);
+}
+
+void ReducedCloth::getNodePos(int node, double& x, double& y, double& z) const {
+    const float* bx = &m_basis[(3 * node + 0) * m_numModes];
+    const float* by = bx + m_numModes;
+    const float* bz = by + m_numModes;
+    x = m_restX[node];
+    y = m_restY[node];
+    z = m_restZ[node];
+    for (int k = 0; k < m_numModes; k++) {
+        x += bx[k] * m_q[k];
+        y += by[k] * m_q[k];
+        z += bz[k] * m_q[k];
+    }
+}
+
+void ReducedCloth::reconstruct(int first, int last, double* x, double* y, double* z) const {
+    // a block of nodes at a time, mode after mode: independent sums per node instead of one
+    // dependent chain per coordinate as in getNodePos, and the rows of the block stay in cache
+    for (int block = first; block < last; block += kReconstructBlock) {
+        int end = std::min(last, block + kReconstructBlock);
+        for (int n = block; n < end; n++) {
+            x[n] = m_restX[n];
+            y[n] = m_restY[n];
+            z[n] = m_restZ[n];
+        }
+        for (int k = 0; k < m_numModes; k++) {
+            double q = m_q[k];
+            for (int n = block; n < end; n++) {
+                const float* row = &m_basis[3 * n * m_numModes + k];
+                x[n] += row[0] * q;
+                y[n] += row[m_numModes] * q;
+                z[n] += row[2 * m_numModes] * q;
+            }
+        }
+    }
+}
+
+void ReducedCloth::addNodeForce(int node, const chai3d::cVector3d& force) {
+    const float* bx = &m_basis[(3 * node + 0) * m_numModes];
+    const float* by = bx + m_numModes;
+    const float* bz = by + m_numModes;
+    for (int k = 0; k < m_numModes; k++)
+        m_force[k] += bx[k] * force.x() + by[k] * force.y() + bz[k] * force.z();
+}
+
+void ReducedCloth::updateDynamics(double time) {
+    // m qdd = f0 + f - k q - c m qd, backward euler on qd then q
+    for (int k = 0; k < m_numModes; k++) {
+        double force = m_restForce[k] + m_force[k] - m_stiffness[k] * m_q[k];
+        m_qDot[k] = (m_mass * m_qDot[k] + time * force) /
+            (m_mass * (1.0 + time * m_kDampingPos) + time * time * m_stiffness[k]);
+        m_q[k] += time * m_qDot[k];
+        m_force[k] = 0.0;
+    }
+}
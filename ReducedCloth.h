@@ -0,0 +1,84 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "chai3d.h"
+
+#include "SoACloth.h"
+
+// reduced order model of a SoACloth for large swatches: the node positions are the settled
+// shape plus a few modes, x = x0 + U q. build fits the modes offline: the full cloth settles
+// under gravity, is pushed around by a scripted sequence of loads, and the POD of the recorded
+// displacements spans the subspace. the forces of the full cloth, linearized at x0 with the node
+// frames relaxed, are projected on it and diagonalized, so each mode is an independent damped
+// oscillator. a step then integrates numModes coordinates whatever the size of the cloth, and
+// nodes are reconstructed on demand. the model is linear around x0, pushes much larger than the
+// scripted ones are felt stiffer or softer than the full cloth would be
+
+class ReducedCloth
+{
+public:
+	ReducedCloth();
+	~ReducedCloth() = default;
+
+	// fit up to numModes modes to full, which has to be at rest and not stepped yet (the copy
+	// that is simulated keeps its thread pool). takes seconds for a 100 x 100 cloth, returns
+	// false if the cloth did not move at all or no mode has a positive stiffness
+	bool build(const SoACloth& full, int numModes);
+
+	// hash of everything build depends on
+	static unsigned long long computeKey(SoACloth& full, int numModes);
+
+	// cache file of a built model, load returns false unless it was saved with the same key
+	bool save(const std::string& path, unsigned long long key) const;
+	bool load(const std::string& path, unsigned long long key);
+
+	int getNumNodes() const { return m_numNodes; }
+	int getNumModes() const { return m_numModes; }
+
+	// current position of one node, numModes multiply-adds per coordinate
+	void getNodePos(int node, double& x, double& y, double& z) const;
+
+	// current positions of nodes first .. last - 1 into x, y, z indexed by node
+	void reconstruct(int first, int last, double* x, double* y, double* z) const;
+
+	// external force on a node during the next step
+	void addNodeForce(int node, const chai3d::cVector3d& force);
+
+	// backward euler per mode, unconditionally stable, clears the external forces
+	void updateDynamics(double time);
+
+	// back to the settled shape at rest
+	void reset();
+
+private:
+	// force on every node of probe (positions and node frames of settled, all nodes fixed) at
+	// the settled shape plus amplitude times displacement, after its frames relaxed for a while.
+	// displacement and force hold x, y, z per node
+	static void computeRelaxedForce(SoACloth& probe, const SoACloth& settled, const std::vector<double>& displacement,
+		double amplitude, std::vector<double>& force);
+
+	int m_numNodes;
+	int m_numModes;
+
+	// settled shape and modes, mode k displacement of node n along axis a at
+	// (3 * n + a) * numModes + k so a node reads three contiguous rows. the modes are streamed
+	// through once per display refresh, floats halve that
+	std::vector<double> m_restX, m_restY, m_restZ;
+	std::vector<float> m_basis;
+
+	// per mode: stiffness and force left at the settled shape (small unless it did not settle)
+	std::vector<double> m_stiffness;
+	std::vector<double> m_restForce;
+
+	// node mass and velocity damping of the full cloth, the modes are orthonormal so every mode
+	// has the mass of a node
+	double m_mass;
+	double m_kDampingPos;
+
+	// state and external forces per mode
+	std::vector<double> m_q;
+	std::vector<double> m_qDot;
+	std::vector<double> m_force;
+};
@@ -0,0 +1,98 @@
+#include "ReplayHapticDevice.h"
+
+#include <algorithm>
+#include <cstring>
+
+ReplayHapticDevice::ReplayHapticDevice() : VirtualHapticDevice(nullptr), m_samples(nullptr), m_numSamples(0), m_index(0) {
+    m_specifications.m_modelName = "replay device";
+    m_specifications.m_manufacturerName = "recording";
+    m_specifications.m_sensedRotation = true;
+    m_specifications.m_sensedGripper = true;
+}
+
+bool ReplayHapticDevice::load(const std::string& path) {
+    m_samples = nullptr;
+    m_numSamples = 0;
+    m_index = 0;
+
+    if (!m_file.open(path))
+        return false;
+
+    DeviceRecordingHeader header;
+    if (m_file.getSize() < sizeof(header))
+        return false;
+    memcpy(&header, m_file.getData(), sizeof(header));
+    if (memcmp(header.magic, DeviceRecorder::MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != DeviceRecorder::VERSION || header.sampleSize != sizeof(DeviceSample)) {
+        m_file.close();
+        return false;
+    }
+
+    // behave like the recorded device
+    m_specifications.m_workspaceRadius = header.workspaceRadius;
+    m_specifications.m_maxLinearStiffness = header.maxLinearStiffness;
+    m_specifications.m_maxLinearForce = header.maxLinearForce;
+
+    // a recording that was cut off ends at its last complete sample
+    m_samples = (const DeviceSample*)(m_file.getData() + sizeof(header));
+    m_numSamples = (int)((m_file.getSize() - sizeof(header)) / sizeof(DeviceSample));
+    return true;
+}
+
+double ReplayHapticDevice::getDuration() {
+    if (m_numSamples == 0)
+        return 0.0;
+    return m_samples[m_numSamples - 1].time - m_samples[0].time;
+}
+
+bool ReplayHapticDevice::isFinished() {
+    return getTime() > getDuration();
+}
+
+const DeviceSample* ReplayHapticDevice::findSample() {
+    if (m_numSamples == 0)
+        return nullptr;
+
+    double time = m_samples[0].time + getTime();
+    if (m_samples[m_index].time > time) {
+        // clock went back (setTime), search from the start
+        const DeviceSample* next = std::upper_bound(m_samples, m_samples + m_numSamples, time,
+            [](double t, const DeviceSample& sample) { return t < sample.time; });
+        m_index = std::max(0, (int)(next - m_samples) - 1);
+    }
+    while (m_index + 1 < m_numSamples && m_samples[m_index + 1].time <= time)
+        m_index++;
+    return &m_samples[m_index];
+}
+
+bool ReplayHapticDevice::getPosition(chai3d::cVector3d& a_position) {
+    const DeviceSample* sample = findSample();
+    if (sample)
+        a_position.set(sample->position[0], sample->position[1], sample->position[2]);
+    else
+        a_position.zero();
+    return (chai3d::C_SUCCESS);
+}
+
+bool ReplayHapticDevice::getRotation(chai3d::cMatrix3d& a_rotation) {
+    const DeviceSample* sample = findSample();
+    a_rotation.identity();
+    if (sample) {
+        for (int row = 0; row < 3; row++)
+            for (int col = 0; col < 3; col++)
+                a_rotation(row, col) = sample->rotation[3 * row + col];
+    }
+    return (chai3d::C_SUCCESS);
+}
+
+bool ReplayHapticDevice::getGripperAngleRad(double& a_angle) {
+    const DeviceSample* sample = findSample();
+    a_angle = sample ? sample->gripperAngle : 0.0;
+    return (chai3d::C_SUCCESS);
+}
+
+bool ReplayHapticDevice::getUserSwitches(unsigned int& a_userSwitches) {
+    const DeviceSample* sample = findSample();
+    a_userSwitches = sample ? sample->userSwitches : 0;
+    return (chai3d::C_SUCCESS);
+}
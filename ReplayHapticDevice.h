@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+
+#include "DeviceRecorder.h"
+#include "MappedFile.h"
+#include "VirtualHapticDevice.h"
+
+// plays back a DeviceRecorder file. the recording is memory mapped, the device reports the
+// last sample at or before its script time (advance/setTime), so the caller decides whether
+// it runs in real time (advance by the measured tick) or as fast as possible (fixed steps)
+
+class ReplayHapticDevice : public VirtualHapticDevice
+{
+public:
+	ReplayHapticDevice();
+	~ReplayHapticDevice() = default;
+
+	// returns false if the file is missing or not a recording of this version. the device then
+	// reports the workspace and stiffness of the recorded one, set it on ChaiWorld afterwards
+	bool load(const std::string& path);
+
+	bool getPosition(chai3d::cVector3d& a_position) override;
+	bool getRotation(chai3d::cMatrix3d& a_rotation) override;
+	bool getGripperAngleRad(double& a_angle) override;
+	bool getUserSwitches(unsigned int& a_userSwitches) override;
+
+	int getNumSamples() { return m_numSamples; }
+
+	// recorded time span [s]
+	double getDuration();
+
+	// true once the script time passed the last sample
+	bool isFinished();
+
+private:
+	// sample for the current script time, nullptr if there are none
+	const DeviceSample* findSample();
+
+	MappedFile m_file;
+	const DeviceSample* m_samples;
+	int m_numSamples;
+
+	// last sample found, playback mostly moves forward by one
+	int m_index;
+};
@@ -2,9 +2,16 @@
 
 #include "ChaiWorld.h"
 
+namespace {
+
+    // grid spacing and stored band of the cloth contact field [m], well above the node radius
+    const double kDistanceFieldCell = 0.05;
+    const double kDistanceFieldBand = 0.25;
+}
+
 Rigid::Rigid(double width, double length, chai3d::cVector3d offset,
-    double stiffness, double staticFriction, double dynamicFriction, double textureLevel) :
-    m_width(width), m_length(length), m_offset(offset),
+    double stiffness, double staticFriction, double dynamicFriction, double textureLevel, RigidShape shape) :
+    m_shape(shape), m_width(width), m_length(length), m_offset(offset),
     m_stiffness(stiffness),m_staticFriction(staticFriction), m_dynamicFriction(dynamicFriction), m_textureLevel(textureLevel) {
 
     // create a mesh
@@ -15,8 +22,11 @@ Rigid::~Rigid() {
 }
 
 void Rigid::AttachToWorld(ChaiWorld& chaiWorld) {
-    // create plane
-    cCreatePlane(m_object, m_width, m_length);
+    // create mesh
+    if (m_shape == RigidShape::Sphere)
+        chai3d::cCreateSphere(m_object, 0.5 * m_width);
+    else
+        cCreatePlane(m_object, m_width, m_length);
 
     //rigid.m_object->createAABBCollisionDetector(m_toolRadius);
     m_object->createAABBCollisionDetector(chaiWorld.getMultiCursorRadius());
@@ -62,5 +72,26 @@ void Rigid::AttachToWorld(ChaiWorld& chaiWorld) {
     m_object->m_material->setDynamicFriction(m_dynamicFriction);
     m_object->m_material->setTextureLevel(m_textureLevel);
     m_object->m_material->setHapticTriangleSides(true, true);
+
+    buildDistanceField();
+
+    chaiWorld.addRigid(this);
+}
+
+void Rigid::buildDistanceField() {
+    // the mesh is only translated, world positions are local ones plus the offset
+    std::vector<chai3d::cVector3d> positions(m_object->getNumVertices());
+    for (int v = 0; v < (int)positions.size(); v++)
+        positions[v] = m_object->m_vertices->getLocalPos(v) + m_offset;
+
+    std::vector<int> indices;
+    indices.reserve(3 * m_object->getNumTriangles());
+    for (int t = 0; t < (int)m_object->getNumTriangles(); t++) {
+        indices.push_back(m_object->m_triangles->getVertexIndex0(t));
+        indices.push_back(m_object->m_triangles->getVertexIndex1(t));
+        indices.push_back(m_object->m_triangles->getVertexIndex2(t));
+    }
+
+    m_distanceField.build(indices, positions, kDistanceFieldCell, kDistanceFieldBand);
 }
 
@@ -4,23 +4,42 @@
 #include "Global.h"
 #include "chai3d.h"
 
+#include "SignedDistanceField.h"
+
+// mesh of a Rigid, both centered on its offset
+enum class RigidShape
+{
+	Plane,		// width x length, facing up
+	Sphere		// diameter width
+};
+
 class Rigid
 {
 	friend class ChaiWorld;
 
 public:
 	Rigid(double width, double length, chai3d::cVector3d offset, 
-		double stiffness, double staticFriction, double dynamicFriction, double textureLevel);
+		double stiffness, double staticFriction, double dynamicFriction, double textureLevel,
+		RigidShape shape = RigidShape::Plane);
 	~Rigid();
 
 	chai3d::cVector3d getOffset() { return m_offset; }
+	RigidShape getShape() { return m_shape; }
+
+	// cloth contact, built by AttachToWorld from the world frame triangles of the mesh
+	const SignedDistanceField& getDistanceField() { return m_distanceField; }
 
 	// setup object properties in world
 	void AttachToWorld(ChaiWorld& chaiWorld);
 
 private:
 
+	// sample the mesh into m_distanceField
+	void buildDistanceField();
+
 	chai3d::cMesh* m_object;
+	RigidShape m_shape;
+	SignedDistanceField m_distanceField;
 
 	chai3d::cVector3d m_offset;
 
@@ -0,0 +1,326 @@
+#include "SceneFile.h"
+
+#include "ChaiWorld.h"
+#include "MappedFile.h"
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <type_traits>
+
+namespace {
+
+    const char kCacheMagic[8] = { 'C', 'L', 'O', 'T', 'H', 'S', 'C', 'N' };
+
+    // bump when the layout of the cache or of SoAClothTopology changes
+    const unsigned int kCacheVersion = 2;
+
+    // FNV-1a
+    unsigned long long hashBytes(const void* data, size_t size, unsigned long long hash = 14695981039346656037ull) {
+        const unsigned char* bytes = (const unsigned char*)data;
+        for (size_t k = 0; k < size; k++) {
+            hash ^= bytes[k];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // visit the arrays of a topology in cache order with their element count
+    template <typename Visitor>
+    void forEachArray(SoAClothTopology& t, Visitor visit) {
+        visit(t.posX, t.numNodes);
+        visit(t.posY, t.numNodes);
+        visit(t.posZ, t.numNodes);
+        visit(t.fixed, t.numNodes);
+        visit(t.link0, t.numLinks);
+        visit(t.link1, t.numLinks);
+        visit(t.length0, t.numLinks);
+        visit(t.kElongation, t.numLinks);
+        visit(t.kFlexion, t.numLinks);
+        visit(t.kTorsion, t.numLinks);
+        visit(t.A0, 3 * t.numLinks);
+        visit(t.A1, 3 * t.numLinks);
+        visit(t.B0, 3 * t.numLinks);
+        visit(t.B1, 3 * t.numLinks);
+        visit(t.colorLinks, t.numLinks);
+        visit(t.colorStart, t.numColors + 1);
+        visit(t.pair0, t.numPairs);
+        visit(t.pair1, t.numPairs);
+        visit(t.linkPair, t.numLinks);
+        visit(t.bendA, t.numBends);
+        visit(t.bendCenter, t.numBends);
+        visit(t.bendB, t.numBends);
+        visit(t.bendStiffness, t.numBends);
+    }
+
+    // append at the next 8 byte boundary, returns the offset
+    unsigned long long append(std::vector<char>& blob, const void* data, size_t size) {
+        blob.resize((blob.size() + 7) & ~(size_t)7);
+        unsigned long long offset = blob.size();
+        blob.insert(blob.end(), (const char*)data, (const char*)data + size);
+        return offset;
+    }
+
+    bool parseEngine(const std::string& name, ClothEngine& engine) {
+        if (name == "gel")
+            engine = ClothEngine::GEL;
+        else if (name == "soa")
+            engine = ClothEngine::SoA;
+        else if (name == "implicit")
+            engine = ClothEngine::Implicit;
+        else if (name == "xpbd")
+            engine = ClothEngine::XPBD;
+        else if (name == "reduced")
+            engine = ClothEngine::Reduced;
+        else
+            return false;
+        return true;
+    }
+
+    bool parseShape(const std::string& name, RigidShape& shape) {
+        if (name == "plane")
+            shape = RigidShape::Plane;
+        else if (name == "sphere")
+            shape = RigidShape::Sphere;
+        else
+            return false;
+        return true;
+    }
+}
+
+SceneFile::SceneFile() : m_cached(false) {
+}
+
+bool SceneFile::load(ChaiWorld& chaiWorld, const std::string& path, ClothEngine defaultEngine) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cout << "cannot open scene file: " << path << std::endl;
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string text = buffer.str();
+
+    // the cache is valid for this text, engine and format only
+    int engine = (int)defaultEngine;
+    unsigned long long sourceHash = hashBytes(text.data(), text.size());
+    sourceHash = hashBytes(&engine, sizeof(engine), sourceHash);
+    sourceHash = hashBytes(&kCacheVersion, sizeof(kCacheVersion), sourceHash);
+
+    std::string cachePath = path + ".cache";
+    if (loadCache(cachePath, sourceHash, chaiWorld)) {
+        m_cached = true;
+        return true;
+    }
+
+    m_cached = false;
+    if (!parse(text, path, defaultEngine))
+        return false;
+
+    attach(chaiWorld, std::vector<const SoAClothTopology*>(m_deformableRecords.size(), nullptr));
+    writeCache(cachePath, sourceHash);
+    return true;
+}
+
+bool SceneFile::parse(const std::string& text, const std::string& path, ClothEngine defaultEngine) {
+    m_rigidRecords.clear();
+    m_deformableRecords.clear();
+    m_polygonsRecords.clear();
+
+    std::istringstream lines(text);
+    std::string line;
+    for (int lineNumber = 1; std::getline(lines, line); lineNumber++) {
+        size_t comment = line.find('#');
+        if (comment != std::string::npos)
+            line.erase(comment);
+
+        std::istringstream fields(line);
+        std::string type;
+        if (!(fields >> type))
+            continue;
+
+        bool valid = true;
+        if (type == "rigid") {
+            RigidRecord r = {};
+            valid = (bool)(fields >> r.width >> r.length >> r.offset[0] >> r.offset[1] >> r.offset[2]
+                >> r.stiffness >> r.staticFriction >> r.dynamicFriction >> r.textureLevel);
+
+            RigidShape shape = RigidShape::Plane;
+            std::string name;
+            if (valid && (fields >> name))
+                valid = parseShape(name, shape);
+            r.shape = (int)shape;
+            m_rigidRecords.push_back(r);
+        }
+        else if (type == "deformable") {
+            DeformableRecord d = {};
+            valid = (bool)(fields >> d.width >> d.length >> d.offset[0] >> d.offset[1] >> d.offset[2]
+                >> d.elongation >> d.flexion >> d.torsion >> d.c11 >> d.c12 >> d.c22 >> d.c33);
+            valid = valid && d.width > 1 && d.length > 1;
+
+            ClothEngine engine = defaultEngine;
+            std::string name;
+            if (valid && (fields >> name))
+                valid = parseEngine(name, engine);
+            d.engine = (int)engine;
+            m_deformableRecords.push_back(d);
+        }
+        else if (type == "polygons") {
+            PolygonsRecord p = {};
+            valid = (bool)(fields >> p.width >> p.length >> p.offset[0] >> p.offset[1] >> p.offset[2]
+                >> p.stiffness >> p.staticFriction >> p.dynamicFriction >> p.textureLevel);
+            valid = valid && p.width > 1 && p.length > 1;
+
+            // deformables are attached first, so any of them can be followed
+            p.source = -1;
+            fields >> p.source;
+            m_polygonsRecords.push_back(p);
+        }
+        else {
+            valid = false;
+        }
+
+        if (!valid) {
+            std::cout << path << ":" << lineNumber << ": invalid scene line: " << line << std::endl;
+            return false;
+        }
+    }
+
+    for (const PolygonsRecord& p : m_polygonsRecords) {
+        if (p.source >= (int)m_deformableRecords.size()) {
+            std::cout << path << ": polygons follow deformable " << p.source << ", there are only "
+                << m_deformableRecords.size() << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void SceneFile::attach(ChaiWorld& chaiWorld, const std::vector<const SoAClothTopology*>& topologies) {
+    for (const RigidRecord& r : m_rigidRecords) {
+        Rigid* rigid = new Rigid(r.width, r.length, chai3d::cVector3d(r.offset[0], r.offset[1], r.offset[2]),
+            r.stiffness, r.staticFriction, r.dynamicFriction, r.textureLevel, (RigidShape)r.shape);
+        rigid->AttachToWorld(chaiWorld);
+        m_rigids.push_back(rigid);
+    }
+
+    for (size_t k = 0; k < m_deformableRecords.size(); k++) {
+        const DeformableRecord& d = m_deformableRecords[k];
+        Deformable* deformable = new Deformable(d.width, d.length, chai3d::cVector3d(d.offset[0], d.offset[1], d.offset[2]),
+            d.elongation, d.flexion, d.torsion, d.c11, d.c12, d.c22, d.c33, (ClothEngine)d.engine);
+        deformable->AttachToWorld(chaiWorld, topologies[k]);
+        m_deformables.push_back(deformable);
+    }
+
+    for (const PolygonsRecord& p : m_polygonsRecords) {
+        Polygons* polygons = new Polygons(p.width, p.length, chai3d::cVector3d(p.offset[0], p.offset[1], p.offset[2]),
+            p.stiffness, p.staticFriction, p.dynamicFriction, p.textureLevel);
+        polygons->AttachToWorld(chaiWorld, p.source >= 0 ? m_deformables[p.source] : nullptr);
+        m_polygons.push_back(polygons);
+    }
+}
+
+bool SceneFile::loadCache(const std::string& path, unsigned long long sourceHash, ChaiWorld& chaiWorld) {
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+
+    const char* data = file.getData();
+    size_t size = file.getSize();
+
+    CacheHeader header;
+    if (size < sizeof(header))
+        return false;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) != 0 || header.version != kCacheVersion ||
+        header.sourceHash != sourceHash || header.numRigids < 0 || header.numDeformables < 0 || header.numPolygons < 0)
+        return false;
+
+    size_t recordsSize = header.numRigids * sizeof(RigidRecord) + header.numDeformables * sizeof(DeformableRecord) +
+        header.numPolygons * sizeof(PolygonsRecord);
+    if (size < sizeof(header) + recordsSize)
+        return false;
+
+    const char* records = data + sizeof(header);
+    m_rigidRecords.assign((const RigidRecord*)records, (const RigidRecord*)records + header.numRigids);
+    records += header.numRigids * sizeof(RigidRecord);
+    m_deformableRecords.assign((const DeformableRecord*)records, (const DeformableRecord*)records + header.numDeformables);
+    records += header.numDeformables * sizeof(DeformableRecord);
+    m_polygonsRecords.assign((const PolygonsRecord*)records, (const PolygonsRecord*)records + header.numPolygons);
+
+    // topologies point into the mapping, the cloths copy them while attaching
+    std::vector<SoAClothTopology> topologies(m_deformableRecords.size());
+    std::vector<const SoAClothTopology*> usedTopologies(m_deformableRecords.size(), nullptr);
+    for (size_t k = 0; k < m_deformableRecords.size(); k++) {
+        const DeformableRecord& d = m_deformableRecords[k];
+        if (!d.hasTopology)
+            continue;
+
+        SoAClothTopology& t = topologies[k];
+        t.numNodes = d.numNodes;
+        t.numLinks = d.numLinks;
+        t.numColors = d.numColors;
+        t.numPairs = d.numPairs;
+        t.numBends = d.numBends;
+
+        int array = 0;
+        bool valid = true;
+        forEachArray(t, [&](auto& pointer, int count) {
+            typedef typename std::remove_const<typename std::remove_pointer<typename std::remove_reference<decltype(pointer)>::type>::type>::type Element;
+            unsigned long long offset = d.arrays[array++];
+            if (count < 0 || offset % 8 != 0 || offset > size || (size - offset) / sizeof(Element) < (size_t)count)
+                valid = false;
+            pointer = valid ? (const Element*)(data + offset) : nullptr;
+        });
+        if (!valid)
+            return false;
+        usedTopologies[k] = &t;
+    }
+
+    attach(chaiWorld, usedTopologies);
+    return true;
+}
+
+void SceneFile::writeCache(const std::string& path, unsigned long long sourceHash) {
+    // records first, the arrays follow
+    std::vector<char> blob;
+    CacheHeader header = {};
+    memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+    header.version = kCacheVersion;
+    header.sourceHash = sourceHash;
+    header.numRigids = (int)m_rigidRecords.size();
+    header.numDeformables = (int)m_deformableRecords.size();
+    header.numPolygons = (int)m_polygonsRecords.size();
+    append(blob, &header, sizeof(header));
+    append(blob, m_rigidRecords.data(), m_rigidRecords.size() * sizeof(RigidRecord));
+    size_t deformableRecords = append(blob, m_deformableRecords.data(), m_deformableRecords.size() * sizeof(DeformableRecord));
+    append(blob, m_polygonsRecords.data(), m_polygonsRecords.size() * sizeof(PolygonsRecord));
+
+    for (size_t k = 0; k < m_deformables.size(); k++) {
+        DeformableRecord& d = m_deformableRecords[k];
+        SoACloth* soaCloth = m_deformables[k]->getSoACloth();
+        d.hasTopology = soaCloth ? 1 : 0;
+        if (!soaCloth)
+            continue;
+
+        SoAClothTopology t;
+        soaCloth->getTopology(t);
+        d.numNodes = t.numNodes;
+        d.numLinks = t.numLinks;
+        d.numColors = t.numColors;
+        d.numPairs = t.numPairs;
+        d.numBends = t.numBends;
+
+        int array = 0;
+        forEachArray(t, [&](auto& pointer, int count) {
+            d.arrays[array++] = append(blob, pointer, count * sizeof(*pointer));
+        });
+    }
+
+    // the records got their topology counts and offsets meanwhile
+    memcpy(&blob[deformableRecords], m_deformableRecords.data(), m_deformableRecords.size() * sizeof(DeformableRecord));
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.write(blob.data(), blob.size()))
+        std::cout << "cannot write scene cache: " << path << std::endl;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Deformable.h"
+#include "Polygons.h"
+#include "Rigid.h"
+
+// scene described in a text file instead of main.cpp, one object per line, # starts a comment
+//
+//   rigid      width length  x y z  stiffness staticFriction dynamicFriction textureLevel [plane|sphere]
+//   deformable width length  x y z  elongation flexion torsion c11 c12 c22 c33 [gel|soa|implicit|xpbd|reduced]
+//   polygons   width length  x y z  stiffness staticFriction dynamicFriction textureLevel [deformable]
+//
+// the last polygons field is the index (in file order) of the deformable the polygons follow.
+// the first load compiles the scene into <file>.cache, a binary copy that also holds the prebuilt
+// SoACloth topology of every deformable. later loads map the cache and skip parsing and the
+// topology build, it is rebuilt whenever the text (or the default engine) changes
+
+class SceneFile
+{
+public:
+	SceneFile();
+	~SceneFile() = default;
+
+	// create and attach all objects of the file, deformables without an engine use defaultEngine.
+	// returns false (and attaches nothing) if the file cannot be read or has an error
+	bool load(ChaiWorld& chaiWorld, const std::string& path, ClothEngine defaultEngine = ClothEngine::GEL);
+
+	// objects in file order, owned by the caller like objects created in main.cpp
+	const std::vector<Rigid*>& getRigids() { return m_rigids; }
+	const std::vector<Deformable*>& getDeformables() { return m_deformables; }
+	const std::vector<Polygons*>& getPolygons() { return m_polygons; }
+
+	// true if the last load came from the cache
+	bool isCached() { return m_cached; }
+
+	// cache layout, all records and arrays 8 byte aligned
+	struct CacheHeader
+	{
+		char magic[8];
+		unsigned int version;
+		int numRigids;
+		unsigned long long sourceHash;
+		int numDeformables;
+		int numPolygons;
+	};
+
+	struct RigidRecord
+	{
+		double width;
+		double length;
+		double offset[3];
+		double stiffness;
+		double staticFriction;
+		double dynamicFriction;
+		double textureLevel;
+		int shape;
+		int padding;
+	};
+
+	// topology arrays in SoAClothTopology order, offsets from the start of the file
+	static const int NUM_TOPOLOGY_ARRAYS = 23;
+
+	struct DeformableRecord
+	{
+		int width;
+		int length;
+		int engine;
+		int hasTopology;
+		double offset[3];
+		double elongation;
+		double flexion;
+		double torsion;
+		double c11;
+		double c12;
+		double c22;
+		double c33;
+		int numNodes;
+		int numLinks;
+		int numColors;
+		int numPairs;
+		int numBends;
+		int padding;
+		unsigned long long arrays[NUM_TOPOLOGY_ARRAYS];
+	};
+
+	struct PolygonsRecord
+	{
+		int width;
+		int length;
+		int source;		// deformable index, -1 for none
+		int padding;
+		double offset[3];
+		double stiffness;
+		double staticFriction;
+		double dynamicFriction;
+		double textureLevel;
+	};
+
+private:
+	bool parse(const std::string& text, const std::string& path, ClothEngine defaultEngine);
+	bool loadCache(const std::string& path, unsigned long long sourceHash, ChaiWorld& chaiWorld);
+	void writeCache(const std::string& path, unsigned long long sourceHash);
+
+	// create the objects of the records and attach them, topologies[d] may be nullptr
+	void attach(ChaiWorld& chaiWorld, const std::vector<const SoAClothTopology*>& topologies);
+
+	std::vector<RigidRecord> m_rigidRecords;
+	std::vector<DeformableRecord> m_deformableRecords;
+	std::vector<PolygonsRecord> m_polygonsRecords;
+
+	std::vector<Rigid*> m_rigids;
+	std::vector<Deformable*> m_deformables;
+	std::vector<Polygons*> m_polygons;
+
+	bool m_cached;
+};
@@ -0,0 +1,188 @@
+#include "SignedDistanceField.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "TriangleBVH.h"
+
+namespace {
+
+    // closest point of triangle abc to p (Ericson, Real-Time Collision Detection 5.1.5)
+    chai3d::cVector3d closestPointOnTriangle(const chai3d::cVector3d& p,
+        const chai3d::cVector3d& a, const chai3d::cVector3d& b, const chai3d::cVector3d& c) {
+
+        chai3d::cVector3d ab = b - a;
+        chai3d::cVector3d ac = c - a;
+        chai3d::cVector3d ap = p - a;
+        double d1 = ab.dot(ap);
+        double d2 = ac.dot(ap);
+        if (d1 <= 0.0 && d2 <= 0.0)
+            return a;
+
+        chai3d::cVector3d bp = p - b;
+        double d3 = ab.dot(bp);
+        double d4 = ac.dot(bp);
+        if (d3 >= 0.0 && d4 <= d3)
+            return b;
+
+        double vc = d1 * d4 - d3 * d2;
+        if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0)
+            return a + ab * (d1 / (d1 - d3));
+
+        chai3d::cVector3d cp = p - c;
+        double d5 = ab.dot(cp);
+        double d6 = ac.dot(cp);
+        if (d6 >= 0.0 && d5 <= d6)
+            return c;
+
+        double vb = d5 * d2 - d1 * d6;
+        if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0)
+            return a + ac * (d2 / (d2 - d6));
+
+        double va = d3 * d6 - d5 * d4;
+        if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0)
+            return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+        double denom = 1.0 / (va + vb + vc);
+        return a + ab * (vb * denom) + ac * (vc * denom);
+    }
+}
+
+SignedDistanceField::SignedDistanceField() :
+    m_size{ 0, 0, 0 }, m_origin{ 0.0, 0.0, 0.0 }, m_cellSize(1.0), m_invCellSize(1.0), m_band(0.0) {
+}
+
+void SignedDistanceField::build(const std::vector<int>& indices, const std::vector<chai3d::cVector3d>& positions,
+    double cellSize, double band, int maxCells) {
+
+    m_values.clear();
+    m_band = band;
+    if (indices.size() < 3 || positions.empty() || cellSize <= 0.0)
+        return;
+
+    // mesh bounds plus the band on every side
+    double lower[3] = { positions[0].x(), positions[0].y(), positions[0].z() };
+    double upper[3] = { lower[0], lower[1], lower[2] };
+    for (const chai3d::cVector3d& p : positions) {
+        for (int axis = 0; axis < 3; axis++) {
+            lower[axis] = std::min(lower[axis], p.get(axis));
+            upper[axis] = std::max(upper[axis], p.get(axis));
+        }
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        lower[axis] -= band;
+        upper[axis] += band;
+    }
+
+    // coarser cells if the grid would be too large
+    double cells = 1.0;
+    for (int axis = 0; axis < 3; axis++)
+        cells *= (upper[axis] - lower[axis]) / cellSize + 1.0;
+    if (cells > maxCells)
+        cellSize *= std::cbrt(cells / maxCells);
+
+    m_cellSize = cellSize;
+    m_invCellSize = 1.0 / cellSize;
+    for (int axis = 0; axis < 3; axis++) {
+        m_origin[axis] = lower[axis];
+        m_size[axis] = std::max(2, (int)std::ceil((upper[axis] - lower[axis]) * m_invCellSize) + 1);
+    }
+    m_values.resize((size_t)m_size[0] * m_size[1] * m_size[2]);
+
+    // only triangles within the band of a grid point can give its distance
+    TriangleBVH bvh;
+    bvh.build(indices, positions);
+    std::vector<int> candidates;
+
+    size_t index = 0;
+    for (int z = 0; z < m_size[2]; z++) {
+        for (int y = 0; y < m_size[1]; y++) {
+            for (int x = 0; x < m_size[0]; x++) {
+                chai3d::cVector3d p(m_origin[0] + x * cellSize, m_origin[1] + y * cellSize, m_origin[2] + z * cellSize);
+                candidates.clear();
+                bvh.querySphere(p, band, candidates);
+                m_values[index++] = (float)computeDistance(p, candidates, indices, positions);
+            }
+        }
+    }
+}
+
+double SignedDistanceField::computeDistance(const chai3d::cVector3d& position, const std::vector<int>& candidates,
+    const std::vector<int>& indices, const std::vector<chai3d::cVector3d>& positions) const {
+
+    double best = m_band * m_band;
+    double sign = 1.0;
+    double bestAlignment = -1.0;
+    for (int t : candidates) {
+        const chai3d::cVector3d& a = positions[indices[3 * t]];
+        const chai3d::cVector3d& b = positions[indices[3 * t + 1]];
+        const chai3d::cVector3d& c = positions[indices[3 * t + 2]];
+        chai3d::cVector3d normal = (b - a).cross(c - a);
+        double area = normal.length();
+        if (area <= 0.0)
+            continue;
+        normal.mul(1.0 / area);
+
+        chai3d::cVector3d offset = position - closestPointOnTriangle(position, a, b, c);
+        double distance2 = offset.dot(offset);
+        if (distance2 > best * (1.0 + 1e-9))
+            continue;
+
+        // several triangles share the closest edge or vertex, the one facing the point decides the sign
+        double side = offset.dot(normal);
+        double alignment = distance2 > 0.0 ? fabs(side) / sqrt(distance2) : 1.0;
+        if (distance2 < best * (1.0 - 1e-9) || alignment > bestAlignment) {
+            best = std::min(best, distance2);
+            sign = side < 0.0 ? -1.0 : 1.0;
+            bestAlignment = alignment;
+        }
+    }
+    return sign * sqrt(best);
+}
+
+double SignedDistanceField::sample(const chai3d::cVector3d& position, chai3d::cVector3d& normal) const {
+    normal.zero();
+    if (m_values.empty())
+        return m_band;
+
+    double gx = (position.x() - m_origin[0]) * m_invCellSize;
+    double gy = (position.y() - m_origin[1]) * m_invCellSize;
+    double gz = (position.z() - m_origin[2]) * m_invCellSize;
+    if (gx < 0.0 || gy < 0.0 || gz < 0.0 || gx >= m_size[0] - 1 || gy >= m_size[1] - 1 || gz >= m_size[2] - 1)
+        return m_band;
+
+    int x = (int)gx;
+    int y = (int)gy;
+    int z = (int)gz;
+    double fx = gx - x;
+    double fy = gy - y;
+    double fz = gz - z;
+
+    // the 8 corners of the cell
+    size_t strideY = m_size[0];
+    size_t strideZ = strideY * m_size[1];
+    const float* c = &m_values[z * strideZ + y * strideY + x];
+    double c000 = c[0], c100 = c[1];
+    double c010 = c[strideY], c110 = c[strideY + 1];
+    double c001 = c[strideZ], c101 = c[strideZ + 1];
+    double c011 = c[strideZ + strideY], c111 = c[strideZ + strideY + 1];
+
+    // interpolate along x, then y, then z
+    double c00 = c000 + (c100 - c000) * fx;
+    double c10 = c010 + (c110 - c010) * fx;
+    double c01 = c001 + (c101 - c001) * fx;
+    double c11 = c011 + (c111 - c011) * fx;
+    double c0 = c00 + (c10 - c00) * fy;
+    double c1 = c01 + (c11 - c01) * fy;
+
+    // gradient of the same trilinear function
+    double dx = ((c100 - c000) * (1.0 - fy) + (c110 - c010) * fy) * (1.0 - fz) +
+        ((c101 - c001) * (1.0 - fy) + (c111 - c011) * fy) * fz;
+    double dy = (c10 - c00) * (1.0 - fz) + (c11 - c01) * fz;
+    double dz = c1 - c0;
+    double length = sqrt(dx * dx + dy * dy + dz * dz);
+    if (length > 1e-12)
+        normal.set(dx / length, dy / length, dz / length);
+
+    return c0 + (c1 - c0) * fz;
+}
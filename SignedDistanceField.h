@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+
+#include "chai3d.h"
+
+// signed distance to a triangle mesh sampled on a regular grid, built once for a rigid object.
+// sample() is one trilinear lookup, so a query costs the same for a plane or a detailed prop.
+// the sign comes from the face normal of the closest triangle (positive on the side the normals
+// point to), so open meshes like a plane work too. only a band around the surface is stored:
+// distances are clamped to +-band, points outside the grid count as far outside
+
+class SignedDistanceField
+{
+public:
+	SignedDistanceField();
+	~SignedDistanceField() = default;
+
+	// world frame triangles (3 vertex indices each). cellSize grows if the grid would exceed
+	// maxCells, band is also the margin of the grid around the mesh bounds
+	void build(const std::vector<int>& indices, const std::vector<chai3d::cVector3d>& positions,
+		double cellSize, double band, int maxCells = 1 << 22);
+
+	// distance to the surface, clamped to the band, and the unit gradient (zero where the
+	// field is flat, outside the grid or before build)
+	double sample(const chai3d::cVector3d& position, chai3d::cVector3d& normal) const;
+
+	bool isBuilt() const { return !m_values.empty(); }
+	double getCellSize() const { return m_cellSize; }
+	int getNumCells() const { return (int)m_values.size(); }
+
+private:
+	// exact signed distance from the candidate triangles, band if there are none
+	double computeDistance(const chai3d::cVector3d& position, const std::vector<int>& candidates,
+		const std::vector<int>& indices, const std::vector<chai3d::cVector3d>& positions) const;
+
+	// grid points along x, y, z, x fastest
+	int m_size[3];
+	double m_origin[3];
+	double m_cellSize;
+	double m_invCellSize;
+	double m_band;
+
+	std::vector<float> m_values;
+};
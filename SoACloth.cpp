@@ -0,0 +1,824 @@
+#include "SoACloth.h"
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+namespace {
+
+    // small stack-only vector helpers, the hot loops avoid chai3d temporaries
+
+    struct Vec3 {
+        double x, y, z;
+    };
+
+    inline Vec3 sub(const Vec3& a, const Vec3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+    inline Vec3 scale(const Vec3& a, double s) { return { a.x * s, a.y * s, a.z * s }; }
+    inline double dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    inline double length(const Vec3& a) { return sqrt(dot(a, a)); }
+    inline Vec3 cross(const Vec3& a, const Vec3& b) {
+        return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+    }
+    inline Vec3 normalize(const Vec3& a) {
+        double l = length(a);
+        return (l > 0.0) ? scale(a, 1.0 / l) : a;
+    }
+
+    // angle between two vectors [rad]
+    inline double angle(const Vec3& a, const Vec3& b) {
+        double l = length(a) * length(b);
+        if (l < 0.0000001)
+            return 0.0;
+        return acos(std::max(-1.0, std::min(1.0, dot(a, b) / l)));
+    }
+
+    // r (row major 3x3) * v
+    inline Vec3 rotate(const double* r, const double* v) {
+        return { r[0] * v[0] + r[1] * v[1] + r[2] * v[2],
+                 r[3] * v[0] + r[4] * v[1] + r[5] * v[2],
+                 r[6] * v[0] + r[7] * v[1] + r[8] * v[2] };
+    }
+
+    // transpose(r) * v
+    inline Vec3 rotateInv(const double* r, const Vec3& v) {
+        return { r[0] * v.x + r[3] * v.y + r[6] * v.z,
+                 r[1] * v.x + r[4] * v.y + r[7] * v.z,
+                 r[2] * v.x + r[5] * v.y + r[8] * v.z };
+    }
+
+    inline void store(std::vector<double>& dst, const Vec3& v) {
+        dst.push_back(v.x);
+        dst.push_back(v.y);
+        dst.push_back(v.z);
+    }
+}
+
+SoACloth::SoACloth() :
+    m_pool(nullptr), m_integrator(SoAIntegrator::Explicit), m_maxIterations(50), m_tolerance(0.0001), m_lastIterations(0),
+    m_constraintIterations(8), m_bendingBuilt(false),
+    m_mass(0.002), m_inertia(0.0), m_kDampingPos(5.0), m_kDampingRot(0.6),
+    m_useGravity(true), m_gravity(0.0, 0.0, -9.81) {
+}
+
+void SoACloth::setNodeProperties(double mass, double inertia, double kDampingPos, double kDampingRot,
+    bool useGravity, const chai3d::cVector3d& gravity) {
+    m_mass = mass;
+    m_inertia = inertia;
+    m_kDampingPos = kDampingPos;
+    m_kDampingRot = kDampingRot;
+    m_useGravity = useGravity;
+    m_gravity = gravity;
+}
+
+void SoACloth::reserve(int numNodes, int numLinks) {
+    for (std::vector<double>* v : { &m_posX, &m_posY, &m_posZ, &m_velX, &m_velY, &m_velZ,
+        &m_forceX, &m_forceY, &m_forceZ, &m_extForceX, &m_extForceY, &m_extForceZ,
+        &m_angVelX, &m_angVelY, &m_angVelZ, &m_torqueX, &m_torqueY, &m_torqueZ })
+        v->reserve(numNodes);
+    m_rot.reserve(9 * numNodes);
+    m_fixed.reserve(numNodes);
+
+    m_link0.reserve(numLinks);
+    m_link1.reserve(numLinks);
+    for (std::vector<double>* v : { &m_length0, &m_kElongation, &m_kFlexion, &m_kTorsion })
+        v->reserve(numLinks);
+    for (std::vector<double>* v : { &m_A0, &m_A1, &m_B0, &m_B1 })
+        v->reserve(3 * numLinks);
+}
+
+int SoACloth::addNode(const chai3d::cVector3d& pos, bool fixed) {
+    m_posX.push_back(pos.x());
+    m_posY.push_back(pos.y());
+    m_posZ.push_back(pos.z());
+
+    for (std::vector<double>* v : { &m_velX, &m_velY, &m_velZ, &m_forceX, &m_forceY, &m_forceZ,
+        &m_extForceX, &m_extForceY, &m_extForceZ, &m_angVelX, &m_angVelY, &m_angVelZ,
+        &m_torqueX, &m_torqueY, &m_torqueZ })
+        v->push_back(0.0);
+
+    const double identity[9] = { 1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0 };
+    m_rot.insert(m_rot.end(), identity, identity + 9);
+
+    m_fixed.push_back(fixed ? 1 : 0);
+
+    return getNumNodes() - 1;
+}
+
+int SoACloth::addLink(int node0, int node1, double kElongation, double kFlexion, double kTorsion) {
+    Vec3 p0 = { m_posX[node0], m_posY[node0], m_posZ[node0] };
+    Vec3 p1 = { m_posX[node1], m_posY[node1], m_posZ[node1] };
+    Vec3 link = sub(p1, p0);
+
+    m_link0.push_back(node0);
+    m_link1.push_back(node1);
+    m_bendingBuilt = false;
+    m_length0.push_back(length(link));
+    m_kElongation.push_back(kElongation);
+    m_kFlexion.push_back(kFlexion);
+    m_kTorsion.push_back(kTorsion);
+
+    // pick the world axis least aligned with the link to build the torsion reference
+    Vec3 dir = normalize(link);
+    Vec3 axis = { 1.0, 0.0, 0.0 };
+    if (fabs(dir.y) < fabs(dir.x) && fabs(dir.y) <= fabs(dir.z))
+        axis = { 0.0, 1.0, 0.0 };
+    else if (fabs(dir.z) < fabs(dir.x) && fabs(dir.z) < fabs(dir.y))
+        axis = { 0.0, 0.0, 1.0 };
+    Vec3 normal = normalize(cross(dir, axis));
+
+    // store rest directions in the frame of each end node
+    const double* r0 = &m_rot[9 * node0];
+    const double* r1 = &m_rot[9 * node1];
+    store(m_A0, rotateInv(r0, dir));
+    store(m_A1, rotateInv(r1, scale(dir, -1.0)));
+    store(m_B0, rotateInv(r0, normal));
+    store(m_B1, rotateInv(r1, normal));
+
+    return getNumLinks() - 1;
+}
+
+void SoACloth::getTopology(SoAClothTopology& topology) {
+    if ((int)m_colorLinks.size() != getNumLinks())
+        colorLinks();
+    if ((int)m_linkPair.size() != getNumLinks())
+        buildJacobianPattern();
+    if (!m_bendingBuilt)
+        buildBendingConstraints();
+
+    topology.numNodes = getNumNodes();
+    topology.numLinks = getNumLinks();
+    topology.numColors = getNumColors();
+    topology.numPairs = (int)m_pair0.size();
+    topology.numBends = (int)m_bendA.size();
+
+    topology.posX = m_posX.data();
+    topology.posY = m_posY.data();
+    topology.posZ = m_posZ.data();
+    topology.fixed = m_fixed.data();
+
+    topology.link0 = m_link0.data();
+    topology.link1 = m_link1.data();
+    topology.length0 = m_length0.data();
+    topology.kElongation = m_kElongation.data();
+    topology.kFlexion = m_kFlexion.data();
+    topology.kTorsion = m_kTorsion.data();
+    topology.A0 = m_A0.data();
+    topology.A1 = m_A1.data();
+    topology.B0 = m_B0.data();
+    topology.B1 = m_B1.data();
+
+    topology.colorLinks = m_colorLinks.data();
+    topology.colorStart = m_colorStart.data();
+
+    topology.pair0 = m_pair0.data();
+    topology.pair1 = m_pair1.data();
+    topology.linkPair = m_linkPair.data();
+
+    topology.bendA = m_bendA.data();
+    topology.bendCenter = m_bendCenter.data();
+    topology.bendB = m_bendB.data();
+    topology.bendStiffness = m_bendStiffness.data();
+}
+
+void SoACloth::setTopology(const SoAClothTopology& topology) {
+    int n = topology.numNodes;
+    int links = topology.numLinks;
+
+    m_posX.assign(topology.posX, topology.posX + n);
+    m_posY.assign(topology.posY, topology.posY + n);
+    m_posZ.assign(topology.posZ, topology.posZ + n);
+    for (std::vector<double>* v : { &m_velX, &m_velY, &m_velZ, &m_forceX, &m_forceY, &m_forceZ,
+        &m_extForceX, &m_extForceY, &m_extForceZ, &m_angVelX, &m_angVelY, &m_angVelZ,
+        &m_torqueX, &m_torqueY, &m_torqueZ })
+        v->assign(n, 0.0);
+
+    const double identity[9] = { 1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0 };
+    m_rot.resize(9 * n);
+    for (int i = 0; i < n; i++)
+        std::copy(identity, identity + 9, &m_rot[9 * i]);
+    m_fixed.assign(topology.fixed, topology.fixed + n);
+
+    m_link0.assign(topology.link0, topology.link0 + links);
+    m_link1.assign(topology.link1, topology.link1 + links);
+    m_length0.assign(topology.length0, topology.length0 + links);
+    m_kElongation.assign(topology.kElongation, topology.kElongation + links);
+    m_kFlexion.assign(topology.kFlexion, topology.kFlexion + links);
+    m_kTorsion.assign(topology.kTorsion, topology.kTorsion + links);
+    m_A0.assign(topology.A0, topology.A0 + 3 * links);
+    m_A1.assign(topology.A1, topology.A1 + 3 * links);
+    m_B0.assign(topology.B0, topology.B0 + 3 * links);
+    m_B1.assign(topology.B1, topology.B1 + 3 * links);
+
+    m_colorLinks.assign(topology.colorLinks, topology.colorLinks + links);
+    m_colorStart.assign(topology.colorStart, topology.colorStart + topology.numColors + 1);
+
+    m_pair0.assign(topology.pair0, topology.pair0 + topology.numPairs);
+    m_pair1.assign(topology.pair1, topology.pair1 + topology.numPairs);
+    m_linkPair.assign(topology.linkPair, topology.linkPair + links);
+
+    m_bendA.assign(topology.bendA, topology.bendA + topology.numBends);
+    m_bendCenter.assign(topology.bendCenter, topology.bendCenter + topology.numBends);
+    m_bendB.assign(topology.bendB, topology.bendB + topology.numBends);
+    m_bendStiffness.assign(topology.bendStiffness, topology.bendStiffness + topology.numBends);
+    m_bendingBuilt = true;
+
+    // solver state follows the new topology on the next step
+    m_diagBlock.clear();
+}
+
+chai3d::cMatrix3d SoACloth::getNodeRot(int index) const {
+    const double* r = &m_rot[9 * index];
+    chai3d::cMatrix3d rot;
+    for (int row = 0; row < 3; row++)
+        for (int col = 0; col < 3; col++)
+            rot(row, col) = r[3 * row + col];
+    return rot;
+}
+
+void SoACloth::setExternalForce(int index, const chai3d::cVector3d& force) {
+    m_extForceX[index] = force.x();
+    m_extForceY[index] = force.y();
+    m_extForceZ[index] = force.z();
+}
+
+void SoACloth::clearExternalForces() {
+    std::fill(m_extForceX.begin(), m_extForceX.end(), 0.0);
+    std::fill(m_extForceY.begin(), m_extForceY.end(), 0.0);
+    std::fill(m_extForceZ.begin(), m_extForceZ.end(), 0.0);
+}
+
+void SoACloth::updateDynamics(double time) {
+    if (m_integrator == SoAIntegrator::Implicit) {
+        updateDynamicsImplicit(time);
+        return;
+    }
+    if (m_integrator == SoAIntegrator::XPBD) {
+        updateDynamicsXPBD(time);
+        return;
+    }
+
+    if (!m_pool) {
+        clearForces(0, getNumNodes());
+        computeLinkForces(0, getNumLinks());
+        integrate(time, 0, getNumNodes());
+        return;
+    }
+
+    if ((int)m_colorLinks.size() != getNumLinks())
+        colorLinks();
+
+    m_pool->run([this, time](int thread, int numThreads) {
+        int first, last;
+        ThreadPool::split(getNumNodes(), thread, numThreads, first, last);
+        clearForces(first, last);
+        m_pool->barrier();
+
+        for (int color = 0; color < getNumColors(); color++) {
+            int count = m_colorStart[color + 1] - m_colorStart[color];
+            ThreadPool::split(count, thread, numThreads, first, last);
+            for (int k = m_colorStart[color] + first; k < m_colorStart[color] + last; k++)
+                computeLinkForce(m_colorLinks[k]);
+            m_pool->barrier();
+        }
+
+        ThreadPool::split(getNumNodes(), thread, numThreads, first, last);
+        integrate(time, first, last);
+    });
+}
+
+void SoACloth::colorLinks() {
+    // colors already taken by the links of each node, one bit per color
+    std::vector<unsigned long long> nodeColors(getNumNodes(), 0);
+    std::vector<int> linkColor(getNumLinks());
+    int numColors = 0;
+
+    for (int l = 0; l < getNumLinks(); l++) {
+        unsigned long long used = nodeColors[m_link0[l]] | nodeColors[m_link1[l]];
+        int color = 0;
+        while (used & (1ull << color))
+            color++;
+        linkColor[l] = color;
+        nodeColors[m_link0[l]] |= 1ull << color;
+        nodeColors[m_link1[l]] |= 1ull << color;
+        numColors = std::max(numColors, color + 1);
+    }
+
+    // counting sort by color, links keep their index order inside a color
+    m_colorStart.assign(numColors + 1, 0);
+    for (int l = 0; l < getNumLinks(); l++)
+        m_colorStart[linkColor[l] + 1]++;
+    for (int c = 0; c < numColors; c++)
+        m_colorStart[c + 1] += m_colorStart[c];
+
+    m_colorLinks.resize(getNumLinks());
+    std::vector<int> next(m_colorStart.begin(), m_colorStart.end() - 1);
+    for (int l = 0; l < getNumLinks(); l++)
+        m_colorLinks[next[linkColor[l]]++] = l;
+}
+
+void SoACloth::clearForces(int first, int last) {
+    double gx = m_useGravity ? m_mass * m_gravity.x() : 0.0;
+    double gy = m_useGravity ? m_mass * m_gravity.y() : 0.0;
+    double gz = m_useGravity ? m_mass * m_gravity.z() : 0.0;
+
+    for (int i = first; i < last; i++) {
+        m_forceX[i] = gx + m_extForceX[i];
+        m_forceY[i] = gy + m_extForceY[i];
+        m_forceZ[i] = gz + m_extForceZ[i];
+        m_torqueX[i] = 0.0;
+        m_torqueY[i] = 0.0;
+        m_torqueZ[i] = 0.0;
+    }
+}
+
+void SoACloth::computeLinkForces(int first, int last) {
+    for (int l = first; l < last; l++)
+        computeLinkForce(l);
+}
+
+void SoACloth::computeLinkForce(int l) {
+    int n0 = m_link0[l];
+    int n1 = m_link1[l];
+
+    Vec3 link = { m_posX[n1] - m_posX[n0], m_posY[n1] - m_posY[n0], m_posZ[n1] - m_posZ[n0] };
+    double len = length(link);
+
+    // if distance too small, no forces are applied
+    if (len < 0.000001)
+        return;
+
+    // ELONGATION
+    double f = m_kElongation[l] * (len - m_length0[l]);
+    Vec3 force = scale(link, f / len);
+    m_forceX[n0] += force.x; m_forceY[n0] += force.y; m_forceZ[n0] += force.z;
+    m_forceX[n1] -= force.x; m_forceY[n1] -= force.y; m_forceZ[n1] -= force.z;
+
+    const double* r0 = &m_rot[9 * n0];
+    const double* r1 = &m_rot[9 * n1];
+
+    // FLEXION: each end node pulls the link back towards its rest direction
+    if (m_kFlexion[l] > 0.0) {
+        Vec3 ends[2] = { link, scale(link, -1.0) };
+        Vec3 wA[2] = { rotate(r0, &m_A0[3 * l]), rotate(r1, &m_A1[3 * l]) };
+        int self[2] = { n0, n1 };
+        int other[2] = { n1, n0 };
+
+        for (int e = 0; e < 2; e++) {
+            double a = angle(wA[e], ends[e]);
+            double torqueMag = a * m_kFlexion[l];
+            if (torqueMag < 0.0001)
+                continue;
+
+            Vec3 torqueDir = normalize(cross(wA[e], ends[e]));
+            m_torqueX[self[e]] += torqueMag * torqueDir.x;
+            m_torqueY[self[e]] += torqueMag * torqueDir.y;
+            m_torqueZ[self[e]] += torqueMag * torqueDir.z;
+
+            Vec3 bend = scale(normalize(cross(ends[e], torqueDir)), torqueMag / len);
+            m_forceX[other[e]] += bend.x; m_forceY[other[e]] += bend.y; m_forceZ[other[e]] += bend.z;
+            m_forceX[self[e]] -= bend.x; m_forceY[self[e]] -= bend.y; m_forceZ[self[e]] -= bend.z;
+        }
+    }
+
+    // TORSION: twist between the end node frames around the link
+    if (m_kTorsion[l] > 0.0) {
+        Vec3 n = scale(link, 1.0 / len);
+        Vec3 wB0 = rotate(r0, &m_B0[3 * l]);
+        Vec3 wB1 = rotate(r1, &m_B1[3 * l]);
+        wB0 = normalize(sub(wB0, scale(n, dot(wB0, n))));
+        wB1 = normalize(sub(wB1, scale(n, dot(wB1, n))));
+
+        double a = angle(wB0, wB1);
+        if (a > 0.0001) {
+            Vec3 torque = scale(normalize(cross(wB0, wB1)), a * m_kTorsion[l]);
+            m_torqueX[n0] += torque.x; m_torqueY[n0] += torque.y; m_torqueZ[n0] += torque.z;
+            m_torqueX[n1] -= torque.x; m_torqueY[n1] -= torque.y; m_torqueZ[n1] -= torque.z;
+        }
+    }
+}
+
+void SoACloth::integrate(double time, int first, int last) {
+    double invMass = 1.0 / m_mass;
+
+    // euler double integration for position
+    for (int i = first; i < last; i++) {
+        if (m_fixed[i])
+            continue;
+        double ax = (m_forceX[i] - m_kDampingPos * m_mass * m_velX[i]) * invMass;
+        double ay = (m_forceY[i] - m_kDampingPos * m_mass * m_velY[i]) * invMass;
+        double az = (m_forceZ[i] - m_kDampingPos * m_mass * m_velZ[i]) * invMass;
+        m_velX[i] += time * ax;
+        m_velY[i] += time * ay;
+        m_velZ[i] += time * az;
+        m_posX[i] += time * m_velX[i];
+        m_posY[i] += time * m_velY[i];
+        m_posZ[i] += time * m_velZ[i];
+    }
+
+    integrateRotations(time, first, last);
+}
+
+void SoACloth::integrateRotations(double time, int first, int last) {
+    double invInertia = (m_inertia > 0.0) ? 1.0 / m_inertia : 0.0;
+
+    for (int i = first; i < last; i++) {
+        // euler double integration for rotation
+        m_angVelX[i] += time * (m_torqueX[i] - m_kDampingRot * m_mass * m_angVelX[i]) * invInertia;
+        m_angVelY[i] += time * (m_torqueY[i] - m_kDampingRot * m_mass * m_angVelY[i]) * invInertia;
+        m_angVelZ[i] += time * (m_torqueZ[i] - m_kDampingRot * m_mass * m_angVelZ[i]) * invInertia;
+
+        Vec3 w = { m_angVelX[i], m_angVelY[i], m_angVelZ[i] };
+        double speed = length(w);
+        if (speed < 0.00001)
+            continue;
+
+        // rotate node frame about the global axis w by |w| * dt (rodrigues)
+        Vec3 k = scale(w, 1.0 / speed);
+        double a = speed * time;
+        double c = cos(a), s = sin(a), t = 1.0 - c;
+        double q[9] = { t * k.x * k.x + c,       t * k.x * k.y - s * k.z, t * k.x * k.z + s * k.y,
+                        t * k.x * k.y + s * k.z, t * k.y * k.y + c,       t * k.y * k.z - s * k.x,
+                        t * k.x * k.z - s * k.y, t * k.y * k.z + s * k.x, t * k.z * k.z + c };
+
+        double* r = &m_rot[9 * i];
+        double next[9];
+        for (int row = 0; row < 3; row++)
+            for (int col = 0; col < 3; col++)
+                next[3 * row + col] = q[3 * row + 0] * r[col] + q[3 * row + 1] * r[3 + col] + q[3 * row + 2] * r[6 + col];
+        std::copy(next, next + 9, r);
+    }
+}
+
+void SoACloth::updateDynamicsImplicit(double time) {
+    int n = getNumNodes();
+    if ((int)m_linkPair.size() != getNumLinks())
+        buildJacobianPattern();
+    if ((int)m_diagBlock.size() != 9 * n)
+        allocateImplicit();
+
+    // forces at the current state, flexion and torsion are only taken explicitly
+    clearForces(0, n);
+    computeLinkForces(0, getNumLinks());
+    assembleJacobian();
+
+    double h = time;
+    double massScale = 1.0 + h * m_kDampingPos;
+
+    // rhs = h (f - c M v - h J v)
+    double* v = m_product.data();
+    for (int i = 0; i < n; i++) {
+        v[3 * i + 0] = m_velX[i];
+        v[3 * i + 1] = m_velY[i];
+        v[3 * i + 2] = m_velZ[i];
+    }
+    multiply(0.0, h, v, m_residual.data());
+    for (int i = 0; i < n; i++) {
+        double f[3] = { m_forceX[i], m_forceY[i], m_forceZ[i] };
+        for (int d = 0; d < 3; d++) {
+            int k = 3 * i + d;
+            m_rhs[k] = m_fixed[i] ? 0.0 : h * (f[d] - m_kDampingPos * m_mass * v[k] - m_residual[k]);
+        }
+    }
+
+    // jacobi preconditioner from the diagonal blocks
+    for (int i = 0; i < n; i++)
+        for (int d = 0; d < 3; d++)
+            m_precond[3 * i + d] = m_fixed[i] ? 1.0 : 1.0 / (massScale * m_mass + h * h * m_diagBlock[9 * i + 4 * d]);
+
+    // preconditioned conjugate gradient, warm started with the previous dv
+    int size = 3 * n;
+    double* x = m_dv.data();
+    double* r = m_residual.data();
+    double* z = m_z.data();
+    double* p = m_direction.data();
+    double* q = m_product.data();
+
+    multiply(massScale, h * h, x, q);
+    double rhsNorm = 0.0;
+    double rz = 0.0;
+    for (int k = 0; k < size; k++) {
+        r[k] = m_rhs[k] - q[k];
+        z[k] = m_precond[k] * r[k];
+        p[k] = z[k];
+        rz += r[k] * z[k];
+        rhsNorm += m_rhs[k] * m_rhs[k];
+    }
+
+    double threshold = m_tolerance * m_tolerance * rhsNorm;
+    int iteration = 0;
+    for (; iteration < m_maxIterations; iteration++) {
+        double rr = 0.0;
+        for (int k = 0; k < size; k++)
+            rr += r[k] * r[k];
+        if (rr <= threshold)
+            break;
+
+        multiply(massScale, h * h, p, q);
+        double pq = 0.0;
+        for (int k = 0; k < size; k++)
+            pq += p[k] * q[k];
+        if (pq <= 0.0)
+            break;
+
+        double alpha = rz / pq;
+        double rzNext = 0.0;
+        for (int k = 0; k < size; k++) {
+            x[k] += alpha * p[k];
+            r[k] -= alpha * q[k];
+            z[k] = m_precond[k] * r[k];
+            rzNext += r[k] * z[k];
+        }
+
+        double beta = rzNext / rz;
+        rz = rzNext;
+        for (int k = 0; k < size; k++)
+            p[k] = z[k] + beta * p[k];
+    }
+    m_lastIterations = iteration;
+
+    for (int i = 0; i < n; i++) {
+        if (m_fixed[i])
+            continue;
+        m_velX[i] += x[3 * i + 0];
+        m_velY[i] += x[3 * i + 1];
+        m_velZ[i] += x[3 * i + 2];
+        m_posX[i] += h * m_velX[i];
+        m_posY[i] += h * m_velY[i];
+        m_posZ[i] += h * m_velZ[i];
+    }
+
+    integrateRotations(time, 0, n);
+}
+
+void SoACloth::buildJacobianPattern() {
+    // links between the same two nodes (neighbouring cells share an edge) add up in one block
+    std::map<std::pair<int, int>, int> pairs;
+    m_pair0.clear();
+    m_pair1.clear();
+    m_linkPair.resize(getNumLinks());
+    for (int l = 0; l < getNumLinks(); l++) {
+        std::pair<int, int> key(std::min(m_link0[l], m_link1[l]), std::max(m_link0[l], m_link1[l]));
+        auto it = pairs.find(key);
+        if (it == pairs.end()) {
+            it = pairs.insert(std::make_pair(key, (int)m_pair0.size())).first;
+            m_pair0.push_back(key.first);
+            m_pair1.push_back(key.second);
+        }
+        m_linkPair[l] = it->second;
+    }
+
+    // blocks are allocated for the new pattern by the next implicit step
+    m_diagBlock.clear();
+}
+
+void SoACloth::allocateImplicit() {
+    int n = getNumNodes();
+    m_pairBlock.assign(9 * m_pair0.size(), 0.0);
+    m_diagBlock.assign(9 * n, 0.0);
+    for (std::vector<double>* v : { &m_dv, &m_rhs, &m_residual, &m_precond, &m_z, &m_direction, &m_product })
+        v->assign(3 * n, 0.0);
+}
+
+void SoACloth::assembleJacobian() {
+    std::fill(m_pairBlock.begin(), m_pairBlock.end(), 0.0);
+    std::fill(m_diagBlock.begin(), m_diagBlock.end(), 0.0);
+
+    for (int l = 0; l < getNumLinks(); l++) {
+        int n0 = m_link0[l];
+        int n1 = m_link1[l];
+        Vec3 link = { m_posX[n1] - m_posX[n0], m_posY[n1] - m_posY[n0], m_posZ[n1] - m_posZ[n0] };
+        double len = length(link);
+        if (len < 0.000001)
+            continue;
+
+        // K = k ((1 - a) n n^T + a I), a = 1 - L / l, clamped at 0 so compressed links stay definite
+        Vec3 dir = scale(link, 1.0 / len);
+        double a = std::max(0.0, 1.0 - m_length0[l] / len);
+        double k = m_kElongation[l];
+        double nn[3] = { dir.x, dir.y, dir.z };
+        double block[9];
+        for (int row = 0; row < 3; row++)
+            for (int col = 0; col < 3; col++)
+                block[3 * row + col] = k * ((1.0 - a) * nn[row] * nn[col] + (row == col ? a : 0.0));
+
+        double* pair = &m_pairBlock[9 * m_linkPair[l]];
+        double* d0 = &m_diagBlock[9 * n0];
+        double* d1 = &m_diagBlock[9 * n1];
+        for (int e = 0; e < 9; e++) {
+            pair[e] += block[e];
+            d0[e] += block[e];
+            d1[e] += block[e];
+        }
+    }
+}
+
+void SoACloth::multiply(double massScale, double jScale, const double* x, double* y) const {
+    int n = getNumNodes();
+    for (int i = 0; i < n; i++) {
+        const double* d = &m_diagBlock[9 * i];
+        const double* xi = x + 3 * i;
+        for (int row = 0; row < 3; row++)
+            y[3 * i + row] = massScale * m_mass * xi[row] +
+                jScale * (d[3 * row + 0] * xi[0] + d[3 * row + 1] * xi[1] + d[3 * row + 2] * xi[2]);
+    }
+
+    // off diagonal blocks of J are -K, symmetric
+    for (int pr = 0; pr < (int)m_pair0.size(); pr++) {
+        const double* b = &m_pairBlock[9 * pr];
+        const double* x0 = x + 3 * m_pair0[pr];
+        const double* x1 = x + 3 * m_pair1[pr];
+        double* y0 = y + 3 * m_pair0[pr];
+        double* y1 = y + 3 * m_pair1[pr];
+        for (int row = 0; row < 3; row++) {
+            y0[row] -= jScale * (b[3 * row + 0] * x1[0] + b[3 * row + 1] * x1[1] + b[3 * row + 2] * x1[2]);
+            y1[row] -= jScale * (b[3 * row + 0] * x0[0] + b[3 * row + 1] * x0[1] + b[3 * row + 2] * x0[2]);
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (m_fixed[i]) {
+            y[3 * i + 0] = x[3 * i + 0];
+            y[3 * i + 1] = x[3 * i + 1];
+            y[3 * i + 2] = x[3 * i + 2];
+        }
+    }
+}
+
+void SoACloth::updateDynamicsXPBD(double time) {
+    int n = getNumNodes();
+    if ((int)m_colorLinks.size() != getNumLinks())
+        colorLinks();
+    if (!m_bendingBuilt)
+        buildBendingConstraints();
+
+    double h = time;
+    if (h <= 0.0)
+        return;
+
+    // predict, gravity and external forces act as forces, damping as in the explicit step
+    clearForces(0, n);
+    m_prevX.assign(m_posX.begin(), m_posX.end());
+    m_prevY.assign(m_posY.begin(), m_posY.end());
+    m_prevZ.assign(m_posZ.begin(), m_posZ.end());
+    double invMass = 1.0 / m_mass;
+    double damping = std::max(0.0, 1.0 - h * m_kDampingPos);
+    for (int i = 0; i < n; i++) {
+        if (m_fixed[i])
+            continue;
+        m_velX[i] = (m_velX[i] + h * m_forceX[i] * invMass) * damping;
+        m_velY[i] = (m_velY[i] + h * m_forceY[i] * invMass) * damping;
+        m_velZ[i] = (m_velZ[i] + h * m_forceZ[i] * invMass) * damping;
+        m_posX[i] += h * m_velX[i];
+        m_posY[i] += h * m_velY[i];
+        m_posZ[i] += h * m_velZ[i];
+    }
+
+    m_lambda.assign(getNumLinks(), 0.0);
+    m_bendLambda.assign(m_bendA.size(), 0.0);
+    double invH2 = 1.0 / (h * h);
+
+    auto project = [this, invH2](int thread, int numThreads) {
+        for (int iteration = 0; iteration < m_constraintIterations; iteration++) {
+            for (int color = 0; color < getNumColors(); color++) {
+                int first, last;
+                int count = m_colorStart[color + 1] - m_colorStart[color];
+                ThreadPool::split(count, thread, numThreads, first, last);
+                for (int k = m_colorStart[color] + first; k < m_colorStart[color] + last; k++)
+                    solveDistance(m_colorLinks[k], invH2);
+                if (m_pool)
+                    m_pool->barrier();
+            }
+
+            // triplets overlap a lot, they stay on one thread
+            if (thread == 0)
+                for (int bend = 0; bend < (int)m_bendA.size(); bend++)
+                    solveBending(bend, invH2);
+            if (m_pool)
+                m_pool->barrier();
+        }
+    };
+    if (m_pool)
+        m_pool->run(project);
+    else
+        project(0, 1);
+    m_lastIterations = m_constraintIterations;
+
+    // velocities from the corrected positions, point constraints carry no node rotation
+    for (int i = 0; i < n; i++) {
+        if (m_fixed[i])
+            continue;
+        m_velX[i] = (m_posX[i] - m_prevX[i]) / h;
+        m_velY[i] = (m_posY[i] - m_prevY[i]) / h;
+        m_velZ[i] = (m_posZ[i] - m_prevZ[i]) / h;
+    }
+}
+
+void SoACloth::solveDistance(int l, double invH2) {
+    int n0 = m_link0[l];
+    int n1 = m_link1[l];
+    double w0 = m_fixed[n0] ? 0.0 : 1.0 / m_mass;
+    double w1 = m_fixed[n1] ? 0.0 : 1.0 / m_mass;
+    if (w0 + w1 == 0.0 || m_kElongation[l] <= 0.0)
+        return;
+
+    Vec3 link = { m_posX[n1] - m_posX[n0], m_posY[n1] - m_posY[n0], m_posZ[n1] - m_posZ[n0] };
+    double len = length(link);
+    if (len < 0.000001)
+        return;
+
+    // compliance is the inverse link stiffness, scaled by 1 / h^2
+    double alphaTilde = invH2 / m_kElongation[l];
+    double c = len - m_length0[l];
+    double dLambda = (-c - alphaTilde * m_lambda[l]) / (w0 + w1 + alphaTilde);
+    m_lambda[l] += dLambda;
+
+    Vec3 corr = scale(link, dLambda / len);
+    m_posX[n0] -= w0 * corr.x; m_posY[n0] -= w0 * corr.y; m_posZ[n0] -= w0 * corr.z;
+    m_posX[n1] += w1 * corr.x; m_posY[n1] += w1 * corr.y; m_posZ[n1] += w1 * corr.z;
+}
+
+void SoACloth::solveBending(int bend, double invH2) {
+    int a = m_bendA[bend];
+    int o = m_bendCenter[bend];
+    int b = m_bendB[bend];
+    double wa = m_fixed[a] ? 0.0 : 1.0 / m_mass;
+    double wo = m_fixed[o] ? 0.0 : 1.0 / m_mass;
+    double wb = m_fixed[b] ? 0.0 : 1.0 / m_mass;
+    if (m_bendStiffness[bend] <= 0.0)
+        return;
+
+    // C = angle between (o - a) and (b - o), zero when straight as at rest
+    Vec3 e1 = { m_posX[o] - m_posX[a], m_posY[o] - m_posY[a], m_posZ[o] - m_posZ[a] };
+    Vec3 e2 = { m_posX[b] - m_posX[o], m_posY[b] - m_posY[o], m_posZ[b] - m_posZ[o] };
+    double l1 = length(e1);
+    double l2 = length(e2);
+    if (l1 < 0.000001 || l2 < 0.000001)
+        return;
+    Vec3 d1 = scale(e1, 1.0 / l1);
+    Vec3 d2 = scale(e2, 1.0 / l2);
+    double c = angle(d1, d2);
+    if (c < 0.0001)
+        return;
+
+    // dC/dd = -(other - (d1.d2) d) / (l sin C), through the unit directions
+    double cosine = dot(d1, d2);
+    double invSin = 1.0 / sin(c);
+    Vec3 g1 = scale(sub(d2, scale(d1, cosine)), -invSin / l1);
+    Vec3 g2 = scale(sub(d1, scale(d2, cosine)), -invSin / l2);
+    Vec3 ga = scale(g1, -1.0);
+    Vec3 gb = g2;
+    Vec3 go = sub(g1, g2);
+
+    double alphaTilde = invH2 / m_bendStiffness[bend];
+    double denominator = wa * dot(ga, ga) + wo * dot(go, go) + wb * dot(gb, gb) + alphaTilde;
+    if (denominator < 0.0000001)
+        return;
+    double dLambda = (-c - alphaTilde * m_bendLambda[bend]) / denominator;
+    m_bendLambda[bend] += dLambda;
+
+    m_posX[a] += wa * dLambda * ga.x; m_posY[a] += wa * dLambda * ga.y; m_posZ[a] += wa * dLambda * ga.z;
+    m_posX[o] += wo * dLambda * go.x; m_posY[o] += wo * dLambda * go.y; m_posZ[o] += wo * dLambda * go.z;
+    m_posX[b] += wb * dLambda * gb.x; m_posY[b] += wb * dLambda * gb.y; m_posZ[b] += wb * dLambda * gb.z;
+}
+
+void SoACloth::buildBendingConstraints() {
+    int n = getNumNodes();
+
+    // distinct neighbours of every node with the flexion of the link to them
+    std::vector<std::vector<std::pair<int, double>>> neighbours(n);
+    for (int l = 0; l < getNumLinks(); l++) {
+        int ends[2] = { m_link0[l], m_link1[l] };
+        for (int e = 0; e < 2; e++) {
+            std::vector<std::pair<int, double>>& list = neighbours[ends[e]];
+            int other = ends[1 - e];
+            auto it = std::find_if(list.begin(), list.end(), [other](const std::pair<int, double>& p) { return p.first == other; });
+            if (it == list.end())
+                list.push_back(std::make_pair(other, m_kFlexion[l]));
+        }
+    }
+
+    m_bendA.clear();
+    m_bendCenter.clear();
+    m_bendB.clear();
+    m_bendStiffness.clear();
+    for (int o = 0; o < n; o++) {
+        const std::vector<std::pair<int, double>>& list = neighbours[o];
+        for (size_t p = 0; p < list.size(); p++) {
+            for (size_t q = p + 1; q < list.size(); q++) {
+                int a = list[p].first;
+                int b = list[q].first;
+                Vec3 ea = { m_posX[a] - m_posX[o], m_posY[a] - m_posY[o], m_posZ[a] - m_posZ[o] };
+                Vec3 eb = { m_posX[b] - m_posX[o], m_posY[b] - m_posY[o], m_posZ[b] - m_posZ[o] };
+                if (dot(normalize(ea), normalize(eb)) > -0.99)
+                    continue;
+                m_bendA.push_back(a);
+                m_bendCenter.push_back(o);
+                m_bendB.push_back(b);
+                m_bendStiffness.push_back(0.5 * (list[p].second + list[q].second));
+            }
+        }
+    }
+    m_bendingBuilt = true;
+}
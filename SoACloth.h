@@ -0,0 +1,235 @@
+#pragma once
+
+#include <vector>
+
+#include "chai3d.h"
+
+class ThreadPool;
+
+// how SoACloth::updateDynamics advances node positions
+enum class SoAIntegrator
+{
+	Explicit,	// euler, same as GEL
+	Implicit,	// linearized backward euler for elongation, flexion and torsion stay explicit
+	XPBD		// compliant position constraints, links as distances and flexion as bending angles
+};
+
+// flat view of everything a SoACloth derives from its rest shape: nodes, links with their rest
+// frames, link colors, the jacobian pattern and the bending triplets. arrays are owned by whoever
+// filled it (the cloth for getTopology, a mapped file for SceneFile)
+struct SoAClothTopology
+{
+	int numNodes;
+	int numLinks;
+	int numColors;
+	int numPairs;
+	int numBends;
+
+	// numNodes each
+	const double* posX;
+	const double* posY;
+	const double* posZ;
+	const unsigned char* fixed;
+
+	// numLinks each, A0/A1/B0/B1 3 per link
+	const int* link0;
+	const int* link1;
+	const double* length0;
+	const double* kElongation;
+	const double* kFlexion;
+	const double* kTorsion;
+	const double* A0;
+	const double* A1;
+	const double* B0;
+	const double* B1;
+
+	// numLinks and numColors + 1
+	const int* colorLinks;
+	const int* colorStart;
+
+	// numPairs each, linkPair numLinks
+	const int* pair0;
+	const int* pair1;
+	const int* linkPair;
+
+	// numBends each
+	const int* bendA;
+	const int* bendCenter;
+	const int* bendB;
+	const double* bendStiffness;
+};
+
+// a mass-spring cloth stored as flat structure-of-arrays, mirrors the GEL skeleton model
+// (same node integration and elongation/flexion/torsion link springs) without per-object
+// heap allocations, so a step streams through contiguous memory
+
+class SoACloth
+{
+	friend class ChaiWorld;
+	friend class Deformable;
+	friend class ClothRefinement;
+	friend class ReducedCloth;
+
+public:
+	SoACloth();
+	~SoACloth() = default;
+
+	// node properties shared by all nodes, same meaning as cGELSkeletonNode members
+	void setNodeProperties(double mass, double inertia, double kDampingPos, double kDampingRot,
+		bool useGravity, const chai3d::cVector3d& gravity);
+
+	// topology, returns the index of the new element
+	int addNode(const chai3d::cVector3d& pos, bool fixed = false);
+	int addLink(int node0, int node1, double kElongation, double kFlexion, double kTorsion);
+
+	void reserve(int numNodes, int numLinks);
+
+	// view of the current topology, the parts built lazily by the integrators are built first.
+	// valid until the topology changes
+	void getTopology(SoAClothTopology& topology);
+
+	// replace all nodes and links by a topology taken from getTopology of a cloth with the same
+	// rest shape, nodes start at rest with identity frames
+	void setTopology(const SoAClothTopology& topology);
+
+	int getNumNodes() const { return (int)m_posX.size(); }
+	int getNumLinks() const { return (int)m_link0.size(); }
+
+	chai3d::cVector3d getNodePos(int index) const { return chai3d::cVector3d(m_posX[index], m_posY[index], m_posZ[index]); }
+	chai3d::cMatrix3d getNodeRot(int index) const;
+
+	void setExternalForce(int index, const chai3d::cVector3d& force);
+	void clearExternalForces();
+
+	void setLinkElongation(int index, double kElongation) { m_kElongation[index] = kElongation; }
+
+	// step on the threads of pool, nullptr for a single threaded step. links are processed by
+	// color, links of one color share no node, so forces are accumulated without atomics and
+	// in the same order for any thread count (not the order of the single threaded step)
+	void setThreadPool(ThreadPool* pool) { m_pool = pool; }
+	ThreadPool* getThreadPool() { return m_pool; }
+	int getNumColors() const { return m_colorStart.empty() ? 0 : (int)m_colorStart.size() - 1; }
+
+	void setIntegrator(SoAIntegrator integrator) { m_integrator = integrator; }
+	SoAIntegrator getIntegrator() const { return m_integrator; }
+
+	// conjugate gradient limits of the implicit integrator, the residual is relative to the rhs
+	void setSolverLimits(int maxIterations, double tolerance) { m_maxIterations = maxIterations; m_tolerance = tolerance; }
+	int getLastIterations() const { return m_lastIterations; }
+
+	// XPBD constraint iterations per step, always all of them so a step has a fixed cost
+	void setConstraintIterations(int iterations) { m_constraintIterations = iterations; }
+	int getConstraintIterations() const { return m_constraintIterations; }
+
+	// one integration step, equivalent to cGELWorld::updateDynamics for SoAIntegrator::Explicit
+	void updateDynamics(double time);
+
+private:
+	void clearForces(int first, int last);
+	void computeLinkForce(int link);
+	void computeLinkForces(int first, int last);
+	void integrate(double time, int first, int last);
+	void integrateRotations(double time, int first, int last);
+
+	// implicit step: (M (1 + h c) + h^2 J) dv = h (f - c M v - h J v), J = -df/dx of the
+	// elongation springs, solved with jacobi preconditioned CG warm started from the last dv
+	void updateDynamicsImplicit(double time);
+
+	// node pairs of the links (duplicate links share a pair), built once per topology
+	void buildJacobianPattern();
+
+	// jacobian blocks and solver vectors for the current pattern
+	void allocateImplicit();
+
+	// XPBD step: predict with external forces, project constraints, derive velocities.
+	// distance constraints run by link color, so threads never touch the same node
+	void updateDynamicsXPBD(double time);
+
+	// bending triplets (a, center, b) of links that are collinear through center at rest
+	void buildBendingConstraints();
+
+	void solveDistance(int link, double invH2);
+	void solveBending(int bend, double invH2);
+
+	// fill the 3x3 blocks of J at the current positions
+	void assembleJacobian();
+
+	// y = massScale * M x + jScale * J x, identity rows for fixed nodes
+	void multiply(double massScale, double jScale, const double* x, double* y) const;
+
+	// greedy coloring of the links in index order, rebuilt when links were added
+	void colorLinks();
+
+	// node state
+	std::vector<double> m_posX, m_posY, m_posZ;
+	std::vector<double> m_velX, m_velY, m_velZ;
+	std::vector<double> m_forceX, m_forceY, m_forceZ;
+	std::vector<double> m_extForceX, m_extForceY, m_extForceZ;
+
+	// orientation as row major 3x3 per node, angular velocity and torque
+	std::vector<double> m_rot;
+	std::vector<double> m_angVelX, m_angVelY, m_angVelZ;
+	std::vector<double> m_torqueX, m_torqueY, m_torqueZ;
+
+	std::vector<unsigned char> m_fixed;
+
+	// link endpoints and springs
+	std::vector<int> m_link0;
+	std::vector<int> m_link1;
+	std::vector<double> m_length0;
+	std::vector<double> m_kElongation;
+	std::vector<double> m_kFlexion;
+	std::vector<double> m_kTorsion;
+
+	// rest link direction (A) and a rest normal to it (B) in each end node frame, 3 per link
+	std::vector<double> m_A0, m_A1;
+	std::vector<double> m_B0, m_B1;
+
+	// links sorted by color, color c is m_colorLinks[m_colorStart[c] .. m_colorStart[c + 1])
+	std::vector<int> m_colorLinks;
+	std::vector<int> m_colorStart;
+
+	ThreadPool* m_pool;
+
+	SoAIntegrator m_integrator;
+	int m_maxIterations;
+	double m_tolerance;
+	int m_lastIterations;
+
+	// sparse spring jacobian: one symmetric 3x3 block per node pair (off diagonal, negated)
+	// and per node (diagonal), 9 doubles each
+	std::vector<int> m_pair0;
+	std::vector<int> m_pair1;
+	std::vector<int> m_linkPair;
+	std::vector<double> m_pairBlock;
+	std::vector<double> m_diagBlock;
+
+	// XPBD state: positions at the start of the step, lagrange multipliers of the links and of
+	// the bending triplets, and the triplets with their rest angle 0
+	int m_constraintIterations;
+	std::vector<double> m_prevX, m_prevY, m_prevZ;
+	std::vector<double> m_lambda;
+	std::vector<int> m_bendA;
+	std::vector<int> m_bendCenter;
+	std::vector<int> m_bendB;
+	std::vector<double> m_bendStiffness;
+	std::vector<double> m_bendLambda;
+	bool m_bendingBuilt;
+
+	// solver vectors, 3 per node interleaved
+	std::vector<double> m_dv;
+	std::vector<double> m_rhs;
+	std::vector<double> m_residual;
+	std::vector<double> m_precond;
+	std::vector<double> m_z;
+	std::vector<double> m_direction;
+	std::vector<double> m_product;
+
+	// shared node properties
+	double m_mass;
+	double m_inertia;
+	double m_kDampingPos;
+	double m_kDampingRot;
+	bool m_useGravity;
+	chai3d::cVector3d m_gravity;
+};
@@ -0,0 +1,135 @@
+#include "SpatialHash.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+    // 21 bits per axis, cells are signed around the origin
+    const int64_t CELL_BITS = 21;
+    const int64_t CELL_MASK = (int64_t(1) << CELL_BITS) - 1;
+
+    inline int64_t packCell(int64_t ix, int64_t iy, int64_t iz) {
+        return ((ix & CELL_MASK) << (2 * CELL_BITS)) | ((iy & CELL_MASK) << CELL_BITS) | (iz & CELL_MASK);
+    }
+
+    inline size_t nextPowerOfTwo(size_t n) {
+        size_t p = 1;
+        while (p < n)
+            p *= 2;
+        return p;
+    }
+}
+
+SpatialHash::SpatialHash(double cellSize, int numBuckets) :
+    m_cellSize(cellSize), m_invCellSize(1.0 / cellSize), m_buckets(nextPowerOfTwo(std::max(numBuckets, 1))) {
+    m_bucketMask = m_buckets.size() - 1;
+}
+
+void SpatialHash::setCellSize(double cellSize) {
+    m_cellSize = cellSize;
+    m_invCellSize = 1.0 / cellSize;
+    for (std::vector<int>& bucket : m_buckets)
+        bucket.clear();
+    m_pointCell.clear();
+    m_pointBucket.clear();
+    m_pointSlot.clear();
+}
+
+int64_t SpatialHash::cellKey(double x, double y, double z) const {
+    return packCell((int64_t)floor(x * m_invCellSize), (int64_t)floor(y * m_invCellSize), (int64_t)floor(z * m_invCellSize));
+}
+
+int SpatialHash::bucketOf(int64_t key) const {
+    // large primes mixing of the packed key (Teschner et al. 2003)
+    uint64_t h = (uint64_t)key * 0x9E3779B97F4A7C15ull;
+    return (int)((h >> 32) & m_bucketMask);
+}
+
+void SpatialHash::insert(int point, int bucket) {
+    m_pointBucket[point] = bucket;
+    m_pointSlot[point] = (int)m_buckets[bucket].size();
+    m_buckets[bucket].push_back(point);
+}
+
+void SpatialHash::remove(int point) {
+    // swap with the last point of the bucket
+    std::vector<int>& bucket = m_buckets[m_pointBucket[point]];
+    int slot = m_pointSlot[point];
+    int last = bucket.back();
+    bucket[slot] = last;
+    m_pointSlot[last] = slot;
+    bucket.pop_back();
+}
+
+void SpatialHash::build(const double* x, const double* y, const double* z, int count) {
+    for (std::vector<int>& bucket : m_buckets)
+        bucket.clear();
+
+    // a few points per occupied bucket at most, however large the cloth
+    size_t numBuckets = nextPowerOfTwo(2 * (size_t)count);
+    if (numBuckets > m_buckets.size()) {
+        m_buckets.resize(numBuckets);
+        m_bucketMask = numBuckets - 1;
+    }
+
+    m_pointCell.resize(count);
+    m_pointBucket.resize(count);
+    m_pointSlot.resize(count);
+
+    for (int i = 0; i < count; i++) {
+        m_pointCell[i] = cellKey(x[i], y[i], z[i]);
+        insert(i, bucketOf(m_pointCell[i]));
+    }
+}
+
+void SpatialHash::update(const double* x, const double* y, const double* z, int count) {
+    if (count != (int)m_pointCell.size()) {
+        build(x, y, z, count);
+        return;
+    }
+
+    for (int i = 0; i < count; i++)
+        move(i, x[i], y[i], z[i]);
+}
+
+void SpatialHash::updateRange(const double* x, const double* y, const double* z, int first, int last) {
+    for (int i = first; i < last; i++)
+        move(i, x[i], y[i], z[i]);
+}
+
+void SpatialHash::move(int point, double x, double y, double z) {
+    int64_t key = cellKey(x, y, z);
+    if (key == m_pointCell[point])
+        return;
+
+    m_pointCell[point] = key;
+    int bucket = bucketOf(key);
+    if (bucket == m_pointBucket[point])
+        return;
+
+    remove(point);
+    insert(point, bucket);
+}
+
+void SpatialHash::query(const chai3d::cVector3d& center, double radius, std::vector<int>& result) const {
+    int64_t minX = (int64_t)floor((center.x() - radius) * m_invCellSize);
+    int64_t minY = (int64_t)floor((center.y() - radius) * m_invCellSize);
+    int64_t minZ = (int64_t)floor((center.z() - radius) * m_invCellSize);
+    int64_t maxX = (int64_t)floor((center.x() + radius) * m_invCellSize);
+    int64_t maxY = (int64_t)floor((center.y() + radius) * m_invCellSize);
+    int64_t maxZ = (int64_t)floor((center.z() + radius) * m_invCellSize);
+
+    // only the points of the cell itself, every point is in one cell so none is returned twice
+    for (int64_t ix = minX; ix <= maxX; ix++) {
+        for (int64_t iy = minY; iy <= maxY; iy++) {
+            for (int64_t iz = minZ; iz <= maxZ; iz++) {
+                int64_t key = packCell(ix, iy, iz);
+                for (int point : m_buckets[bucketOf(key)]) {
+                    if (m_pointCell[point] == key)
+                        result.push_back(point);
+                }
+            }
+        }
+    }
+}
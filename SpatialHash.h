@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "chai3d.h"
+
+// uniform grid over point positions, hashed into at least twice as many buckets as points.
+// update() only touches the buckets of points that changed cell, so a mostly resting cloth
+// costs one cell computation per point. query() only returns the points of the cells it
+// covers, whatever else shares their buckets, so its cost does not grow with the cloth
+
+class SpatialHash
+{
+public:
+	// numBuckets is the minimum, build() grows it with the number of points
+	SpatialHash(double cellSize = 0.15, int numBuckets = 4096);
+	~SpatialHash() = default;
+
+	// changing the cell size drops all points, call build() afterwards
+	void setCellSize(double cellSize);
+	double getCellSize() { return m_cellSize; }
+
+	// insert all points from scratch
+	void build(const double* x, const double* y, const double* z, int count);
+
+	// move points whose cell changed since the last build/update, rebuilds if count changed
+	void update(const double* x, const double* y, const double* z, int count);
+
+	// the same for points first .. last - 1 only, indices into x, y, z and the built points
+	void updateRange(const double* x, const double* y, const double* z, int first, int last);
+
+	// append the indices of all points in cells overlapping the sphere, may contain points
+	// outside of it (cell granularity) but never misses one inside
+	void query(const chai3d::cVector3d& center, double radius, std::vector<int>& result) const;
+
+	int getNumPoints() { return (int)m_pointCell.size(); }
+
+private:
+	int64_t cellKey(double x, double y, double z) const;
+	int bucketOf(int64_t key) const;
+
+	void insert(int point, int bucket);
+	void remove(int point);
+
+	// move a point to the cell of its new position if that changed
+	void move(int point, double x, double y, double z);
+
+	double m_cellSize;
+	double m_invCellSize;
+
+	// points of each bucket, a power of two of them
+	std::vector<std::vector<int>> m_buckets;
+	uint64_t m_bucketMask;
+
+	// per point: packed cell coordinates, bucket and position inside the bucket
+	std::vector<int64_t> m_pointCell;
+	std::vector<int> m_pointBucket;
+	std::vector<int> m_pointSlot;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// lock-free single producer / single consumer ring of fixed capacity. push never waits, it
+// fails when the ring is full, so a real-time producer drops data instead of stalling
+
+template <typename T>
+class SpscRing
+{
+public:
+	// capacity is rounded up to a power of two
+	explicit SpscRing(size_t capacity) : m_head(0), m_tail(0) {
+		size_t size = 1;
+		while (size < capacity)
+			size <<= 1;
+		m_items.resize(size);
+		m_mask = size - 1;
+	}
+	~SpscRing() = default;
+
+	// not copyable
+	SpscRing(const SpscRing&) = delete;
+	SpscRing& operator= (const SpscRing&) = delete;
+
+	// producer thread: returns false if the ring is full
+	bool push(const T& item) {
+		size_t head = m_head.load(std::memory_order_relaxed);
+		if (head - m_tail.load(std::memory_order_acquire) > m_mask)
+			return false;
+		m_items[head & m_mask] = item;
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// consumer thread: move up to maxCount items to out, returns their number
+	size_t pop(T* out, size_t maxCount) {
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		size_t count = m_head.load(std::memory_order_acquire) - tail;
+		if (count > maxCount)
+			count = maxCount;
+		for (size_t k = 0; k < count; k++)
+			out[k] = m_items[(tail + k) & m_mask];
+		m_tail.store(tail + count, std::memory_order_release);
+		return count;
+	}
+
+	size_t getCapacity() const { return m_mask + 1; }
+
+private:
+	std::vector<T> m_items;
+	size_t m_mask;
+
+	// written by the producer and the consumer only, on separate cache lines
+	alignas(64) std::atomic<size_t> m_head;
+	alignas(64) std::atomic<size_t> m_tail;
+};
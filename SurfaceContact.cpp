@@ -0,0 +1,269 @@
+#include "SurfaceContact.h"
+
+#include <cfloat>
+#include <cmath>
+
+namespace {
+    // the proxy touches the surface closer than this share of its radius
+    const double kTouchTolerance = 0.001;
+
+    // planes and conservative steps per tick, the proxy stops short rather than pass through
+    const int kMaxIterations = 4;
+    const int kAdvanceSteps = 32;
+
+    const double kTiny = 0.0000001;
+
+    // closest point of triangle abc to p with its barycentric weights (Ericson, Real-Time Collision Detection 5.1.5)
+    chai3d::cVector3d closestOnTriangle(const chai3d::cVector3d& p, const chai3d::cVector3d& a,
+        const chai3d::cVector3d& b, const chai3d::cVector3d& c, double* weights) {
+        chai3d::cVector3d ab = b - a;
+        chai3d::cVector3d ac = c - a;
+        chai3d::cVector3d ap = p - a;
+        double d1 = ab.dot(ap);
+        double d2 = ac.dot(ap);
+        if (d1 <= 0.0 && d2 <= 0.0) {
+            weights[0] = 1.0; weights[1] = 0.0; weights[2] = 0.0;
+            return a;
+        }
+
+        chai3d::cVector3d bp = p - b;
+        double d3 = ab.dot(bp);
+        double d4 = ac.dot(bp);
+        if (d3 >= 0.0 && d4 <= d3) {
+            weights[0] = 0.0; weights[1] = 1.0; weights[2] = 0.0;
+            return b;
+        }
+
+        double vc = d1 * d4 - d3 * d2;
+        if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) {
+            double v = d1 / (d1 - d3);
+            weights[0] = 1.0 - v; weights[1] = v; weights[2] = 0.0;
+            return a + ab * v;
+        }
+
+        chai3d::cVector3d cp = p - c;
+        double d5 = ab.dot(cp);
+        double d6 = ac.dot(cp);
+        if (d6 >= 0.0 && d5 <= d6) {
+            weights[0] = 0.0; weights[1] = 0.0; weights[2] = 1.0;
+            return c;
+        }
+
+        double vb = d5 * d2 - d1 * d6;
+        if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) {
+            double w = d2 / (d2 - d6);
+            weights[0] = 1.0 - w; weights[1] = 0.0; weights[2] = w;
+            return a + ac * w;
+        }
+
+        double va = d3 * d6 - d5 * d4;
+        if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0) {
+            double w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+            weights[0] = 0.0; weights[1] = 1.0 - w; weights[2] = w;
+            return b + (c - b) * w;
+        }
+
+        double denom = 1.0 / (va + vb + vc);
+        double v = vb * denom;
+        double w = vc * denom;
+        weights[0] = 1.0 - v - w; weights[1] = v; weights[2] = w;
+        return a + ab * v + ac * w;
+    }
+}
+
+SurfaceContact::SurfaceContact() : m_proxy(0.0, 0.0, 0.0), m_active(false), m_numContactNodes(0) {
+    m_closest.triangle = -1;
+    m_closest.distance = DBL_MAX;
+}
+
+void SurfaceContact::attach(int width, int length, const double* x, const double* y, const double* z) {
+    // two triangles per cell, the diagonal alternates like the Polygons mesh
+    m_indices.clear();
+    m_indices.reserve((width - 1) * (length - 1) * 2 * 3);
+    for (int i = 0; i < length - 1; i++) {
+        for (int j = 0; j < width - 1; j++) {
+            int i0 = i * width + j;
+            int i1 = i0 + 1;
+            int i2 = i0 + width;
+            int i3 = i2 + 1;
+            if ((j + i) % 2) {
+                m_indices.insert(m_indices.end(), { i0, i2, i1 });
+                m_indices.insert(m_indices.end(), { i1, i2, i3 });
+            }
+            else {
+                m_indices.insert(m_indices.end(), { i0, i2, i3 });
+                m_indices.insert(m_indices.end(), { i0, i3, i1 });
+            }
+        }
+    }
+
+    // the tree is split on these positions once, refit keeps its topology
+    m_positions.resize(width * length);
+    setNodePositions(x, y, z);
+    m_bvh.build(m_indices, m_positions);
+
+    m_active = false;
+    m_numContactNodes = 0;
+}
+
+void SurfaceContact::setNodePositions(const double* x, const double* y, const double* z) {
+    for (int index = 0; index < (int)m_positions.size(); index++)
+        m_positions[index].set(x[index], y[index], z[index]);
+}
+
+void SurfaceContact::setNodePos(int node, const chai3d::cVector3d& pos) {
+    m_positions[node] = pos;
+}
+
+bool SurfaceContact::getSurfacePoint(chai3d::cVector3d& point) const {
+    if (m_closest.triangle < 0)
+        return false;
+    point = m_closest.point;
+    return true;
+}
+
+SurfaceContact::Closest SurfaceContact::findClosest(const chai3d::cVector3d& point) const {
+    Closest closest;
+    closest.triangle = -1;
+    closest.distance = DBL_MAX;
+    for (int t : m_candidates) {
+        double weights[3];
+        chai3d::cVector3d onTriangle = closestOnTriangle(point, m_positions[m_indices[3 * t]],
+            m_positions[m_indices[3 * t + 1]], m_positions[m_indices[3 * t + 2]], weights);
+        double distance = (point - onTriangle).length();
+        if (distance < closest.distance) {
+            closest.point = onTriangle;
+            closest.triangle = t;
+            closest.distance = distance;
+            closest.weights[0] = weights[0];
+            closest.weights[1] = weights[1];
+            closest.weights[2] = weights[2];
+        }
+    }
+    return closest;
+}
+
+void SurfaceContact::pushOut(double radius) {
+    // a fold can hold the proxy between two sheets, a few passes settle it
+    for (int iteration = 0; iteration < kMaxIterations; iteration++) {
+        Closest closest = findClosest(m_proxy);
+        if (closest.triangle < 0 || closest.distance >= radius)
+            return;
+
+        chai3d::cVector3d normal;
+        if (closest.distance > kTiny) {
+            normal = (m_proxy - closest.point) / closest.distance;
+        }
+        else {
+            // on the surface, either side will do
+            const chai3d::cVector3d& a = m_positions[m_indices[3 * closest.triangle]];
+            const chai3d::cVector3d& b = m_positions[m_indices[3 * closest.triangle + 1]];
+            const chai3d::cVector3d& c = m_positions[m_indices[3 * closest.triangle + 2]];
+            normal = (b - a).cross(c - a);
+            if (normal.length() < kTiny)
+                return;
+            normal.normalize();
+        }
+        m_proxy = closest.point + normal * radius;
+    }
+}
+
+bool SurfaceContact::advance(const chai3d::cVector3d& target, double radius, chai3d::cVector3d& normal) {
+    // conservative advancement: the proxy can move as far as its gap to the surface without
+    // touching it, so it never tunnels through the sheet however thin
+    for (int step = 0; step < kAdvanceSteps; step++) {
+        chai3d::cVector3d remaining = target - m_proxy;
+        double length = remaining.length();
+        if (length < kTiny)
+            return false;
+
+        Closest closest = findClosest(m_proxy);
+        if (closest.triangle < 0) {
+            m_proxy = target;
+            return false;
+        }
+
+        double gap = closest.distance - radius;
+        if (gap < kTouchTolerance * radius) {
+            normal = (m_proxy - closest.point) / closest.distance;
+            if (remaining.dot(normal) < -kTiny * length)
+                return true;
+
+            // along or away from the surface the proxy only sinks in by its curvature, step and
+            // push it back out
+            m_proxy = target;
+            pushOut(radius);
+            return false;
+        }
+
+        if (gap >= length) {
+            m_proxy = target;
+            return false;
+        }
+        m_proxy += remaining * (gap / length);
+    }
+    return false;
+}
+
+chai3d::cVector3d SurfaceContact::computeForce(const chai3d::cVector3d& cursor, double radius, double stiffness) {
+    m_bvh.refit(m_positions);
+    m_numContactNodes = 0;
+
+    if (!m_active) {
+        m_proxy = cursor;
+        m_active = true;
+    }
+
+    // the proxy never ends up farther from the cursor than it starts plus the push out of the
+    // surface, the triangles it can touch on the way are within its radius of that
+    m_candidates.clear();
+    m_bvh.querySphere(cursor, (cursor - m_proxy).length() + 2.0 * radius, m_candidates);
+
+    // the surface moved into the proxy since the last tick
+    pushOut(radius);
+
+    // god object: advance to the cursor, on each plane touched slide toward the projection of the
+    // cursor on the planes touched so far
+    chai3d::cVector3d target = cursor;
+    chai3d::cVector3d planes[2];
+    int numPlanes = 0;
+    for (int iteration = 0; iteration < kMaxIterations; iteration++) {
+        chai3d::cVector3d normal;
+        if (!advance(target, radius, normal))
+            break;
+
+        // a third plane holds the proxy in a corner
+        if (numPlanes == 2)
+            break;
+        planes[numPlanes++] = normal;
+
+        chai3d::cVector3d offset = cursor - m_proxy;
+        target = cursor - normal * offset.dot(normal);
+        if (numPlanes == 2) {
+            // the last plane alone unless the slide on it goes into the first one
+            if (planes[0].dot(target - m_proxy) >= 0.0) {
+                planes[0] = normal;
+                numPlanes = 1;
+            }
+            else {
+                chai3d::cVector3d crease = planes[0].cross(planes[1]);
+                if (crease.length() < kTiny)
+                    break;
+                crease.normalize();
+                target = m_proxy + crease * offset.dot(crease);
+            }
+        }
+    }
+
+    // reaction on the nodes of the triangle under the proxy
+    m_closest = findClosest(m_proxy);
+    chai3d::cVector3d force = (m_proxy - cursor) * stiffness;
+    if (m_closest.triangle >= 0 && (m_proxy - cursor).length() > kTiny) {
+        m_numContactNodes = 3;
+        for (int k = 0; k < 3; k++) {
+            m_contactNodes[k] = m_indices[3 * m_closest.triangle + k];
+            m_contactWeights[k] = m_closest.weights[k];
+        }
+    }
+    return force;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+
+#include "chai3d.h"
+
+#include "TriangleBVH.h"
+
+// cursor contact with the triangle surface of a cloth grid instead of its node spheres. the
+// surface through the node centers is kept in a TriangleBVH refitted every tick, and a proxy
+// (god object) of the cursor radius follows the cursor without passing through it: it advances
+// until it touches the surface, then slides along the planes it touches toward the cursor. the
+// force on the cursor pulls it to the proxy, its reaction goes to the three nodes of the touched
+// triangle by their barycentric weights. the surface is two-sided and thin, the proxy stays on the
+// side it came from and the force does not depend on how far apart the nodes are
+
+class SurfaceContact
+{
+public:
+	SurfaceContact();
+	~SurfaceContact() = default;
+
+	// grid of width x length nodes, node (i, j) at i * width + j, triangulated like Polygons. the
+	// tree is split on these packed positions
+	void attach(int width, int length, const double* x, const double* y, const double* z);
+
+	// surface for the next computeForce, all nodes from packed coordinates or a single node
+	void setNodePositions(const double* x, const double* y, const double* z);
+	void setNodePos(int node, const chai3d::cVector3d& pos);
+
+	// move the proxy toward the cursor and return the force on the cursor, stiffness times their
+	// distance. radius is the clearance between the proxy and the surface
+	chai3d::cVector3d computeForce(const chai3d::cVector3d& cursor, double radius, double stiffness);
+
+	// the proxy starts at the cursor again on the next computeForce (the cursor left the cloth)
+	void release() { m_active = false; }
+
+	const chai3d::cVector3d& getProxy() const { return m_proxy; }
+
+	// node position the surface was last refitted to
+	const chai3d::cVector3d& getNodePos(int node) const { return m_positions[node]; }
+
+	// closest point of the surface to the proxy after computeForce, false if no triangle was in reach
+	bool getSurfacePoint(chai3d::cVector3d& point) const;
+
+	// nodes taking the reaction of the last computeForce and their weights, empty without contact
+	int getNumContactNodes() const { return m_numContactNodes; }
+	int getContactNode(int k) const { return m_contactNodes[k]; }
+	double getContactWeight(int k) const { return m_contactWeights[k]; }
+
+private:
+	// closest point of the candidate triangles to point, its triangle (-1 if none), distance and
+	// barycentric weights on the triangle nodes
+	struct Closest
+	{
+		chai3d::cVector3d point;
+		int triangle;
+		double distance;
+		double weights[3];
+	};
+	Closest findClosest(const chai3d::cVector3d& point) const;
+
+	// push the proxy out of the surface along the direction to its closest point
+	void pushOut(double radius);
+
+	// advance the proxy on a straight line toward target. returns true if it stopped on the
+	// surface while moving into it, normal then points from the surface to the proxy
+	bool advance(const chai3d::cVector3d& target, double radius, chai3d::cVector3d& normal);
+
+	std::vector<int> m_indices;
+	std::vector<chai3d::cVector3d> m_positions;
+	TriangleBVH m_bvh;
+
+	// triangles in reach of the proxy this tick
+	std::vector<int> m_candidates;
+
+	chai3d::cVector3d m_proxy;
+	bool m_active;
+
+	Closest m_closest;
+	int m_numContactNodes;
+	int m_contactNodes[3];
+	double m_contactWeights[3];
+};
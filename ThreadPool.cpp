@@ -0,0 +1,118 @@
+#include "ThreadPool.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+    // busy wait, giving the core away once in a while so an oversubscribed machine still progresses
+    template <typename Condition>
+    inline void spinUntil(Condition condition) {
+        for (int spin = 0; !condition(); spin++) {
+            if (spin > 64)
+                std::this_thread::yield();
+        }
+    }
+}
+
+ThreadPool::ThreadPool(int numThreads, int reservedCore) :
+    m_numThreads(numThreads < 1 ? 1 : numThreads), m_task(nullptr),
+    m_generation(0), m_pending(0), m_stop(false), m_barrierCount(0), m_barrierGeneration(0) {
+
+    // spread the workers over all cores but the reserved one
+    int numCores = getNumCores();
+    for (int thread = 1; thread < m_numThreads; thread++) {
+        int core = -1;
+        if (numCores > 1) {
+            core = (thread - 1) % (numCores - 1);
+            if (core >= reservedCore)
+                core++;
+        }
+        m_workers.emplace_back(&ThreadPool::workerLoop, this, thread, core);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    m_stop.store(true, std::memory_order_release);
+    for (std::thread& worker : m_workers)
+        worker.join();
+}
+
+void ThreadPool::run(const std::function<void(int, int)>& task) {
+    if (m_numThreads == 1) {
+        task(0, 1);
+        return;
+    }
+
+    m_task = &task;
+    m_pending.store(m_numThreads - 1, std::memory_order_relaxed);
+    m_generation.fetch_add(1, std::memory_order_release);
+
+    task(0, m_numThreads);
+
+    spinUntil([this] { return m_pending.load(std::memory_order_acquire) == 0; });
+    m_task = nullptr;
+}
+
+void ThreadPool::barrier() {
+    if (m_numThreads == 1)
+        return;
+
+    unsigned generation = m_barrierGeneration.load(std::memory_order_acquire);
+    if (m_barrierCount.fetch_add(1, std::memory_order_acq_rel) == m_numThreads - 1) {
+        // last one in releases the others
+        m_barrierCount.store(0, std::memory_order_relaxed);
+        m_barrierGeneration.fetch_add(1, std::memory_order_release);
+        return;
+    }
+    spinUntil([this, generation] { return m_barrierGeneration.load(std::memory_order_acquire) != generation; });
+}
+
+void ThreadPool::split(int count, int thread, int numThreads, int& first, int& last) {
+    first = (int)((long long)count * thread / numThreads);
+    last = (int)((long long)count * (thread + 1) / numThreads);
+}
+
+int ThreadPool::getNumCores() {
+    unsigned cores = std::thread::hardware_concurrency();
+    return cores > 0 ? (int)cores : 1;
+}
+
+bool ThreadPool::pinCurrentThread(int core) {
+    if (core < 0 || core >= getNumCores())
+        return false;
+#if defined(_WIN32)
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+void ThreadPool::workerLoop(int thread, int core) {
+    pinCurrentThread(core);
+
+    unsigned seen = 0;
+    while (true) {
+        spinUntil([this, seen] {
+            return m_generation.load(std::memory_order_acquire) != seen || m_stop.load(std::memory_order_acquire);
+        });
+        if (m_stop.load(std::memory_order_acquire))
+            return;
+
+        seen = m_generation.load(std::memory_order_acquire);
+        (*m_task)(thread, m_numThreads);
+        m_pending.fetch_sub(1, std::memory_order_acq_rel);
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// persistent worker threads for the cloth step. run() executes a task on every worker and on the
+// calling thread and returns once all of them finished, barrier() separates phases inside a task.
+// workers spin (yielding) instead of sleeping, so a 1 kHz caller never pays for a wake-up, and
+// are pinned to cores other than the reserved one, which is left to the haptic thread
+
+class ThreadPool
+{
+public:
+	// numThreads counts the calling thread, so 1 means no workers
+	ThreadPool(int numThreads, int reservedCore = 0);
+	~ThreadPool();
+
+	// not copyable
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator= (const ThreadPool&) = delete;
+
+	int getNumThreads() const { return m_numThreads; }
+
+	// task(thread, numThreads) with thread 0 being the caller, not reentrant
+	void run(const std::function<void(int, int)>& task);
+
+	// wait until all threads of the current task reached it
+	void barrier();
+
+	// contiguous share of [0, count) of a thread, the same split for the same thread count
+	static void split(int count, int thread, int numThreads, int& first, int& last);
+
+	static int getNumCores();
+
+	// returns false if pinning is not supported or failed
+	static bool pinCurrentThread(int core);
+
+private:
+	void workerLoop(int thread, int core);
+
+	int m_numThreads;
+	std::vector<std::thread> m_workers;
+
+	// current task, a new generation starts it on the workers
+	const std::function<void(int, int)>* m_task;
+	std::atomic<unsigned> m_generation;
+	std::atomic<int> m_pending;
+	std::atomic<bool> m_stop;
+
+	// sense of the barrier flips each time all threads arrived
+	std::atomic<int> m_barrierCount;
+	std::atomic<unsigned> m_barrierGeneration;
+};
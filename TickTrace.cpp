@@ -0,0 +1,119 @@
+#include "TickTrace.h"
+
+#include <algorithm>
+
+TickTrace::TickTrace(int window) :
+    m_tick(0), m_window(window < 1 ? 1 : window), m_windowTicks(0), m_hasSummary(false),
+    m_ring(4096), m_dropped(0), m_file(nullptr), m_running(false) {
+
+    std::fill(m_current.phases, m_current.phases + NUM_PHASES, 0.0f);
+    std::fill(m_sum, m_sum + NUM_PHASES, 0.0);
+    std::fill(m_max, m_max + NUM_PHASES, 0.0);
+    m_last = std::chrono::steady_clock::now();
+}
+
+TickTrace::~TickTrace() {
+    stopFile();
+}
+
+const char* TickTrace::getPhaseName(TracePhase phase) {
+    switch (phase) {
+    case PHASE_DEVICE: return "device";
+    case PHASE_CONTACT: return "contact";
+    case PHASE_TABLE: return "table";
+    case PHASE_STIFFNESS: return "stiffness";
+    case PHASE_DYNAMICS: return "dynamics";
+    case PHASE_GLOBAL_POSITIONS: return "positions";
+    case PHASE_INTERACTION: return "interaction";
+    case PHASE_APPLY: return "apply";
+    case PHASE_COLLISION: return "collision";
+    default: return "";
+    }
+}
+
+void TickTrace::endTick() {
+    m_current.tick = m_tick++;
+    if (m_file && !m_ring.push(m_current))
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+
+    for (int p = 0; p < NUM_PHASES; p++) {
+        m_sum[p] += m_current.phases[p];
+        m_max[p] = std::max(m_max[p], (double)m_current.phases[p]);
+        m_current.phases[p] = 0.0f;
+    }
+
+    if (++m_windowTicks < m_window)
+        return;
+
+    TickSummary& summary = m_summaries.getWriteBuffer();
+    summary.meanTotal = 0.0;
+    for (int p = 0; p < NUM_PHASES; p++) {
+        summary.mean[p] = m_sum[p] / m_windowTicks;
+        summary.max[p] = m_max[p];
+        summary.meanTotal += summary.mean[p];
+        m_sum[p] = 0.0;
+        m_max[p] = 0.0;
+    }
+    summary.ticks = m_tick;
+    m_summaries.publish();
+    m_windowTicks = 0;
+}
+
+bool TickTrace::getSummary(TickSummary& summary) {
+    if (m_summaries.update())
+        m_hasSummary = true;
+    if (!m_hasSummary)
+        return false;
+    summary = m_summaries.getReadBuffer();
+    return true;
+}
+
+bool TickTrace::startFile(const std::string& path) {
+    stopFile();
+
+    m_file = fopen(path.c_str(), "w");
+    if (!m_file)
+        return false;
+
+    fprintf(m_file, "tick");
+    for (int p = 0; p < NUM_PHASES; p++)
+        fprintf(m_file, " %s", getPhaseName((TracePhase)p));
+    fprintf(m_file, "\n");
+
+    m_running = true;
+    m_writer = std::thread(&TickTrace::writerLoop, this);
+    return true;
+}
+
+void TickTrace::stopFile() {
+    if (!m_file)
+        return;
+
+    m_running = false;
+    m_writer.join();
+    flush();
+    fclose(m_file);
+    m_file = nullptr;
+}
+
+size_t TickTrace::flush() {
+    size_t written = 0;
+    size_t count;
+    while ((count = m_ring.pop(m_chunk, sizeof(m_chunk) / sizeof(m_chunk[0]))) > 0) {
+        for (size_t k = 0; k < count; k++) {
+            fprintf(m_file, "%llu", m_chunk[k].tick);
+            for (int p = 0; p < NUM_PHASES; p++)
+                fprintf(m_file, " %.2f", m_chunk[k].phases[p]);
+            fprintf(m_file, "\n");
+        }
+        written += count;
+    }
+    return written;
+}
+
+void TickTrace::writerLoop() {
+    while (m_running.load(std::memory_order_acquire)) {
+        if (flush() == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+}
@@ -0,0 +1,217 @@
+#include "TriangleBVH.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <functional>
+
+TriangleBVH::TriangleBVH() : m_margin(0.0) {
+}
+
+void TriangleBVH::build(const std::vector<int>& indices, const std::vector<chai3d::cVector3d>& positions, double margin) {
+    m_indices = indices;
+    m_positions = positions;
+    m_margin = margin;
+
+    int numTriangles = (int)indices.size() / 3;
+    int numVertices = (int)positions.size();
+
+    // vertex -> triangles adjacency
+    m_vertexTriangleStart.assign(numVertices + 1, 0);
+    for (int v : m_indices)
+        m_vertexTriangleStart[v + 1]++;
+    for (int v = 0; v < numVertices; v++)
+        m_vertexTriangleStart[v + 1] += m_vertexTriangleStart[v];
+    m_vertexTriangles.resize(m_indices.size());
+    std::vector<int> fill(m_vertexTriangleStart.begin(), m_vertexTriangleStart.end() - 1);
+    for (int t = 0; t < numTriangles; t++)
+        for (int k = 0; k < 3; k++)
+            m_vertexTriangles[fill[m_indices[3 * t + k]]++] = t;
+
+    std::vector<double> centroids(3 * numTriangles);
+    for (int t = 0; t < numTriangles; t++) {
+        chai3d::cVector3d c = (positions[indices[3 * t]] + positions[indices[3 * t + 1]] + positions[indices[3 * t + 2]]) / 3.0;
+        centroids[3 * t + 0] = c.x();
+        centroids[3 * t + 1] = c.y();
+        centroids[3 * t + 2] = c.z();
+    }
+
+    m_order.resize(numTriangles);
+    for (int t = 0; t < numTriangles; t++)
+        m_order[t] = t;
+    m_triangleLeaf.resize(numTriangles);
+
+    m_nodes.clear();
+    m_nodes.reserve(2 * numTriangles / LEAF_SIZE + 1);
+    if (numTriangles > 0)
+        buildNode(0, numTriangles, -1, centroids);
+
+    // parents come before children, fit bottom-up
+    for (int n = (int)m_nodes.size() - 1; n >= 0; n--) {
+        if (m_nodes[n].left < 0)
+            fitLeaf(m_nodes[n]);
+        else
+            fitInternal(m_nodes[n]);
+    }
+
+    m_dirty.assign(m_nodes.size(), 0);
+}
+
+int TriangleBVH::buildNode(int first, int last, int parent, const std::vector<double>& centroids) {
+    int index = (int)m_nodes.size();
+    m_nodes.push_back(Node());
+    m_nodes[index].parent = parent;
+    m_nodes[index].left = -1;
+    m_nodes[index].right = -1;
+    m_nodes[index].first = first;
+    m_nodes[index].count = last - first;
+
+    if (last - first <= LEAF_SIZE) {
+        for (int k = first; k < last; k++)
+            m_triangleLeaf[m_order[k]] = index;
+        return index;
+    }
+
+    // split at the median centroid along the longest axis
+    double lo[3] = { DBL_MAX, DBL_MAX, DBL_MAX };
+    double hi[3] = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+    for (int k = first; k < last; k++) {
+        for (int a = 0; a < 3; a++) {
+            lo[a] = std::min(lo[a], centroids[3 * m_order[k] + a]);
+            hi[a] = std::max(hi[a], centroids[3 * m_order[k] + a]);
+        }
+    }
+    int axis = 0;
+    if (hi[1] - lo[1] > hi[axis] - lo[axis]) axis = 1;
+    if (hi[2] - lo[2] > hi[axis] - lo[axis]) axis = 2;
+
+    int middle = (first + last) / 2;
+    std::nth_element(m_order.begin() + first, m_order.begin() + middle, m_order.begin() + last,
+        [&](int a, int b) { return centroids[3 * a + axis] < centroids[3 * b + axis]; });
+
+    int left = buildNode(first, middle, index, centroids);
+    int right = buildNode(middle, last, index, centroids);
+    m_nodes[index].left = left;
+    m_nodes[index].right = right;
+    return index;
+}
+
+void TriangleBVH::fitLeaf(Node& node) {
+    for (int a = 0; a < 3; a++) {
+        node.min[a] = DBL_MAX;
+        node.max[a] = -DBL_MAX;
+    }
+    for (int k = node.first; k < node.first + node.count; k++) {
+        int t = m_order[k];
+        for (int v = 0; v < 3; v++) {
+            const chai3d::cVector3d& p = m_positions[m_indices[3 * t + v]];
+            for (int a = 0; a < 3; a++) {
+                node.min[a] = std::min(node.min[a], p.get(a) - m_margin);
+                node.max[a] = std::max(node.max[a], p.get(a) + m_margin);
+            }
+        }
+    }
+}
+
+void TriangleBVH::fitInternal(Node& node) {
+    const Node& l = m_nodes[node.left];
+    const Node& r = m_nodes[node.right];
+    for (int a = 0; a < 3; a++) {
+        node.min[a] = std::min(l.min[a], r.min[a]);
+        node.max[a] = std::max(l.max[a], r.max[a]);
+    }
+}
+
+int TriangleBVH::refit(const std::vector<chai3d::cVector3d>& positions) {
+    m_dirtyNodes.clear();
+
+    // leaves touching a moved vertex
+    int numVertices = std::min((int)positions.size(), (int)m_positions.size());
+    for (int v = 0; v < numVertices; v++) {
+        const chai3d::cVector3d& p = positions[v];
+        chai3d::cVector3d& cached = m_positions[v];
+        if (p.x() == cached.x() && p.y() == cached.y() && p.z() == cached.z())
+            continue;
+        cached = p;
+
+        for (int k = m_vertexTriangleStart[v]; k < m_vertexTriangleStart[v + 1]; k++) {
+            int leaf = m_triangleLeaf[m_vertexTriangles[k]];
+            if (!m_dirty[leaf]) {
+                m_dirty[leaf] = 1;
+                m_dirtyNodes.push_back(leaf);
+            }
+        }
+    }
+
+    // and their ancestors, stop at the first one already collected
+    size_t numLeaves = m_dirtyNodes.size();
+    for (size_t k = 0; k < numLeaves; k++) {
+        int n = m_nodes[m_dirtyNodes[k]].parent;
+        while (n >= 0 && !m_dirty[n]) {
+            m_dirty[n] = 1;
+            m_dirtyNodes.push_back(n);
+            n = m_nodes[n].parent;
+        }
+    }
+
+    // children have larger indices than their parent
+    std::sort(m_dirtyNodes.begin(), m_dirtyNodes.end(), std::greater<int>());
+    for (int n : m_dirtyNodes) {
+        if (m_nodes[n].left < 0)
+            fitLeaf(m_nodes[n]);
+        else
+            fitInternal(m_nodes[n]);
+        m_dirty[n] = 0;
+    }
+
+    return (int)m_dirtyNodes.size();
+}
+
+void TriangleBVH::querySegment(const chai3d::cVector3d& a, const chai3d::cVector3d& b, double radius, std::vector<int>& result) const {
+    if (m_nodes.empty())
+        return;
+
+    double origin[3] = { a.x(), a.y(), a.z() };
+    double dir[3] = { b.x() - a.x(), b.y() - a.y(), b.z() - a.z() };
+
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const Node& node = m_nodes[stack[--top]];
+
+        // slab test of the segment against the box grown by radius
+        double t0 = 0.0, t1 = 1.0;
+        bool hit = true;
+        for (int k = 0; k < 3 && hit; k++) {
+            double lo = node.min[k] - radius;
+            double hi = node.max[k] + radius;
+            if (fabs(dir[k]) < 1e-12) {
+                hit = (origin[k] >= lo) && (origin[k] <= hi);
+            }
+            else {
+                double inv = 1.0 / dir[k];
+                double ta = (lo - origin[k]) * inv;
+                double tb = (hi - origin[k]) * inv;
+                t0 = std::max(t0, std::min(ta, tb));
+                t1 = std::min(t1, std::max(ta, tb));
+                hit = t0 <= t1;
+            }
+        }
+        if (!hit)
+            continue;
+
+        if (node.left < 0) {
+            result.insert(result.end(), m_order.begin() + node.first, m_order.begin() + node.first + node.count);
+        }
+        else if (top + 2 <= 64) {
+            stack[top++] = node.left;
+            stack[top++] = node.right;
+        }
+    }
+}
+
+void TriangleBVH::querySphere(const chai3d::cVector3d& center, double radius, std::vector<int>& result) const {
+    querySegment(center, center, radius, result);
+}
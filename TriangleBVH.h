@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+
+#include "chai3d.h"
+
+// bounding volume hierarchy over a triangle mesh with fixed topology. refit() compares vertex
+// positions with the last call and updates only the leaves touching moved vertices and their
+// ancestors, so the tree is never rebuilt while the mesh deforms
+
+class TriangleBVH
+{
+public:
+	TriangleBVH();
+	~TriangleBVH() = default;
+
+	// 3 vertex indices per triangle, margin enlarges every box
+	void build(const std::vector<int>& indices, const std::vector<chai3d::cVector3d>& positions, double margin = 0.0);
+
+	// returns the number of refit nodes, 0 if nothing moved
+	int refit(const std::vector<chai3d::cVector3d>& positions);
+
+	// append triangles whose box comes within radius of the segment ab
+	void querySegment(const chai3d::cVector3d& a, const chai3d::cVector3d& b, double radius, std::vector<int>& result) const;
+
+	// append triangles whose box comes within radius of the point
+	void querySphere(const chai3d::cVector3d& center, double radius, std::vector<int>& result) const;
+
+	int getNumTriangles() const { return (int)m_triangleLeaf.size(); }
+	int getNumNodes() const { return (int)m_nodes.size(); }
+
+private:
+	struct Node
+	{
+		double min[3];
+		double max[3];
+		int parent;
+		int left;		// -1 for leaves
+		int right;
+		int first;		// leaves: range in m_order
+		int count;
+	};
+
+	int buildNode(int first, int last, int parent, const std::vector<double>& centroids);
+	void fitLeaf(Node& node);
+	void fitInternal(Node& node);
+
+	std::vector<Node> m_nodes;
+
+	// triangles sorted by leaf, and the leaf of each triangle
+	std::vector<int> m_order;
+	std::vector<int> m_triangleLeaf;
+
+	// mesh copy, positions as of the last build/refit
+	std::vector<int> m_indices;
+	std::vector<chai3d::cVector3d> m_positions;
+
+	// triangles around each vertex (compressed rows)
+	std::vector<int> m_vertexTriangleStart;
+	std::vector<int> m_vertexTriangles;
+
+	// scratch for refit
+	std::vector<unsigned char> m_dirty;
+	std::vector<int> m_dirtyNodes;
+
+	double m_margin;
+
+	// triangles per leaf
+	static const int LEAF_SIZE = 4;
+};
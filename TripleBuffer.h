@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+
+// lock-free single producer / single consumer triple buffer. the writer fills its back buffer
+// and publishes it without ever waiting, the reader always picks up the latest complete one.
+// buffers are only swapped, never copied, so T can be preallocated once
+
+template <typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() : m_middle(1), m_back(0), m_front(2) {}
+	~TripleBuffer() = default;
+
+	// not copyable
+	TripleBuffer(const TripleBuffer&) = delete;
+	TripleBuffer& operator= (const TripleBuffer&) = delete;
+
+	// setup before the threads start, e.g. to preallocate
+	T& getBuffer(int index) { return m_buffers[index]; }
+
+	// writer thread: fill, then publish
+	T& getWriteBuffer() { return m_buffers[m_back]; }
+	void publish() {
+		int previous = m_middle.exchange(m_back | FRESH, std::memory_order_acq_rel);
+		m_back = previous & INDEX;
+	}
+
+	// reader thread: returns true if a newer buffer was published since the last call
+	bool update() {
+		if (!(m_middle.load(std::memory_order_relaxed) & FRESH))
+			return false;
+		int previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+		m_front = previous & INDEX;
+		return true;
+	}
+	const T& getReadBuffer() { return m_buffers[m_front]; }
+
+private:
+	static const int INDEX = 3;
+	static const int FRESH = 4;
+
+	T m_buffers[3];
+
+	// index of the buffer in between and whether it holds an unread publish
+	std::atomic<int> m_middle;
+
+	// owned by the writer and the reader respectively
+	int m_back;
+	int m_front;
+};
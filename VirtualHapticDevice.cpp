@@ -0,0 +1,86 @@
+#include "VirtualHapticDevice.h"
+
+VirtualHapticDevice::VirtualHapticDevice(Trajectory trajectory, double workspaceRadius) :
+    chai3d::cGenericHapticDevice(0), m_trajectory(trajectory), m_time(0.0) {
+
+    // pretend to be a small 3-dof impedance device
+    m_specifications.m_model = chai3d::C_HAPTIC_DEVICE_VIRTUAL;
+    m_specifications.m_modelName = "virtual device";
+    m_specifications.m_manufacturerName = "scripted";
+    m_specifications.m_maxLinearForce = 8.0;                // [N]
+    m_specifications.m_maxAngularTorque = 0.0;              // [N*m]
+    m_specifications.m_maxGripperForce = 0.0;               // [N]
+    m_specifications.m_maxLinearStiffness = 2000.0;         // [N/m]
+    m_specifications.m_maxAngularStiffness = 0.0;           // [N*m/Rad]
+    m_specifications.m_maxGripperLinearStiffness = 0.0;     // [N*m]
+    m_specifications.m_maxLinearDamping = 10.0;             // [N/(m/s)]
+    m_specifications.m_maxAngularDamping = 0.0;             // [N*m/(Rad/s)]
+    m_specifications.m_maxGripperAngularDamping = 0.0;      // [N*m/(Rad/s)]
+    m_specifications.m_workspaceRadius = workspaceRadius;   // [m]
+    m_specifications.m_gripperMaxAngleRad = 0.0;
+    m_specifications.m_sensedPosition = true;
+    m_specifications.m_sensedRotation = false;
+    m_specifications.m_sensedGripper = false;
+    m_specifications.m_actuatedPosition = true;
+    m_specifications.m_actuatedRotation = false;
+    m_specifications.m_actuatedGripper = false;
+    m_specifications.m_leftHand = true;
+    m_specifications.m_rightHand = true;
+
+    m_deviceAvailable = true;
+    m_deviceReady = false;
+}
+
+bool VirtualHapticDevice::open() {
+    m_deviceReady = true;
+    return (chai3d::C_SUCCESS);
+}
+
+bool VirtualHapticDevice::close() {
+    m_deviceReady = false;
+    return (chai3d::C_SUCCESS);
+}
+
+bool VirtualHapticDevice::calibrate(bool a_forceCalibration) {
+    return (chai3d::C_SUCCESS);
+}
+
+bool VirtualHapticDevice::getPosition(chai3d::cVector3d& a_position) {
+    if (m_trajectory)
+        a_position = m_trajectory(m_time);
+    else
+        a_position.zero();
+    return (chai3d::C_SUCCESS);
+}
+
+bool VirtualHapticDevice::getRotation(chai3d::cMatrix3d& a_rotation) {
+    a_rotation.identity();
+    return (chai3d::C_SUCCESS);
+}
+
+bool VirtualHapticDevice::getGripperAngleRad(double& a_angle) {
+    a_angle = 0.0;
+    return (chai3d::C_SUCCESS);
+}
+
+bool VirtualHapticDevice::getUserSwitches(unsigned int& a_userSwitches) {
+    a_userSwitches = 0;
+    return (chai3d::C_SUCCESS);
+}
+
+bool VirtualHapticDevice::setForceAndTorqueAndGripperForce(const chai3d::cVector3d& a_force,
+    const chai3d::cVector3d& a_torque, double a_gripperForce) {
+    m_lastForce = a_force;
+    return (chai3d::C_SUCCESS);
+}
+
+VirtualHapticDevice::Trajectory VirtualHapticDevice::pokeAndCircle(chai3d::cVector3d center, double depth, double radius, double period) {
+    return [=](double t) {
+        double phase = 2.0 * chai3d::C_PI * t / period;
+        // press down over the first half period, then keep circling at full depth
+        double press = chai3d::cMin(1.0, 2.0 * t / period);
+        return chai3d::cVector3d(center.x() + radius * cos(phase),
+            center.y() + radius * sin(phase),
+            center.z() - depth * press);
+    };
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <functional>
+
+#include "chai3d.h"
+
+// a scripted stand-in for a physical haptic device, used to drive the haptic loop
+// without hardware (benchmarks, headless runs)
+
+class VirtualHapticDevice : public chai3d::cGenericHapticDevice
+{
+public:
+	// device position [m] as a function of script time [s], in device workspace coordinates
+	typedef std::function<chai3d::cVector3d(double)> Trajectory;
+
+	VirtualHapticDevice(Trajectory trajectory = nullptr, double workspaceRadius = 0.04);
+	~VirtualHapticDevice() = default;
+
+	bool open() override;
+	bool close() override;
+	bool calibrate(bool a_forceCalibration = false) override;
+
+	bool getPosition(chai3d::cVector3d& a_position) override;
+	bool getRotation(chai3d::cMatrix3d& a_rotation) override;
+	bool getGripperAngleRad(double& a_angle) override;
+	bool getUserSwitches(unsigned int& a_userSwitches) override;
+	bool setForceAndTorqueAndGripperForce(const chai3d::cVector3d& a_force,
+		const chai3d::cVector3d& a_torque, double a_gripperForce) override;
+
+	// advance the script clock, the device is only moved by the caller
+	void advance(double dt) { m_time += dt; }
+	void setTime(double time) { m_time = time; }
+	double getTime() { return m_time; }
+
+	void setTrajectory(Trajectory trajectory) { m_trajectory = trajectory; }
+
+	// last force commanded by the application
+	chai3d::cVector3d getLastForce() { return m_lastForce; }
+
+	// a trajectory that starts at center, pokes down by depth and circles around it
+	static Trajectory pokeAndCircle(chai3d::cVector3d center, double depth, double radius, double period);
+
+private:
+	Trajectory m_trajectory;
+
+	// script time [s]
+	double m_time;
+
+	chai3d::cVector3d m_lastForce;
+};
@@ -9,6 +9,11 @@
 #include "Macro.h"
 #include "Global.h"
 #include "ChaiWorld.h"
+#include "FramePacer.h"
+#include "HapticBenchmark.h"
+#include "HapticScheduler.h"
+#include "ReplayHapticDevice.h"
+#include "SceneFile.h"
 
 #include <GLFW/glfw3.h> // must include after chai3d
 //------------------------------------------------------------------------------
@@ -27,6 +32,12 @@ Polygons* polygonCloth;
 // a label to display the rate [Hz] at which the simulation is running
 chai3d::cLabel* labelHapticRate;
 
+// a label to display the time [us] of each phase of the haptic tick, tracing only
+chai3d::cLabel* labelTickPhases = NULL;
+
+// a label to display the frame time and CPU usage of the graphics loop
+chai3d::cLabel* labelFrame;
+
 // flag to indicate if the haptic simulation currently running
 bool simulationRunning = false;
 
@@ -42,6 +53,40 @@ chai3d::cFrequencyCounter freqCounterHaptics;
 // haptic thread
 chai3d::cThread* hapticsThread;
 
+// rate [Hz] of the haptic thread and its scheduler
+double hapticRate = 1000.0;
+HapticScheduler* hapticScheduler = NULL;
+
+// SCHED_FIFO priority of the haptic thread, 0 for a normal thread
+int hapticPriority = 0;
+
+// cloth thread, multi-rate mode only
+chai3d::cThread* clothThread = NULL;
+
+// rate [Hz] of the cloth thread in multi-rate mode
+double clothRate = 250.0;
+
+// flag to indicate if the cloth simulation has terminated
+bool clothFinished = true;
+
+// a frequency counter to measure the cloth rate
+chai3d::cFrequencyCounter freqCounterCloth;
+
+// simulation engine of the cloth in the scene
+ClothEngine clothEngine = ClothEngine::GEL;
+
+// scene file replacing the scene composed in main, empty for none
+std::string scenePath;
+
+// device recording written by the haptic loop, and the recording replayed instead of the device
+DeviceRecorder recorder;
+std::string recordPath;
+std::shared_ptr<ReplayHapticDevice> replayDevice;
+
+// per-phase timing of the haptic tick, and the file it is written to (empty for screen only)
+TickTrace* tickTrace = NULL;
+std::string tracePath;
+
 // a handle to window display context
 GLFWwindow* window = NULL;
 
@@ -54,6 +99,20 @@ int windowHeight = 0;
 // swap interval for the display context (vertical synchronization)
 int swapInterval = 1;
 
+// what the last rendered frame showed, the graphics loop only renders when the cloth, the
+// cursor or the scene version changed, or every labelRefresh [s] to keep the labels current
+unsigned long renderedSceneVersion = (unsigned long)-1;
+chai3d::cVector3d renderedCursorPos;
+chai3d::cPrecisionClock labelClock;
+double labelRefresh = 0.5;
+
+// [ms] the graphics loop waits when nothing changed
+int idleWait = 2;
+
+// frames the GPU may lag behind the graphics loop, 0 finishes every frame
+int framesInFlight = 0;
+FramePacer* framePacer = NULL;
+
 //------------------------------------------------------------------------------
 // STATES
 //------------------------------------------------------------------------------
@@ -79,12 +138,15 @@ void keyCallback(GLFWwindow* a_window, int a_key, int a_scancode, int a_action,
 // callback when a mouse button is pressed
 //void mouseButtonCallback(GLFWwindow* a_window, int a_button, int a_action, int a_mods);
 
-// callback to render graphic scene
-void updateGraphics(void);
+// callback to render graphic scene, returns false if nothing changed and nothing was rendered
+bool updateGraphics(void);
 
 // main haptics simulation loop
 void updateHaptics(void);
 
+// cloth simulation loop of the multi-rate mode
+void updateClothDynamics(void);
+
 //void clothTableCollision(void);
 
 // function that closes the application
@@ -116,12 +178,157 @@ int main(int argc, char* argv[])
     std::cout << "[l] - Enable/Disable polygon wire mode" << std::endl;
     std::cout << "[q] - Exit application" << std::endl;
     std::cout << "[w,a,s,d] - move camera along xy plane" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Command line:" << std::endl << std::endl;
+    std::cout << "--benchmark [ticks] [sizes...] [gel|soa|implicit|xpbd|reduced] [scalar|sse2|avx2] [threads=N] [stiffness=X] [iterations=N] [replay=file] [trace] [validate] [nocollision] [refine=N] [surface] - headless haptic tick latency benchmark, validate adds accuracy checks" << std::endl;
+    std::cout << "--multirate [Hz] - step the cloth on its own thread (default 250 Hz), haptics render a local contact patch" << std::endl;
+    std::cout << "--rate Hz - fixed rate of the haptic loop (default 1000 Hz)" << std::endl;
+    std::cout << "--realtime [priority] - real-time priority (SCHED_FIFO on Linux, default 80) and core 0 for the haptic thread" << std::endl;
+    std::cout << "--pipeline [frames] - fence instead of finishing each frame, up to frames (default 2) in flight" << std::endl;
+    std::cout << "--nocollision - let cloth nodes pass through each other and through other cloths" << std::endl;
+    std::cout << "--refine [factor] - simulate SoA cloths factor times finer (default 2) around the cursor" << std::endl;
+    std::cout << "--surface - render the cursor contact on the triangle surface of the cloth with a proxy instead of on its nodes" << std::endl;
+    std::cout << "--threads N - step SoA cloths on N threads, workers stay off the haptic thread's core" << std::endl;
+    std::cout << "--engine gel|soa|implicit|xpbd|reduced - simulation engine of the cloth (default gel), reduced fits a modal model once and caches it" << std::endl;
+    std::cout << "--record file - record the device state of every haptic tick" << std::endl;
+    std::cout << "--replay file - replay a recording in real time instead of the device" << std::endl;
+    std::cout << "--trace [file] - time each phase of the haptic tick, shown under the rates and written to file" << std::endl;
+    std::cout << "--scene file - load the scene from a text file (see SceneFile.h), compiled into file.cache on first load" << std::endl;
     std::cout << std::endl << std::endl;
 
     // parse first arg to try and locate resources
     resourceRoot = std::string(argv[0]).substr(0, std::string(argv[0]).find_last_of("/\\") + 1);
     std::cout << std::string(argv[0]) << std::endl;
 
+    // run the headless benchmark instead of the interactive scene, no window or device needed
+    if (argc > 1 && std::string(argv[1]) == "--benchmark")
+    {
+        HapticBenchmark benchmark(ChaiWorld::chaiWorld);
+        if (!benchmark.parseArguments(argc - 2, argv + 2))
+            return 1;
+        return benchmark.run(std::cout);
+    }
+
+    for (int k = 1; k < argc; k++)
+    {
+        std::string arg = argv[k];
+
+        // step the cloth on its own thread at a lower rate than the haptic loop
+        if (arg == "--multirate")
+        {
+            if (k + 1 < argc && isdigit((unsigned char)argv[k + 1][0]))
+                clothRate = atof(argv[++k]);
+            if (clothRate <= 0.0 || clothRate > 1000.0)
+            {
+                std::cout << "cloth rate must be in (0, 1000] Hz" << std::endl;
+                return 1;
+            }
+            ChaiWorld::chaiWorld.setMultiRate(true);
+        }
+        else if (arg == "--rate" && k + 1 < argc)
+        {
+            hapticRate = atof(argv[++k]);
+            if (hapticRate <= 0.0)
+            {
+                std::cout << "haptic rate must be positive" << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--realtime")
+        {
+            hapticPriority = 80;
+            if (k + 1 < argc && isdigit((unsigned char)argv[k + 1][0]))
+                hapticPriority = atoi(argv[++k]);
+        }
+        else if (arg == "--pipeline")
+        {
+            framesInFlight = 2;
+            if (k + 1 < argc && isdigit((unsigned char)argv[k + 1][0]))
+                framesInFlight = atoi(argv[++k]);
+            if (framesInFlight < 1 || framesInFlight > 4)
+            {
+                std::cout << "frames in flight must be in [1, 4]" << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--nocollision")
+        {
+            ChaiWorld::chaiWorld.setClothCollision(false);
+        }
+        // adaptive resolution around the cursor, must be set before the scene is composed
+        else if (arg == "--refine")
+        {
+            int factor = 2;
+            if (k + 1 < argc && isdigit((unsigned char)argv[k + 1][0]))
+                factor = atoi(argv[++k]);
+            if (factor < 1 || factor > 4)
+            {
+                std::cout << "refinement factor must be in [1, 4]" << std::endl;
+                return 1;
+            }
+            ChaiWorld::chaiWorld.setClothRefinement(factor);
+        }
+        // proxy on the cloth surface, must be set before the scene is composed
+        else if (arg == "--surface")
+        {
+            ChaiWorld::chaiWorld.setSurfaceContact(true);
+        }
+        // parallel cloth step, must be set before the scene is composed
+        else if (arg == "--threads" && k + 1 < argc)
+        {
+            ChaiWorld::chaiWorld.setClothThreads(atoi(argv[++k]));
+        }
+        else if (arg == "--engine" && k + 1 < argc)
+        {
+            std::string engine = argv[++k];
+            if (engine == "gel")
+                clothEngine = ClothEngine::GEL;
+            else if (engine == "soa")
+                clothEngine = ClothEngine::SoA;
+            else if (engine == "implicit")
+                clothEngine = ClothEngine::Implicit;
+            else if (engine == "xpbd")
+                clothEngine = ClothEngine::XPBD;
+            else if (engine == "reduced")
+                clothEngine = ClothEngine::Reduced;
+            else
+            {
+                std::cout << "unknown engine: " << engine << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--scene" && k + 1 < argc)
+        {
+            scenePath = argv[++k];
+        }
+        else if (arg == "--trace")
+        {
+            if (k + 1 < argc && argv[k + 1][0] != '-')
+                tracePath = argv[++k];
+            tickTrace = new TickTrace();
+        }
+        else if (arg == "--record" && k + 1 < argc)
+        {
+            recordPath = argv[++k];
+        }
+        else if (arg == "--replay" && k + 1 < argc)
+        {
+            replayDevice = std::make_shared<ReplayHapticDevice>();
+            if (!replayDevice->load(argv[++k]))
+            {
+                std::cout << "cannot replay " << argv[k] << std::endl;
+                return 1;
+            }
+            // the scene reads the device stiffness, so switch before composing it
+            ChaiWorld::chaiWorld.setHapticDevice(replayDevice);
+        }
+        else
+        {
+            std::cout << "unknown argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+
     //--------------------------------------------------------------------------
     // OPENGL - WINDOW DISPLAY
     //--------------------------------------------------------------------------
@@ -200,25 +407,74 @@ int main(int argc, char* argv[])
     }
 #endif
 
+    // fences need GL 3.2 or ARB_sync
+    framePacer = new FramePacer(framesInFlight);
+    if (!framePacer->initialize() && framesInFlight > 0)
+        std::cout << "no GL fences, finishing every frame" << std::endl;
+
     //-----------------------------------------------------------------------
     // COMPOSE THE VIRTUAL SCENE
     //-----------------------------------------------------------------------
-    table = new Rigid(4.0, 4.0, chai3d::cVector3d(-0.5, 0.0, -3.5), 0.8, 0.3, 0.2, 1.0);
-    //texture 1
-    cloth = new Deformable(14, 14, chai3d::cVector3d(-0.5, 0.0, -0.1), 10);
-    //texture 2
-    //cloth2 = new Deformable(13, 13, chai3d::cVector3d(-0.5, 1.0, -0.1), 300);
-    //polygon version
-    //polygonCloth = new Polygons(14, 14, chai3d::cVector3d(-0.5, 0.0, -0.1), 0.8, 0.3, 0.2, 1.0);
-
-    if(table)
-        table->AttachToWorld(ChaiWorld::chaiWorld);
-    if(cloth)
-        cloth->AttachToWorld(ChaiWorld::chaiWorld);
-    if(cloth2)
-        cloth2->AttachToWorld(ChaiWorld::chaiWorld);
-    if(polygonCloth)
-        polygonCloth->AttachToWorld(ChaiWorld::chaiWorld);
+    if (!scenePath.empty())
+    {
+        SceneFile scene;
+        if (!scene.load(ChaiWorld::chaiWorld, scenePath, clothEngine))
+        {
+            glfwTerminate();
+            return 1;
+        }
+        std::cout << "scene " << scenePath << (scene.isCached() ? " (cached)" : "") << std::endl;
+
+        // the keyboard toggles act on the first objects of the file
+        table = scene.getRigids().empty() ? NULL : scene.getRigids()[0];
+        cloth = scene.getDeformables().empty() ? NULL : scene.getDeformables()[0];
+        cloth2 = (scene.getDeformables().size() < 2) ? NULL : scene.getDeformables()[1];
+        polygonCloth = scene.getPolygons().empty() ? NULL : scene.getPolygons()[0];
+    }
+    else
+    {
+        table = new Rigid(4.0, 4.0, chai3d::cVector3d(-0.5, 0.0, -3.5), 0.8, 0.3, 0.2, 1.0);
+        //texture 1
+        cloth = new Deformable(14, 14, chai3d::cVector3d(-0.5, 0.0, -0.1), 10, 0.5, 0.1,
+            42.871021, -0.234556, 65.166023, 83.175644, clothEngine);
+        //texture 2
+        //cloth2 = new Deformable(13, 13, chai3d::cVector3d(-0.5, 1.0, -0.1), 300);
+        //polygon version
+        //polygonCloth = new Polygons(14, 14, chai3d::cVector3d(-0.5, 0.0, -0.1), 0.8, 0.3, 0.2, 1.0);
+
+        if(table)
+            table->AttachToWorld(ChaiWorld::chaiWorld);
+        if(cloth)
+            cloth->AttachToWorld(ChaiWorld::chaiWorld);
+        if(cloth2)
+            cloth2->AttachToWorld(ChaiWorld::chaiWorld);
+        if(polygonCloth)
+            polygonCloth->AttachToWorld(ChaiWorld::chaiWorld, cloth);
+    }
+
+    // trace from the first haptic tick on
+    if (tickTrace)
+    {
+        if (!tracePath.empty() && !tickTrace->startFile(tracePath))
+        {
+            std::cout << "cannot trace to " << tracePath << std::endl;
+            glfwTerminate();
+            return 1;
+        }
+        ChaiWorld::chaiWorld.setTrace(tickTrace);
+    }
+
+    // record from the first haptic tick on
+    if (!recordPath.empty())
+    {
+        if (!recorder.start(recordPath, ChaiWorld::chaiWorld.getHapticDeviceInfo()))
+        {
+            std::cout << "cannot record to " << recordPath << std::endl;
+            glfwTerminate();
+            return 1;
+        }
+        ChaiWorld::chaiWorld.setRecorder(&recorder);
+    }
 
     //--------------------------------------------------------------------------
     // WIDGETS
@@ -232,14 +488,36 @@ int main(int argc, char* argv[])
     ChaiWorld::chaiWorld.getCamera()->m_frontLayer->addChild(labelHapticRate);
     labelHapticRate->m_fontColor.setWhite();
 
+    // create a label to display the frame time and CPU usage of the graphics loop
+    labelFrame = new chai3d::cLabel(font);
+    ChaiWorld::chaiWorld.getCamera()->m_frontLayer->addChild(labelFrame);
+    labelFrame->m_fontColor.setWhite();
+
+    // create a label to display the phases of the haptic tick
+    if (tickTrace)
+    {
+        labelTickPhases = new chai3d::cLabel(font);
+        ChaiWorld::chaiWorld.getCamera()->m_frontLayer->addChild(labelTickPhases);
+        labelTickPhases->m_fontColor.setWhite();
+    }
+
     //--------------------------------------------------------------------------
     // START SIMULATION
     //--------------------------------------------------------------------------
 
     // create a thread which starts the main haptics rendering loop
+    hapticScheduler = new HapticScheduler(1.0 / hapticRate);
     hapticsThread = new chai3d::cThread();
     hapticsThread->start(updateHaptics, chai3d::CTHREAD_PRIORITY_HAPTICS);
 
+    // create a thread for the cloth solver in multi-rate mode
+    if (ChaiWorld::chaiWorld.isMultiRate())
+    {
+        clothFinished = false;
+        clothThread = new chai3d::cThread();
+        clothThread->start(updateClothDynamics, chai3d::CTHREAD_PRIORITY_GRAPHICS);
+    }
+
     // setup callback when application exits
     atexit(close);
 
@@ -247,24 +525,36 @@ int main(int argc, char* argv[])
     windowSizeCallback(window, windowWidth, windowHeight);
 
     // main graphic loop
+    labelClock.start(true);
     while (!glfwWindowShouldClose(window))
     {
         // get width and height of window
         glfwGetWindowSize(window, &windowWidth, &windowHeight);
 
-        // render graphics
-        updateGraphics();
+        // render graphics, or leave the core to the simulation threads if nothing changed
+        if (updateGraphics())
+        {
+            // swap buffers
+            glfwSwapBuffers(window);
 
-        // swap buffers
-        glfwSwapBuffers(window);
+            // signal frequency counter
+            freqCounterGraphics.signal(1);
+        }
+        else
+        {
+            chai3d::cSleepMs(idleWait);
+        }
 
         // process events
         glfwPollEvents();
-
-        // signal frequency counter
-        freqCounterGraphics.signal(1);
     }
 
+    // the fences belong to the context
+    framePacer->release();
+    std::cout << "graphics " << (framePacer->isPipelined() ? std::to_string(framePacer->getFramesInFlight()) + " frames in flight" : "finish") <<
+        ": " << framePacer->getFrames() << " frames, " << chai3d::cStr(framePacer->getMeanFrameTime(), 2) << " ms per frame (" <<
+        chai3d::cStr(framePacer->getMeanWaitTime(), 2) << " ms waiting for the GPU), " << chai3d::cStr(framePacer->getMeanCpuUsage(), 0) << " % CPU" << std::endl;
+
     // close window
     glfwDestroyWindow(window);
 
@@ -282,6 +572,7 @@ void windowSizeCallback(GLFWwindow* a_window, int a_width, int a_height)
     // update window size
     windowWidth = a_width;
     windowHeight = a_height;
+    ChaiWorld::chaiWorld.markSceneChanged();
 }
 
 //------------------------------------------------------------------------------
@@ -326,11 +617,11 @@ void keyCallback(GLFWwindow* a_window, int a_key, int a_scancode, int a_action,
         glfwSetWindowShouldClose(a_window, GLFW_TRUE);
         break;
     case GLFW_KEY_K:
-        if (a_action == GLFW_PRESS)
+        if (a_action == GLFW_PRESS && cloth)
             cloth->getDefObject()->m_showSkeletonModel = !cloth->getDefObject()->m_showSkeletonModel;
         break;
     case GLFW_KEY_L:
-        if (a_action == GLFW_PRESS)
+        if (a_action == GLFW_PRESS && polygonCloth)
             polygonCloth->changeWireMode();
         break;
     case GLFW_KEY_F:
@@ -367,6 +658,9 @@ void keyCallback(GLFWwindow* a_window, int a_key, int a_scancode, int a_action,
         ChaiWorld::chaiWorld.getCamera()->setMirrorVertical(kMirroredDisplay);
         break;
     }
+
+    // toggles change what is shown without changing the simulated state
+    ChaiWorld::chaiWorld.markSceneChanged();
 }
 
 void cursorPositionCallback(GLFWwindow* window, double xpos, double ypos) {
@@ -381,7 +675,25 @@ void close(void)
     simulationRunning = false;
 
     // wait for graphics and haptics loops to terminate
-    while (!simulationFinished) { chai3d::cSleepMs(100); }
+    while (!simulationFinished || !clothFinished) { chai3d::cSleepMs(100); }
+
+    // write the rest of the trace
+    if (tickTrace)
+    {
+        ChaiWorld::chaiWorld.setTrace(NULL);
+        tickTrace->stopFile();
+        if (tickTrace->getDroppedSamples() > 0)
+            std::cout << tickTrace->getDroppedSamples() << " ticks dropped from " << tracePath << std::endl;
+    }
+
+    // write the rest of the recording
+    if (recorder.isRecording())
+    {
+        ChaiWorld::chaiWorld.setRecorder(NULL);
+        recorder.stop();
+        if (recorder.getDroppedSamples() > 0)
+            std::cout << recorder.getDroppedSamples() << " samples dropped from " << recordPath << std::endl;
+    }
 
     // close haptic device
     if (ChaiWorld::chaiWorld.getHapticDevice()) {
@@ -393,14 +705,19 @@ void close(void)
 
     // delete resources
     delete hapticsThread;
+    delete hapticScheduler;
+    delete framePacer;
+    delete clothThread;
     delete ChaiWorld::chaiWorld.getWorld();
     delete ChaiWorld::chaiWorld.getHandler();
 }
 
 //------------------------------------------------------------------------------
 
-void updateGraphics(void)
+bool updateGraphics(void)
 {
+    framePacer->beginFrame();
+
     /////////////////////////////////////////////////////////////////////
     // UPDATE CAMERA
     /////////////////////////////////////////////////////////////////////
@@ -415,67 +732,110 @@ void updateGraphics(void)
         ChaiWorld::chaiWorld.cameraMoveRight();
 
 
+    // take the latest cloth state published by the haptic thread, false if it did not move
+    bool clothChanged = ChaiWorld::chaiWorld.updateDisplay();
+
+    // skip the frame if nothing on screen would change
+    chai3d::cVector3d cursorPos = renderedCursorPos;
+    if (ChaiWorld::chaiWorld.getCursor())
+        cursorPos = ChaiWorld::chaiWorld.getCursor()->getDeviceGlobalPos();
+    bool cursorMoved = !cursorPos.equals(renderedCursorPos);
+    bool sceneChanged = ChaiWorld::chaiWorld.getSceneVersion() != renderedSceneVersion;
+    if (!clothChanged && !cursorMoved && !sceneChanged && labelClock.getCurrentTimeSeconds() < labelRefresh)
+        return false;
+
+    renderedCursorPos = cursorPos;
+    renderedSceneVersion = ChaiWorld::chaiWorld.getSceneVersion();
+    labelClock.start(true);
+
+
     /////////////////////////////////////////////////////////////////////
     // UPDATE WIDGETS
     /////////////////////////////////////////////////////////////////////
 
     // display haptic rate data
     labelHapticRate->setText(chai3d::cStr(freqCounterGraphics.getFrequency(), 0) + " Hz / " +
-        chai3d::cStr(freqCounterHaptics.getFrequency(), 0) + " Hz");
+        chai3d::cStr(freqCounterHaptics.getFrequency(), 0) + " Hz" +
+        (ChaiWorld::chaiWorld.isMultiRate() ? " / " + chai3d::cStr(freqCounterCloth.getFrequency(), 0) + " Hz" : "") +
+        " - missed " + std::to_string(hapticScheduler->getMissedDeadlines()) +
+        ", jitter " + chai3d::cStr(hapticScheduler->getJitterMean(), 0) + " / " + chai3d::cStr(hapticScheduler->getJitterMax(), 0) + " us");
 
     // update position of label
     labelHapticRate->setLocalPos((int)(0.5 * (windowWidth - labelHapticRate->getWidth())), 15);
 
+    // frame time, GPU wait and CPU usage of the graphics loop over the last window
+    labelFrame->setText(std::string(framePacer->isPipelined() ? "pipelined " + std::to_string(framePacer->getFramesInFlight()) : "finish") +
+        " - frame " + chai3d::cStr(framePacer->getFrameTime(), 2) + " ms, wait " + chai3d::cStr(framePacer->getWaitTime(), 2) +
+        " ms, cpu " + chai3d::cStr(framePacer->getCpuUsage(), 0) + " %");
+    labelFrame->setLocalPos((int)(0.5 * (windowWidth - labelFrame->getWidth())), 40);
+
+    // mean time of each phase of the haptic tick over the last window
+    TickSummary summary;
+    if (labelTickPhases && tickTrace->getSummary(summary))
+    {
+        std::string text;
+        for (int p = 0; p < NUM_PHASES; p++)
+            text += std::string(TickTrace::getPhaseName((TracePhase)p)) + " " + chai3d::cStr(summary.mean[p], 1) + " | ";
+        labelTickPhases->setText(text + "tick " + chai3d::cStr(summary.meanTotal, 1) + " us");
+        labelTickPhases->setLocalPos((int)(0.5 * (windowWidth - labelTickPhases->getWidth())), 65);
+    }
 
-    // update skins deformable objects
-    ChaiWorld::chaiWorld.getDefWorld()->updateSkins(true);
 
     /////////////////////////////////////////////////////////////////////
     // RENDER SCENE
     /////////////////////////////////////////////////////////////////////
 
-    // update shadow maps (if any)
-    ChaiWorld::chaiWorld.getWorld()->updateShadowMaps(false, kMirroredDisplay);
+    // the CPU-side work is done, wait for the GPU only now
+    framePacer->waitForFrame();
+
+    // update shadow maps (if any), only geometry changes move shadows
+    if (clothChanged || cursorMoved || sceneChanged)
+        ChaiWorld::chaiWorld.getWorld()->updateShadowMaps(false, kMirroredDisplay);
 
     // render world
     ChaiWorld::chaiWorld.getCamera()->renderView(windowWidth, windowHeight);
 
-    if(polygonCloth)
-        ChaiWorld::chaiWorld.updateCloth(polygonCloth);
-
-    // wait until all GL commands are completed
-    glFinish();
+    // finish the frame, or fence it and let the GPU catch up while the next one is prepared
+    framePacer->endFrame();
 
     // check for any OpenGL errors
     GLenum err;
     err = glGetError();
     if (err != GL_NO_ERROR) std::cout << "Error:  %s\n" << gluErrorString(err);
+
+    return true;
 }
 
 //------------------------------------------------------------------------------
 
 void updateHaptics(void)
 {
-    // initialize precision clock
-    chai3d::cPrecisionClock clock;
-    clock.reset();
+    // keep the haptic thread on the core the cloth workers leave free
+    if (ChaiWorld::chaiWorld.getThreadPool() || hapticPriority > 0)
+        ThreadPool::pinCurrentThread(0);
+    if (hapticPriority > 0 && !HapticScheduler::setRealTimePriority(hapticPriority))
+        std::cout << "real-time priority not permitted, running at normal priority" << std::endl;
 
     // simulation in now running
     simulationRunning = true;
     simulationFinished = false;
 
+    // every tick simulates one period, late ticks show up as missed deadlines
+    double time = hapticScheduler->getPeriod();
+    hapticScheduler->start();
+
     // main haptic simulation loop
     while (simulationRunning)
     {
-        // stop clock
-        double time = chai3d::cMin(0.001, clock.stop());
+        // wait for the next deadline
+        double elapsed = hapticScheduler->wait();
 
-        // restart clock
-        clock.start(true);
+        // a replay follows the wall clock
+        if (replayDevice)
+            replayDevice->advance(elapsed);
 
-        //ChaiWorld::chaiWorld.updateHaptics(time, cloth, table);             // one texture
-        //ChaiWorld::chaiWorld.updateHaptics(time, cloth, table, cloth2);   // two texture comparison
-        ChaiWorld::chaiWorld.updateHapticsMulti(time, table, cloth, polygonCloth);
+        // every object attached to the world, e.g. cloth and cloth2 for a two texture comparison
+        ChaiWorld::chaiWorld.updateHapticsMulti(time);
 
         // signal frequency counter
         freqCounterHaptics.signal(1);
@@ -483,4 +843,33 @@ void updateHaptics(void)
 
     // exit haptics thread
     simulationFinished = true;
-}
\ No newline at end of file
+}
+
+//------------------------------------------------------------------------------
+
+void updateClothDynamics(void)
+{
+    // sleep to an absolute deadline without spinning, the haptic thread keeps its core
+    HapticScheduler clothScheduler(1.0 / clothRate, 0.0);
+
+    // wait for the haptic loop so the first step sees the cursor
+    while (!simulationRunning) { chai3d::cSleepMs(1); }
+
+    // every tick simulates one period (substepped by updateClothMulti), late ticks are dropped
+    double time = clothScheduler.getPeriod();
+    clothScheduler.start();
+
+    // main cloth simulation loop, the haptic loop keeps rendering the last contact patch meanwhile
+    while (simulationRunning)
+    {
+        clothScheduler.wait();
+
+        ChaiWorld::chaiWorld.updateClothMulti(time);
+
+        // signal frequency counter
+        freqCounterCloth.signal(1);
+    }
+
+    // exit cloth thread
+    clothFinished = true;
+}